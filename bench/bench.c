@@ -0,0 +1,577 @@
+/**
+ * @file   bench.c
+ *
+ * @brief  Logger benchmarks.
+ *
+ * Each case logs messages in batches. The first message of each batch
+ * is timed alone, and its time without the timer overhead is a
+ * latency sample. Percentiles are computed from the samples. Mean is
+ * wall clock time per message of a thread, and throughput is
+ * messages per wall clock second over all threads.
+ *
+ * Results are printed as a table, and written as JSON if an output
+ * file is given:
+ *
+ *   bench [results.json]
+ *
+ * Environment variable BENCH_COMMIT is stored to JSON as "commit".
+ *
+ */
+
+#include "logger.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define BENCH_ROUNDS 10000000
+#define BENCH_WRITES 1000000
+#define BENCH_BATCH_FAST 1000
+#define BENCH_BATCH_WRITE 16
+#define BENCH_THREADS 4
+#define BENCH_DEPTH 8
+#define BENCH_FANOUT 8
+#define BENCH_GROUPS 10000
+#define BENCH_RESULTS 64
+
+
+/** Case context. */
+st_struct( bench_ctx )
+{
+    lg_host_t host;  /**< Host. */
+    lg_grp_t  grp;   /**< Group handle. */
+    char**    names; /**< Group names (by name cases). */
+    int       cnt;   /**< Group name count. */
+};
+
+
+/** Case function: log "cnt" messages starting from "base". */
+typedef void ( *bench_fn_p )( bench_ctx_t ctx, int base, int cnt );
+
+
+/** Case result. */
+st_struct( bench_result )
+{
+    const char* name;     /**< Case name. */
+    int         threads;  /**< Thread count. */
+    uint64_t    messages; /**< Message count. */
+    double      mean;     /**< Wall clock ns/message per thread. */
+    double      rate;     /**< Messages per second. */
+    double      p50;      /**< Median ns/message. */
+    double      p90;      /**< 90th percentile ns/message. */
+    double      p99;      /**< 99th percentile ns/message. */
+    double      p999;     /**< 99.9th percentile ns/message. */
+    double      max;      /**< Maximum ns/message. */
+};
+
+
+/** Thread work for multithreaded cases. */
+st_struct( bench_work )
+{
+    bench_ctx_s        ctx;     /**< Thread context. */
+    bench_fn_p         fn;      /**< Case function. */
+    int                rounds;  /**< Messages. */
+    int                batch;   /**< Batch size. */
+    double*            samples; /**< Latency samples. */
+    pthread_barrier_t* start;   /**< Start barrier. */
+};
+
+
+static int to_string_calls = 0;
+
+/** Cost of timing an empty section in ns. */
+static double bench_overhead = 0;
+
+static bench_result_s bench_results[ BENCH_RESULTS ];
+static int            bench_result_cnt = 0;
+
+
+
+/* ------------------------------------------------------------
+ * Helpers:
+ */
+
+
+static const char* to_string( int value )
+{
+    static char buf[ 64 ];
+    to_string_calls++;
+    snprintf( buf, sizeof( buf ), "value-%d", value );
+    return buf;
+}
+
+
+static void strftime_prefix( const lg_host_t host, const lg_grp_t grp, const char* msg, sl_p outbuf )
+{
+    struct timespec ts;
+    struct tm       tm;
+    char            buf[ 64 ];
+    size_t          len;
+
+    (void)host;
+    (void)grp;
+    (void)msg;
+
+    clock_gettime( CLOCK_REALTIME, &ts );
+    localtime_r( &ts.tv_sec, &tm );
+    len = strftime( buf, sizeof( buf ), "%Y-%m-%d %H:%M:%S", &tm );
+    snprintf( buf + len, sizeof( buf ) - len, ".%06ld ", ts.tv_nsec / 1000 );
+    sl_concatenate_c( outbuf, buf );
+}
+
+
+static double now_ns( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+
+static int bench_cmp( const void* a, const void* b )
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return ( x > y ) - ( x < y );
+}
+
+
+static double bench_pct( double* samples, int cnt, double pct )
+{
+    int idx;
+
+    idx = (int)( pct * ( cnt - 1 ) + 0.5 );
+    return samples[ idx ];
+}
+
+
+/**
+ * Measure minimum cost of timing an empty section.
+ */
+static double bench_timer_overhead( void )
+{
+    double start;
+    double min;
+    double t;
+    int    i;
+
+    min = 1e9;
+    for ( i = 0; i < 10000; i++ ) {
+        start = now_ns();
+        t = now_ns() - start;
+        if ( t < min )
+            min = t;
+    }
+
+    return min;
+}
+
+
+/**
+ * Log "rounds" messages in batches, and time first message of each
+ * batch to "samples".
+ */
+static void bench_loop( bench_ctx_t ctx, bench_fn_p fn, int rounds, int batch, double* samples )
+{
+    double start;
+    double t;
+    int    i;
+
+    for ( i = 0; i < rounds / batch; i++ ) {
+        start = now_ns();
+        fn( ctx, i * batch, 1 );
+        t = now_ns() - start - bench_overhead;
+        samples[ i ] = t > 0 ? t : 0;
+        fn( ctx, i * batch + 1, batch - 1 );
+    }
+}
+
+
+static void bench_report( const char* name,
+                          int         threads,
+                          int         rounds,
+                          double      wall,
+                          double*     samples,
+                          int         cnt )
+{
+    bench_result_t res;
+
+    if ( bench_result_cnt == BENCH_RESULTS )
+        return;
+
+    res = &bench_results[ bench_result_cnt++ ];
+
+    qsort( samples, cnt, sizeof( double ), bench_cmp );
+
+    res->name = name;
+    res->threads = threads;
+    res->messages = (uint64_t)rounds * threads;
+    res->mean = wall / rounds;
+    res->rate = res->messages / ( wall / 1e9 );
+    res->p50 = bench_pct( samples, cnt, 0.50 );
+    res->p90 = bench_pct( samples, cnt, 0.90 );
+    res->p99 = bench_pct( samples, cnt, 0.99 );
+    res->p999 = bench_pct( samples, cnt, 0.999 );
+    res->max = samples[ cnt - 1 ];
+
+    printf( "%-28s %2d %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %12.0f\n",
+            res->name,
+            res->threads,
+            res->mean,
+            res->p50,
+            res->p90,
+            res->p99,
+            res->p999,
+            res->max,
+            res->rate );
+}
+
+
+/**
+ * Run case in calling thread.
+ */
+static void bench_run( const char* name, bench_ctx_t ctx, bench_fn_p fn, int rounds, int batch )
+{
+    double* samples;
+    double  start;
+    double  wall;
+
+    samples = malloc( sizeof( double ) * ( rounds / batch ) );
+
+    start = now_ns();
+    bench_loop( ctx, fn, rounds, batch, samples );
+    wall = now_ns() - start;
+
+    bench_report( name, 1, rounds, wall, samples, rounds / batch );
+
+    free( samples );
+}
+
+
+static void* bench_worker( void* arg )
+{
+    bench_work_t work = (bench_work_t)arg;
+
+    pthread_barrier_wait( work->start );
+    bench_loop( &work->ctx, work->fn, work->rounds, work->batch, work->samples );
+
+    return NULL;
+}
+
+
+/**
+ * Run case in "threads" threads, each with own context.
+ */
+static void bench_run_mt( const char*  name,
+                          bench_ctx_s* ctxs,
+                          int          threads,
+                          bench_fn_p   fn,
+                          int          rounds,
+                          int          batch )
+{
+    bench_work_s      work[ BENCH_THREADS ];
+    pthread_t         tids[ BENCH_THREADS ];
+    pthread_barrier_t start;
+    double*           samples;
+    double            begin;
+    int               per;
+    int               i;
+
+    per = rounds / batch;
+    samples = malloc( sizeof( double ) * per * threads );
+    pthread_barrier_init( &start, NULL, threads + 1 );
+
+    for ( i = 0; i < threads; i++ ) {
+        work[ i ].ctx = ctxs[ i ];
+        work[ i ].fn = fn;
+        work[ i ].rounds = rounds;
+        work[ i ].batch = batch;
+        work[ i ].samples = samples + i * per;
+        work[ i ].start = &start;
+        pthread_create( &tids[ i ], NULL, bench_worker, &work[ i ] );
+    }
+
+    pthread_barrier_wait( &start );
+    begin = now_ns();
+    for ( i = 0; i < threads; i++ )
+        pthread_join( tids[ i ], NULL );
+
+    bench_report( name, threads, rounds, now_ns() - begin, samples, per * threads );
+
+    pthread_barrier_destroy( &start );
+    free( samples );
+}
+
+
+static void bench_json( const char* file )
+{
+    FILE*          fh;
+    bench_result_t res;
+    const char*    commit;
+    int            i;
+
+    fh = fopen( file, "w" );
+    if ( fh == NULL ) {
+        perror( file );
+        return;
+    }
+
+    commit = getenv( "BENCH_COMMIT" );
+
+    fprintf( fh, "{\n  \"commit\": \"%s\",\n  \"results\": [\n", commit ? commit : "" );
+    for ( i = 0; i < bench_result_cnt; i++ ) {
+        res = &bench_results[ i ];
+        fprintf( fh,
+                 "    { \"name\": \"%s\", \"threads\": %d, \"messages\": %llu, "
+                 "\"mean_ns\": %.2f, \"msgs_per_sec\": %.0f, \"p50_ns\": %.2f, "
+                 "\"p90_ns\": %.2f, \"p99_ns\": %.2f, \"p999_ns\": %.2f, "
+                 "\"max_ns\": %.2f }%s\n",
+                 res->name,
+                 res->threads,
+                 (unsigned long long)res->messages,
+                 res->mean,
+                 res->rate,
+                 res->p50,
+                 res->p90,
+                 res->p99,
+                 res->p999,
+                 res->max,
+                 i + 1 < bench_result_cnt ? "," : "" );
+    }
+    fprintf( fh, "  ]\n}\n" );
+
+    fclose( fh );
+}
+
+
+
+/* ------------------------------------------------------------
+ * Cases:
+ */
+
+
+static void case_lg( bench_ctx_t ctx, int base, int cnt )
+{
+    int i;
+    for ( i = base; i < base + cnt; i++ )
+        lg( ctx->host, "bench", "value: %s", to_string( i ) );
+}
+
+
+static void case_lg_h_str( bench_ctx_t ctx, int base, int cnt )
+{
+    int i;
+    for ( i = base; i < base + cnt; i++ )
+        lg_h( ctx->host, ctx->grp, "value: %s", to_string( i ) );
+}
+
+
+static void case_LG_H( bench_ctx_t ctx, int base, int cnt )
+{
+    int i;
+    for ( i = base; i < base + cnt; i++ )
+        LG_H( ctx->host, ctx->grp, "value: %s", to_string( i ) );
+}
+
+
+static void case_lg_h( bench_ctx_t ctx, int base, int cnt )
+{
+    int i;
+    for ( i = base; i < base + cnt; i++ )
+        lg_h( ctx->host, ctx->grp, "value: %d", i );
+}
+
+
+static void case_lg_h_mixed( bench_ctx_t ctx, int base, int cnt )
+{
+    int i;
+    for ( i = base; i < base + cnt; i++ )
+        lg_h( ctx->host, ctx->grp, "id: %d size: %zu name: %s", i, (size_t)i * 8, "bench" );
+}
+
+
+static void case_LG_KV( bench_ctx_t ctx, int base, int cnt )
+{
+    int i;
+    for ( i = base; i < base + cnt; i++ )
+        LG_KV( ctx->host,
+               ctx->grp,
+               "request",
+               LG_I64( "id", i ),
+               LG_U64( "size", (uint64_t)i * 8 ),
+               LG_STR( "name", "bench \"quoted\"" ) );
+}
+
+
+static void case_lg_names( bench_ctx_t ctx, int base, int cnt )
+{
+    int i;
+    for ( i = base; i < base + cnt; i++ )
+        lg( ctx->host, ctx->names[ i % ctx->cnt ], "value: %d", i );
+}
+
+
+
+/* ------------------------------------------------------------
+ * Main:
+ */
+
+
+int main( int argc, char** argv )
+{
+    bench_ctx_s ctx;
+    bench_ctx_s ctxs[ BENCH_THREADS ];
+    char        name[ 64 ];
+    char        prev[ 64 ];
+    int         i;
+
+    bench_overhead = bench_timer_overhead();
+
+    printf( "%-28s %2s %9s %9s %9s %9s %9s %9s %12s\n",
+            "case",
+            "th",
+            "mean ns",
+            "p50 ns",
+            "p90 ns",
+            "p99 ns",
+            "p99.9 ns",
+            "max ns",
+            "msgs/s" );
+
+    /* Disabled calls. */
+    ctx.host = lg_host_new( st_nil );
+    ctx.grp = lg_grp_log( ctx.host, "bench", "/dev/null" );
+    lg_grp_n( ctx.host, "bench" );
+
+    bench_run( "disabled lg()", &ctx, case_lg, BENCH_ROUNDS, BENCH_BATCH_FAST );
+    bench_run( "disabled lg_h()", &ctx, case_lg_h_str, BENCH_ROUNDS, BENCH_BATCH_FAST );
+    to_string_calls = 0;
+    bench_run( "disabled LG_H()", &ctx, case_LG_H, BENCH_ROUNDS, BENCH_BATCH_FAST );
+    printf( "%-28s %d\n", "LG_H() argument evaluations", to_string_calls );
+
+    /* One File. */
+    ctx.grp = lg_grp_log( ctx.host, "file", "bench.log" );
+    bench_run( "file lg_h()", &ctx, case_lg_h, BENCH_WRITES, BENCH_BATCH_WRITE );
+
+    /* Prefixes. */
+    ctx.grp = lg_grp_top( ctx.host, "strftime", "/dev/null", strftime_prefix, st_nil );
+    bench_run( "strftime prefix lg_h()", &ctx, case_lg_h, BENCH_WRITES, BENCH_BATCH_WRITE );
+
+    ctx.grp = lg_grp_top( ctx.host, "wall", "/dev/null", lg_prefix_wall, st_nil );
+    bench_run( "lg_prefix_wall lg_h()", &ctx, case_lg_h, BENCH_WRITES, BENCH_BATCH_WRITE );
+
+    ctx.grp = lg_grp_top( ctx.host, "tsc", "/dev/null", lg_prefix_tsc, st_nil );
+    bench_run( "lg_prefix_tsc lg_h()", &ctx, case_lg_h, BENCH_WRITES, BENCH_BATCH_WRITE );
+
+    /* Formatter. */
+    ctx.grp = lg_grp_log( ctx.host, "fastfmt", "/dev/null" );
+    bench_run( "fastfmt lg_h()", &ctx, case_lg_h_mixed, BENCH_WRITES, BENCH_BATCH_WRITE );
+    lg_host_config( ctx.host, "fastfmt", st_false );
+    bench_run( "printf lg_h()", &ctx, case_lg_h_mixed, BENCH_WRITES, BENCH_BATCH_WRITE );
+    lg_host_config( ctx.host, "fastfmt", st_true );
+
+    /* Structured messages, per encoding. */
+    ctx.grp = lg_grp_log( ctx.host, "kv", "/dev/null" );
+    bench_run( "text LG_KV()", &ctx, case_LG_KV, BENCH_WRITES, BENCH_BATCH_WRITE );
+    lg_log_encoding( ctx.host, "/dev/null", LG_ENC_JSON );
+    bench_run( "json LG_KV()", &ctx, case_LG_KV, BENCH_WRITES, BENCH_BATCH_WRITE );
+    lg_log_encoding( ctx.host, "/dev/null", LG_ENC_LOGFMT );
+    bench_run( "logfmt LG_KV()", &ctx, case_LG_KV, BENCH_WRITES, BENCH_BATCH_WRITE );
+    lg_log_encoding( ctx.host, "/dev/null", LG_ENC_TEXT );
+
+    /* Deep hierarchy: each level is a sub Group of the level above,
+     * and the leaf overrides the inherited Prefix and Postfix. */
+    lg_grp_top( ctx.host, "deep", "/dev/null", lg_prefix_mono, st_nil );
+    lg_grp_postfix_str( ctx.host, "deep", " <deep>" );
+    strcpy( prev, "deep" );
+    for ( i = 1; i < BENCH_DEPTH; i++ ) {
+        snprintf( name, sizeof( name ), "d%d", i );
+        ctx.grp = lg_grp_sub( ctx.host, prev, name );
+        snprintf( prev, sizeof( prev ), "%s", ctx.grp->name );
+    }
+    lg_grp_prefix( ctx.host, prev, lg_prefix_wall );
+    lg_grp_postfix_str( ctx.host, prev, " <leaf>" );
+    bench_run( "deep hierarchy lg_h()", &ctx, case_lg_h, BENCH_WRITES, BENCH_BATCH_WRITE );
+
+    /* Fan-out to joined Groups. */
+    ctx.grp = lg_grp_log( ctx.host, "fan", st_nil );
+    for ( i = 0; i < BENCH_FANOUT; i++ ) {
+        snprintf( name, sizeof( name ), "sink%d", i );
+        lg_grp_log( ctx.host, name, "/dev/null" );
+        lg_grp_join_grp( ctx.host, "fan", name );
+    }
+    bench_run( "fan-out lg_h()", &ctx, case_lg_h, BENCH_WRITES / BENCH_FANOUT, BENCH_BATCH_WRITE );
+
+    /* Many Groups, looked up by name. */
+    lg_grp_top( ctx.host, "many", "/dev/null", st_nil, st_nil );
+    ctx.cnt = BENCH_GROUPS;
+    ctx.names = malloc( sizeof( char* ) * ctx.cnt );
+    for ( i = 0; i < ctx.cnt; i++ ) {
+        snprintf( name, sizeof( name ), "g%05d", i );
+        ctx.names[ i ] = strdup( lg_grp_sub( ctx.host, "many", name )->name );
+    }
+    bench_run( "many groups lg()", &ctx, case_lg_names, BENCH_WRITES, BENCH_BATCH_WRITE );
+    for ( i = 0; i < ctx.cnt; i++ )
+        free( ctx.names[ i ] );
+    free( ctx.names );
+
+    lg_host_del( ctx.host );
+    unlink( "bench.log" );
+
+    /* Threads sharing one File. */
+    ctx.host = lg_host_new( st_nil );
+    lg_host_config( ctx.host, "threaded", st_true );
+    ctx.grp = lg_grp_log( ctx.host, "shared", "bench.log" );
+    for ( i = 0; i < BENCH_THREADS; i++ )
+        ctxs[ i ] = ctx;
+    bench_run_mt( "threads shared lg_h()",
+                  ctxs,
+                  BENCH_THREADS,
+                  case_lg_h,
+                  BENCH_WRITES / BENCH_THREADS,
+                  BENCH_BATCH_WRITE );
+
+    /* Threads with own Files. */
+    for ( i = 0; i < BENCH_THREADS; i++ ) {
+        snprintf( name, sizeof( name ), "own%d", i );
+        snprintf( prev, sizeof( prev ), "bench%d.log", i );
+        ctxs[ i ].grp = lg_grp_log( ctx.host, name, prev );
+    }
+    bench_run_mt( "threads own lg_h()",
+                  ctxs,
+                  BENCH_THREADS,
+                  case_lg_h,
+                  BENCH_WRITES / BENCH_THREADS,
+                  BENCH_BATCH_WRITE );
+
+    /* Threads sharing one sharded File. */
+    lg_log_shard( ctx.host, "bench.lgs", BENCH_THREADS );
+    lg_grp_log( ctx.host, "sharded", st_nil );
+    lg_grp_join_file_type( ctx.host, "sharded", "bench.lgs", LG_LOG_TYPE_SHARD );
+    for ( i = 0; i < BENCH_THREADS; i++ )
+        ctxs[ i ].grp = lg_grp_get( ctx.host, "sharded" );
+    bench_run_mt( "threads sharded lg_h()",
+                  ctxs,
+                  BENCH_THREADS,
+                  case_lg_h,
+                  BENCH_WRITES / BENCH_THREADS,
+                  BENCH_BATCH_WRITE );
+
+    lg_host_del( ctx.host );
+    unlink( "bench.log" );
+    for ( i = 0; i < BENCH_THREADS; i++ ) {
+        snprintf( prev, sizeof( prev ), "bench%d.log", i );
+        unlink( prev );
+        snprintf( prev, sizeof( prev ), "bench.lgs.shard%d", i );
+        unlink( prev );
+    }
+
+    if ( argc > 1 )
+        bench_json( argv[ 1 ] );
+
+    return 0;
+}
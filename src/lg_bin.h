@@ -0,0 +1,49 @@
+#ifndef LG_BIN_H
+#define LG_BIN_H
+
+/**
+ * @file   lg_bin.h
+ *
+ * @brief  Logger - Binary Log format.
+ *
+ * Binary Log starts with file header, which is followed by
+ * records. Numbers are stored in host byte order.
+ *
+ * File header: magic (4 bytes), version (u32).
+ *
+ * Record: type (u8), payload length (u32), payload.
+ *
+ * Payloads:
+ *
+ *   LG_BIN_REC_STR: id (u32), format string.
+ *
+ *   LG_BIN_REC_GRP: id (u32), Group name.
+ *
+ *   LG_BIN_REC_MSG: Group id (u32), sequence (u64), timestamp in ns
+ *   (u64), format id (u32), newline (u8), prefix length (u32),
+ *   prefix, postfix length (u32), postfix, captured arguments (rest,
+ *   see lg_fmt.h).
+ *
+ * String and Group definitions precede their first use.
+ *
+ */
+
+#include <stdint.h>
+
+
+/** Binary Log magic. */
+#define LG_BIN_MAGIC "LGB\x01"
+
+/** Binary Log version. */
+#define LG_BIN_VERSION 1
+
+/** Record types. */
+#define LG_BIN_REC_STR 1
+#define LG_BIN_REC_GRP 2
+#define LG_BIN_REC_MSG 3
+
+/** Record header size. */
+#define LG_BIN_REC_HEAD ( 1 + 4 )
+
+
+#endif
@@ -0,0 +1,565 @@
+/**
+ * @file   lg_fast.c
+ *
+ * @brief  Logger - Fast path formatter for common conversions.
+ *
+ * Cache is an open addressing table, where slots are claimed with
+ * CAS. Programs are immutable after publishing. Integers are
+ * converted two decimal digits at a time from a table.
+ *
+ */
+
+
+#include "lg_fast.h"
+
+#include <string.h>
+#include <postor.h>
+
+
+
+/* ------------------------------------------------------------
+ * Internal types and data:
+ */
+
+
+/** Op types. */
+#define LG_FAST_LIT 0
+#define LG_FAST_INT 1
+#define LG_FAST_UINT 2
+#define LG_FAST_HEX 3
+#define LG_FAST_HEXU 4
+#define LG_FAST_CHR 5
+#define LG_FAST_STR 6
+#define LG_FAST_PTR 7
+
+/** Argument sizes. */
+#define LG_FAST_ARG_INT 0
+#define LG_FAST_ARG_LONG 1
+#define LG_FAST_ARG_LLONG 2
+#define LG_FAST_ARG_SIZE 3
+#define LG_FAST_ARG_INTMAX 4
+#define LG_FAST_ARG_PTRDIFF 5
+
+/** Local render buffer size. */
+#define LG_FAST_BUF 512
+
+/** Maximum supported width. */
+#define LG_FAST_WIDTH_MAX 128
+
+/** Maximum rendered length of non-string op. */
+#define LG_FAST_ITEM_MAX ( LG_FAST_WIDTH_MAX + 32 )
+
+/** Maximum probe count in cache. */
+#define LG_FAST_PROBES 16
+
+
+typedef struct
+{
+    uint8_t  type;  /**< Op type. */
+    uint8_t  arg;   /**< Argument size. */
+    uint8_t  left;  /**< Left justify. */
+    uint8_t  zero;  /**< Zero padding. */
+    uint16_t width; /**< Field width. */
+    uint32_t off;   /**< Literal offset in format. */
+    uint32_t len;   /**< Literal length. */
+} lg_fast_op_s;
+
+
+st_struct( lg_fast_prog )
+{
+    char*        fmt;    /**< Copy of format string. */
+    int          ok;     /**< Format is supported. */
+    size_t       cnt;    /**< Op count. */
+    lg_fast_op_s ops[];  /**< Ops. */
+};
+
+
+static const char lg_fast_dec2[] = "00010203040506070809"
+                                   "10111213141516171819"
+                                   "20212223242526272829"
+                                   "30313233343536373839"
+                                   "40414243444546474849"
+                                   "50515253545556575859"
+                                   "60616263646566676869"
+                                   "70717273747576777879"
+                                   "80818283848586878889"
+                                   "90919293949596979899";
+
+static const char lg_fast_hexl[] = "0123456789abcdef";
+static const char lg_fast_hexh[] = "0123456789ABCDEF";
+
+
+
+/* ------------------------------------------------------------
+ * Internal functions:
+ */
+
+
+/**
+ * Parse conversion at "p" (after "%") to "op".
+ *
+ * @return Pointer after conversion (or NULL if not supported).
+ */
+static const char* lg_fast_parse_conv( const char* p, lg_fast_op_s* op )
+{
+    unsigned width = 0;
+
+    memset( op, 0, sizeof( *op ) );
+
+    for ( ;; p++ ) {
+        if ( *p == '-' )
+            op->left = 1;
+        else if ( *p == '0' )
+            op->zero = 1;
+        else
+            break;
+    }
+
+    while ( *p >= '0' && *p <= '9' ) {
+        width = width * 10 + ( *p++ - '0' );
+        if ( width > LG_FAST_WIDTH_MAX )
+            return NULL;
+    }
+    op->width = width;
+
+    if ( op->left )
+        op->zero = 0;
+
+    switch ( *p ) {
+        case 'l':
+            p++;
+            if ( *p == 'l' ) {
+                p++;
+                op->arg = LG_FAST_ARG_LLONG;
+            } else {
+                op->arg = LG_FAST_ARG_LONG;
+            }
+            break;
+        case 'z': p++; op->arg = LG_FAST_ARG_SIZE; break;
+        case 'j': p++; op->arg = LG_FAST_ARG_INTMAX; break;
+        case 't': p++; op->arg = LG_FAST_ARG_PTRDIFF; break;
+        default: op->arg = LG_FAST_ARG_INT; break;
+    }
+
+    switch ( *p ) {
+        case 'd':
+        case 'i': op->type = LG_FAST_INT; break;
+        case 'u': op->type = LG_FAST_UINT; break;
+        case 'x': op->type = LG_FAST_HEX; break;
+        case 'X': op->type = LG_FAST_HEXU; break;
+        case 'c': op->type = LG_FAST_CHR; break;
+        case 's': op->type = LG_FAST_STR; break;
+        case 'p': op->type = LG_FAST_PTR; break;
+        default: return NULL;
+    }
+
+    /* Length modifiers for c, s and p are wide or invalid. */
+    if ( op->type >= LG_FAST_CHR && ( op->arg != LG_FAST_ARG_INT || op->zero ) )
+        return NULL;
+
+    return p + 1;
+}
+
+
+static lg_fast_prog_t lg_fast_compile( const char* format )
+{
+    lg_fast_prog_t prog;
+    lg_fast_op_s   op;
+    const char*    p;
+    const char*    lit;
+    size_t         max;
+    size_t         len;
+
+    /* Each op takes at least one character. */
+    len = strlen( format );
+    max = len + 1;
+
+    prog = po_malloc( sizeof( lg_fast_prog_s ) + max * sizeof( lg_fast_op_s ) );
+    prog->fmt = po_malloc( len + 1 );
+    memcpy( prog->fmt, format, len + 1 );
+    prog->ok = 0;
+    prog->cnt = 0;
+
+    p = format;
+    lit = p;
+
+    while ( *p ) {
+
+        if ( *p != '%' ) {
+            p++;
+            continue;
+        }
+
+        if ( p > lit ) {
+            memset( &op, 0, sizeof( op ) );
+            op.type = LG_FAST_LIT;
+            op.off = lit - format;
+            op.len = p - lit;
+            prog->ops[ prog->cnt++ ] = op;
+        }
+
+        if ( p[ 1 ] == '%' ) {
+            /* Literal "%" starts next literal. */
+            lit = p + 1;
+            p += 2;
+            continue;
+        }
+
+        p = lg_fast_parse_conv( p + 1, &op );
+        if ( p == NULL )
+            return prog;
+
+        prog->ops[ prog->cnt++ ] = op;
+        lit = p;
+    }
+
+    if ( p > lit ) {
+        memset( &op, 0, sizeof( op ) );
+        op.type = LG_FAST_LIT;
+        op.off = lit - format;
+        op.len = p - lit;
+        prog->ops[ prog->cnt++ ] = op;
+    }
+
+    prog->ok = 1;
+
+    return prog;
+}
+
+
+static void lg_fast_prog_del( lg_fast_prog_t prog )
+{
+    po_free( prog->fmt );
+    po_free( prog );
+}
+
+
+/**
+ * Write decimal digits of "value" ending at "end".
+ *
+ * @return Start of digits.
+ */
+static char* lg_fast_dec( char* end, uint64_t value )
+{
+    while ( value >= 100 ) {
+        end -= 2;
+        memcpy( end, lg_fast_dec2 + ( value % 100 ) * 2, 2 );
+        value /= 100;
+    }
+
+    if ( value >= 10 ) {
+        end -= 2;
+        memcpy( end, lg_fast_dec2 + value * 2, 2 );
+    } else {
+        *--end = '0' + value;
+    }
+
+    return end;
+}
+
+
+static char* lg_fast_hex( char* end, uint64_t value, const char* digits )
+{
+    do {
+        *--end = digits[ value & 0xf ];
+        value >>= 4;
+    } while ( value );
+
+    return end;
+}
+
+
+/**
+ * Append local buffer by length, since "%c" may produce NUL.
+ */
+static void lg_fast_flush( char* local, size_t* len, sl_p buf )
+{
+    if ( *len > 0 ) {
+        local[ *len ] = 0;
+        lg_fast_append( buf, local, *len );
+        *len = 0;
+    }
+}
+
+
+/**
+ * Write "str" with padding. Sign (if any) precedes zero padding.
+ */
+static size_t lg_fast_pad( char* out, const lg_fast_op_s* op, const char* str, size_t len, int sign )
+{
+    size_t pad;
+    size_t n;
+
+    pad = ( op->width > len ) ? op->width - len : 0;
+    n = 0;
+
+    if ( op->zero ) {
+        if ( sign ) {
+            out[ n++ ] = *str++;
+            len--;
+        }
+        memset( out + n, '0', pad );
+        n += pad;
+    } else if ( !op->left ) {
+        memset( out + n, ' ', pad );
+        n += pad;
+    }
+
+    memcpy( out + n, str, len );
+    n += len;
+
+    if ( op->left ) {
+        memset( out + n, ' ', pad );
+        n += pad;
+    }
+
+    return n;
+}
+
+
+static int64_t lg_fast_arg_int( const lg_fast_op_s* op, va_list* ap )
+{
+    switch ( op->arg ) {
+        case LG_FAST_ARG_LONG: return va_arg( *ap, long );
+        case LG_FAST_ARG_LLONG: return va_arg( *ap, long long );
+        case LG_FAST_ARG_SIZE: return va_arg( *ap, ssize_t );
+        case LG_FAST_ARG_INTMAX: return va_arg( *ap, intmax_t );
+        case LG_FAST_ARG_PTRDIFF: return va_arg( *ap, ptrdiff_t );
+        default: return va_arg( *ap, int );
+    }
+}
+
+
+static uint64_t lg_fast_arg_uint( const lg_fast_op_s* op, va_list* ap )
+{
+    switch ( op->arg ) {
+        case LG_FAST_ARG_LONG: return va_arg( *ap, unsigned long );
+        case LG_FAST_ARG_LLONG: return va_arg( *ap, unsigned long long );
+        case LG_FAST_ARG_SIZE: return va_arg( *ap, size_t );
+        case LG_FAST_ARG_INTMAX: return va_arg( *ap, uintmax_t );
+        case LG_FAST_ARG_PTRDIFF: return va_arg( *ap, ptrdiff_t );
+        default: return va_arg( *ap, unsigned int );
+    }
+}
+
+
+static void lg_fast_render( lg_fast_prog_t prog, sl_p buf, va_list ap )
+{
+    char                local[ LG_FAST_BUF ];
+    char                num[ 32 ];
+    char*               end = num + sizeof( num );
+    char*               start;
+    const lg_fast_op_s* op;
+    const char*         str;
+    size_t              len;
+    size_t              slen;
+    size_t              i;
+    int64_t             sval;
+    uint64_t            uval;
+    va_list             args;
+
+    va_copy( args, ap );
+
+    len = 0;
+
+    for ( i = 0; i < prog->cnt; i++ ) {
+
+        op = &prog->ops[ i ];
+
+        if ( len + LG_FAST_ITEM_MAX >= LG_FAST_BUF )
+            lg_fast_flush( local, &len, buf );
+
+        switch ( op->type ) {
+
+            case LG_FAST_LIT:
+                if ( len + op->len >= LG_FAST_BUF ) {
+                    lg_fast_flush( local, &len, buf );
+                    /* Long literal in pieces. */
+                    str = prog->fmt + op->off;
+                    slen = op->len;
+                    while ( slen > 0 ) {
+                        size_t part = slen < LG_FAST_BUF - 1 ? slen : LG_FAST_BUF - 1;
+                        memcpy( local, str, part );
+                        len = part;
+                        lg_fast_flush( local, &len, buf );
+                        str += part;
+                        slen -= part;
+                    }
+                } else {
+                    memcpy( local + len, prog->fmt + op->off, op->len );
+                    len += op->len;
+                }
+                break;
+
+            case LG_FAST_INT:
+                sval = lg_fast_arg_int( op, &args );
+                if ( sval < 0 ) {
+                    start = lg_fast_dec( end, -(uint64_t)sval );
+                    *--start = '-';
+                } else {
+                    start = lg_fast_dec( end, sval );
+                }
+                len += lg_fast_pad( local + len, op, start, end - start, sval < 0 );
+                break;
+
+            case LG_FAST_UINT:
+                uval = lg_fast_arg_uint( op, &args );
+                start = lg_fast_dec( end, uval );
+                len += lg_fast_pad( local + len, op, start, end - start, 0 );
+                break;
+
+            case LG_FAST_HEX:
+            case LG_FAST_HEXU:
+                uval = lg_fast_arg_uint( op, &args );
+                start = lg_fast_hex( end, uval, op->type == LG_FAST_HEX ? lg_fast_hexl : lg_fast_hexh );
+                len += lg_fast_pad( local + len, op, start, end - start, 0 );
+                break;
+
+            case LG_FAST_CHR:
+                num[ 0 ] = (char)va_arg( args, int );
+                len += lg_fast_pad( local + len, op, num, 1, 0 );
+                break;
+
+            case LG_FAST_PTR:
+                uval = (uintptr_t)va_arg( args, void* );
+                if ( uval ) {
+                    start = lg_fast_hex( end, uval, lg_fast_hexl );
+                    *--start = 'x';
+                    *--start = '0';
+                    len += lg_fast_pad( local + len, op, start, end - start, 0 );
+                } else {
+                    len += lg_fast_pad( local + len, op, "(nil)", 5, 0 );
+                }
+                break;
+
+            case LG_FAST_STR:
+                str = va_arg( args, const char* );
+                if ( str == NULL )
+                    str = "(null)";
+                slen = strlen( str );
+                if ( len + slen + op->width < LG_FAST_BUF ) {
+                    len += lg_fast_pad( local + len, op, str, slen, 0 );
+                } else {
+                    /* Long string is appended directly. */
+                    size_t pad = ( op->width > slen ) ? op->width - slen : 0;
+                    if ( !op->left ) {
+                        memset( local + len, ' ', pad );
+                        len += pad;
+                    }
+                    lg_fast_flush( local, &len, buf );
+                    sl_concatenate_c( buf, str );
+                    if ( op->left ) {
+                        memset( local + len, ' ', pad );
+                        len += pad;
+                    }
+                }
+                break;
+        }
+    }
+
+    lg_fast_flush( local, &len, buf );
+
+    va_end( args );
+}
+
+
+
+/* ------------------------------------------------------------
+ * User API:
+ */
+
+
+lg_fast_t lg_fast_new( void )
+{
+    lg_fast_t fast;
+
+    fast = po_malloc( sizeof( lg_fast_s ) );
+    memset( fast, 0, sizeof( lg_fast_s ) );
+
+    return fast;
+}
+
+
+void lg_fast_del( lg_fast_t fast )
+{
+    size_t i;
+
+    for ( i = 0; i < LG_FAST_SLOTS; i++ )
+        if ( fast->slots[ i ].prog )
+            lg_fast_prog_del( fast->slots[ i ].prog );
+
+    po_free( fast );
+}
+
+
+void lg_fast_append( sl_p buf, const char* data, size_t len )
+{
+    const char* end;
+    const char* nul;
+
+    end = data + len;
+    while ( data < end ) {
+        nul = memchr( data, 0, end - data );
+        if ( nul == NULL ) {
+            sl_concatenate_c( buf, data );
+            break;
+        }
+        if ( nul > data )
+            sl_concatenate_c( buf, data );
+        sl_append_char( buf, 0 );
+        data = nul + 1;
+    }
+}
+
+
+int lg_fast_format( lg_fast_t fast, sl_p buf, const char* format, va_list ap )
+{
+    lg_fast_slot_t slot;
+    lg_fast_prog_t prog;
+    const char*    key;
+    uintptr_t      hash;
+    size_t         i;
+
+    hash = (uintptr_t)format;
+    hash ^= hash >> 17;
+    hash *= 0x9e3779b97f4a7c15ULL;
+    hash >>= 32;
+
+    for ( i = 0; i < LG_FAST_PROBES; i++ ) {
+
+        slot = &fast->slots[ ( hash + i ) & ( LG_FAST_SLOTS - 1 ) ];
+        key = __atomic_load_n( &slot->key, __ATOMIC_ACQUIRE );
+
+        if ( key == format ) {
+
+            prog = __atomic_load_n( &slot->prog, __ATOMIC_ACQUIRE );
+
+            /* Format buffer may have been reused for other content. */
+            if ( prog == NULL || !prog->ok || strcmp( prog->fmt, format ) )
+                return 0;
+
+            lg_fast_render( prog, buf, ap );
+            return 1;
+
+        } else if ( key == NULL ) {
+
+            prog = lg_fast_compile( format );
+
+            if ( !__atomic_compare_exchange_n(
+                     &slot->key, &key, format, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) ) {
+                lg_fast_prog_del( prog );
+                return 0;
+            }
+
+            __atomic_store_n( &slot->prog, prog, __ATOMIC_RELEASE );
+
+            if ( !prog->ok )
+                return 0;
+
+            lg_fast_render( prog, buf, ap );
+            return 1;
+        }
+    }
+
+    return 0;
+}
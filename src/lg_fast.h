@@ -0,0 +1,90 @@
+#ifndef LG_FAST_H
+#define LG_FAST_H
+
+/**
+ * @file   lg_fast.h
+ *
+ * @brief  Logger - Fast path formatter for common conversions.
+ *
+ * Format string is parsed once into ops, and the program is cached
+ * by format string pointer. Cached program is used only if the
+ * format string content is unchanged.
+ *
+ * Supported conversions are "d", "i", "u", "x", "X", "c", "s", "p"
+ * and "%", with flags "-" and "0", width, and length modifiers "l",
+ * "ll", "z", "j" and "t". Output is identical to printf. Formats
+ * with other conversions, such as floats, are reported as not
+ * handled, and the caller should use printf style formatting.
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <sixten.h>
+#include <slinky.h>
+
+
+/** Cache size (power of two). */
+#define LG_FAST_SLOTS 1024
+
+
+st_struct_type( lg_fast_prog );
+
+
+/** Cache slot. */
+st_struct( lg_fast_slot )
+{
+    const char*    key;  /**< Format string pointer. */
+    lg_fast_prog_t prog; /**< Program (or NULL if not ready). */
+};
+
+
+st_struct( lg_fast )
+{
+    lg_fast_slot_s slots[ LG_FAST_SLOTS ]; /**< Cache slots. */
+};
+
+
+/**
+ * Create formatter cache.
+ *
+ * @return Cache.
+ */
+lg_fast_t lg_fast_new( void );
+
+
+/**
+ * Destroy formatter cache.
+ *
+ * @param fast Cache.
+ */
+void lg_fast_del( lg_fast_t fast );
+
+
+/**
+ * Append data with length to buffer, embedded NULs included.
+ *
+ * @param buf  Output buffer.
+ * @param data Data (terminated after length).
+ * @param len  Data length.
+ */
+void lg_fast_append( sl_p buf, const char* data, size_t len );
+
+
+/**
+ * Format to buffer (appended), if format is supported.
+ *
+ * Cache can be used from multiple threads.
+ *
+ * @param fast   Cache.
+ * @param buf    Output buffer.
+ * @param format Format string.
+ * @param ap     Arguments (not used if format is not handled).
+ *
+ * @return 1 if formatted, 0 if not handled.
+ */
+int lg_fast_format( lg_fast_t fast, sl_p buf, const char* format, va_list ap );
+
+
+#endif
@@ -0,0 +1,497 @@
+/**
+ * @file   lg_fmt.c
+ *
+ * @brief  Logger - Format argument capture and rendering.
+ *
+ * Captured argument is a type tag followed by the value. Strings are
+ * stored with length. Rendering walks the format again and renders
+ * each conversion separately with the captured value.
+ *
+ */
+
+
+#include "lg_fmt.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <postor.h>
+
+
+/** Maximum length of conversion spec, with '*' values expanded. */
+#define LG_FMT_SPEC_MAX 48
+
+
+/** Captured argument types. */
+st_enum( lg_fmt_arg ){ LG_FMT_ARG_INT = 1,
+                       LG_FMT_ARG_LONG,
+                       LG_FMT_ARG_DOUBLE,
+                       LG_FMT_ARG_LDOUBLE,
+                       LG_FMT_ARG_PTR,
+                       LG_FMT_ARG_STR,
+                       LG_FMT_ARG_LLONG,
+                       LG_FMT_ARG_SIZE,
+                       LG_FMT_ARG_IMAX };
+
+
+/** Parsed conversion specification. */
+st_struct( lg_fmt_spec )
+{
+    const char* start;  /**< Start of spec ('%'). */
+    const char* end;    /**< End of spec (after conversion). */
+    int         width;  /**< Width is '*'. */
+    int         prec;   /**< Precision is '*'. */
+    int         digits; /**< Literal precision (-1 for none). */
+    int         type;   /**< Argument type (0 if not captured). */
+};
+
+
+
+/* ------------------------------------------------------------
+ * Internal functions:
+ */
+
+/**
+ * Parse conversion spec starting from '%'.
+ */
+static void lg_fmt_parse( const char* p, lg_fmt_spec_t spec )
+{
+    int lng = 0;
+
+    spec->start = p++;
+    spec->width = 0;
+    spec->prec = 0;
+    spec->digits = -1;
+    spec->type = 0;
+
+    while ( *p && strchr( "-+ #0'", *p ) )
+        p++;
+
+    if ( *p == '*' ) {
+        spec->width = 1;
+        p++;
+    } else {
+        while ( *p >= '0' && *p <= '9' )
+            p++;
+    }
+
+    if ( *p == '.' ) {
+        p++;
+        if ( *p == '*' ) {
+            spec->prec = 1;
+            p++;
+        } else {
+            spec->digits = 0;
+            while ( *p >= '0' && *p <= '9' )
+                spec->digits = spec->digits * 10 + ( *p++ - '0' );
+        }
+    }
+
+    /* Integer arguments are captured with their own width, since
+     * long is not long long everywhere. */
+    while ( *p && strchr( "hlLqjzt", *p ) ) {
+        switch ( *p ) {
+            case 'l': lng = lng ? LG_FMT_ARG_LLONG : LG_FMT_ARG_LONG; break;
+            case 'q': lng = LG_FMT_ARG_LLONG; break;
+            case 'j': lng = LG_FMT_ARG_IMAX; break;
+            case 'z':
+            case 't': lng = LG_FMT_ARG_SIZE; break;
+            case 'L': lng = LG_FMT_ARG_LDOUBLE; break;
+            default: break;
+        }
+        p++;
+    }
+
+    switch ( *p ) {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X': spec->type = ( lng && lng != LG_FMT_ARG_LDOUBLE ) ? lng : LG_FMT_ARG_INT; break;
+        /* Wide characters and strings ("%lc", "%ls") are not captured. */
+        case 'c': spec->type = lng ? 0 : LG_FMT_ARG_INT; break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A': spec->type = ( lng == LG_FMT_ARG_LDOUBLE ) ? LG_FMT_ARG_LDOUBLE : LG_FMT_ARG_DOUBLE; break;
+        case 'p':
+        case 'n': spec->type = LG_FMT_ARG_PTR; break;
+        case 's': spec->type = lng ? 0 : LG_FMT_ARG_STR; break;
+        default: break;
+    }
+
+    if ( *p )
+        p++;
+
+    spec->end = p;
+}
+
+
+static void lg_fmt_put( lg_fmt_buf_t buf, char type, const void* value, size_t len )
+{
+    lg_fmt_buf_append( buf, &type, 1 );
+    lg_fmt_buf_append( buf, value, len );
+}
+
+
+static const char* lg_fmt_get( const char* args, const char* end, void* value, size_t len )
+{
+    if ( args + 1 + len > end )
+        return end;
+
+    memcpy( value, args + 1, len );
+
+    return args + 1 + len;
+}
+
+
+/**
+ * Render spec with one value to Buffer.
+ */
+static void lg_fmt_render_spec( lg_fmt_buf_t buf, const char* spec, int type, const void* value )
+{
+    char   tmp[ 512 ];
+    char*  out;
+    int    len;
+    size_t size;
+
+    out = tmp;
+    size = sizeof( tmp );
+
+    for ( ;; ) {
+
+        switch ( type ) {
+            case LG_FMT_ARG_INT: len = snprintf( out, size, spec, *(const int*)value ); break;
+            case LG_FMT_ARG_LONG: len = snprintf( out, size, spec, *(const long*)value ); break;
+            case LG_FMT_ARG_LLONG: len = snprintf( out, size, spec, *(const long long*)value ); break;
+            case LG_FMT_ARG_SIZE: len = snprintf( out, size, spec, *(const size_t*)value ); break;
+            case LG_FMT_ARG_IMAX: len = snprintf( out, size, spec, *(const intmax_t*)value ); break;
+            case LG_FMT_ARG_DOUBLE: len = snprintf( out, size, spec, *(const double*)value ); break;
+            case LG_FMT_ARG_LDOUBLE:
+                len = snprintf( out, size, spec, *(const long double*)value );
+                break;
+            case LG_FMT_ARG_PTR: len = snprintf( out, size, spec, *(void* const*)value ); break;
+            case LG_FMT_ARG_STR: len = snprintf( out, size, spec, (const char*)value ); break;
+            default: len = snprintf( out, size, "%s", spec ); break;
+        }
+
+        if ( len < 0 )
+            len = 0;
+
+        if ( (size_t)len < size || out != tmp )
+            break;
+
+        size = len + 1;
+        out = po_malloc( size );
+    }
+
+    lg_fmt_buf_append( buf, out, len );
+
+    if ( out != tmp )
+        po_free( out );
+}
+
+
+
+/* ------------------------------------------------------------
+ * User API:
+ */
+
+
+void lg_fmt_buf_init( lg_fmt_buf_t buf )
+{
+    buf->data = st_nil;
+    buf->len = 0;
+    buf->size = 0;
+}
+
+
+void lg_fmt_buf_free( lg_fmt_buf_t buf )
+{
+    if ( buf->data )
+        po_free( buf->data );
+    lg_fmt_buf_init( buf );
+}
+
+
+void lg_fmt_buf_append( lg_fmt_buf_t buf, const void* data, size_t len )
+{
+    if ( buf->len + len + 1 > buf->size ) {
+        char*  data_new;
+        size_t size;
+
+        size = buf->size ? buf->size : 256;
+        while ( size < buf->len + len + 1 )
+            size *= 2;
+
+        data_new = po_malloc( size );
+        if ( buf->data ) {
+            memcpy( data_new, buf->data, buf->len );
+            po_free( buf->data );
+        }
+        buf->data = data_new;
+        buf->size = size;
+    }
+
+    memcpy( buf->data + buf->len, data, len );
+    buf->len += len;
+    buf->data[ buf->len ] = 0;
+}
+
+
+int lg_fmt_encode( lg_fmt_buf_t buf, const char* format, va_list ap )
+{
+    lg_fmt_spec_s spec;
+    const char*   p;
+    int           prec;
+    size_t        start;
+
+    start = buf->len;
+
+    for ( p = format; *p; p++ ) {
+
+        if ( *p != '%' )
+            continue;
+
+        if ( p[ 1 ] == '%' ) {
+            p++;
+            continue;
+        }
+
+        lg_fmt_parse( p, &spec );
+
+        /* Spec is rendered from a copy, where '*' is replaced with
+         * at most 11 characters. */
+        if ( spec.type == 0
+             || (size_t)( spec.end - spec.start ) + 10 * ( spec.width + spec.prec )
+                    > LG_FMT_SPEC_MAX ) {
+            buf->len = start;
+            if ( buf->data )
+                buf->data[ start ] = 0;
+            return 0;
+        }
+
+        if ( spec.width ) {
+            int v = va_arg( ap, int );
+            lg_fmt_put( buf, LG_FMT_ARG_INT, &v, sizeof( v ) );
+        }
+
+        prec = spec.digits;
+        if ( spec.prec ) {
+            int v = va_arg( ap, int );
+            lg_fmt_put( buf, LG_FMT_ARG_INT, &v, sizeof( v ) );
+            prec = v;
+        }
+
+        switch ( spec.type ) {
+
+            case LG_FMT_ARG_INT: {
+                int v = va_arg( ap, int );
+                lg_fmt_put( buf, LG_FMT_ARG_INT, &v, sizeof( v ) );
+                break;
+            }
+
+            case LG_FMT_ARG_LONG: {
+                long v = va_arg( ap, long );
+                lg_fmt_put( buf, LG_FMT_ARG_LONG, &v, sizeof( v ) );
+                break;
+            }
+
+            case LG_FMT_ARG_LLONG: {
+                long long v = va_arg( ap, long long );
+                lg_fmt_put( buf, LG_FMT_ARG_LLONG, &v, sizeof( v ) );
+                break;
+            }
+
+            case LG_FMT_ARG_SIZE: {
+                size_t v = va_arg( ap, size_t );
+                lg_fmt_put( buf, LG_FMT_ARG_SIZE, &v, sizeof( v ) );
+                break;
+            }
+
+            case LG_FMT_ARG_IMAX: {
+                intmax_t v = va_arg( ap, intmax_t );
+                lg_fmt_put( buf, LG_FMT_ARG_IMAX, &v, sizeof( v ) );
+                break;
+            }
+
+            case LG_FMT_ARG_DOUBLE: {
+                double v = va_arg( ap, double );
+                lg_fmt_put( buf, LG_FMT_ARG_DOUBLE, &v, sizeof( v ) );
+                break;
+            }
+
+            case LG_FMT_ARG_LDOUBLE: {
+                long double v = va_arg( ap, long double );
+                lg_fmt_put( buf, LG_FMT_ARG_LDOUBLE, &v, sizeof( v ) );
+                break;
+            }
+
+            case LG_FMT_ARG_PTR: {
+                void* v = va_arg( ap, void* );
+                lg_fmt_put( buf, LG_FMT_ARG_PTR, &v, sizeof( v ) );
+                break;
+            }
+
+            case LG_FMT_ARG_STR: {
+                const char* v = va_arg( ap, const char* );
+                uint32_t    len;
+                if ( v == st_nil )
+                    v = "(null)";
+                /* With precision the string need not be terminated. */
+                len = ( prec >= 0 ) ? strnlen( v, prec ) : strlen( v );
+                lg_fmt_put( buf, LG_FMT_ARG_STR, &len, sizeof( len ) );
+                lg_fmt_buf_append( buf, v, len );
+                break;
+            }
+
+            default: break;
+        }
+
+        p = spec.end - 1;
+    }
+
+    return 1;
+}
+
+
+size_t lg_fmt_render( lg_fmt_buf_t buf, const char* format, const char* args, size_t len )
+{
+    lg_fmt_spec_s spec;
+    const char*   p;
+    const char*   lit;
+    const char*   cur;
+    const char*   end;
+    char          fmt[ LG_FMT_SPEC_MAX + 16 ];
+    size_t        flen;
+
+    cur = args;
+    end = args + len;
+    lit = format;
+
+    if ( buf->data == st_nil )
+        lg_fmt_buf_append( buf, "", 0 );
+
+    for ( p = format; *p; p++ ) {
+
+        if ( *p != '%' )
+            continue;
+
+        lg_fmt_buf_append( buf, lit, p - lit );
+
+        if ( p[ 1 ] == '%' ) {
+            lg_fmt_buf_append( buf, "%", 1 );
+            p++;
+            lit = p + 1;
+            continue;
+        }
+
+        lg_fmt_parse( p, &spec );
+
+        /* Replace '*' with captured values in the spec copy. */
+        flen = 0;
+        for ( const char* s = spec.start; s < spec.end && flen < LG_FMT_SPEC_MAX; s++ ) {
+            if ( *s == '*' ) {
+                int v = 0;
+                cur = lg_fmt_get( cur, end, &v, sizeof( v ) );
+                flen += snprintf( fmt + flen, sizeof( fmt ) - flen, "%d", v );
+            } else {
+                fmt[ flen++ ] = *s;
+            }
+        }
+        fmt[ flen ] = 0;
+
+        switch ( spec.type ) {
+
+            case LG_FMT_ARG_INT: {
+                int v = 0;
+                cur = lg_fmt_get( cur, end, &v, sizeof( v ) );
+                lg_fmt_render_spec( buf, fmt, spec.type, &v );
+                break;
+            }
+
+            case LG_FMT_ARG_LONG: {
+                long v = 0;
+                cur = lg_fmt_get( cur, end, &v, sizeof( v ) );
+                lg_fmt_render_spec( buf, fmt, spec.type, &v );
+                break;
+            }
+
+            case LG_FMT_ARG_LLONG: {
+                long long v = 0;
+                cur = lg_fmt_get( cur, end, &v, sizeof( v ) );
+                lg_fmt_render_spec( buf, fmt, spec.type, &v );
+                break;
+            }
+
+            case LG_FMT_ARG_SIZE: {
+                size_t v = 0;
+                cur = lg_fmt_get( cur, end, &v, sizeof( v ) );
+                lg_fmt_render_spec( buf, fmt, spec.type, &v );
+                break;
+            }
+
+            case LG_FMT_ARG_IMAX: {
+                intmax_t v = 0;
+                cur = lg_fmt_get( cur, end, &v, sizeof( v ) );
+                lg_fmt_render_spec( buf, fmt, spec.type, &v );
+                break;
+            }
+
+            case LG_FMT_ARG_DOUBLE: {
+                double v = 0;
+                cur = lg_fmt_get( cur, end, &v, sizeof( v ) );
+                lg_fmt_render_spec( buf, fmt, spec.type, &v );
+                break;
+            }
+
+            case LG_FMT_ARG_LDOUBLE: {
+                long double v = 0;
+                cur = lg_fmt_get( cur, end, &v, sizeof( v ) );
+                lg_fmt_render_spec( buf, fmt, spec.type, &v );
+                break;
+            }
+
+            case LG_FMT_ARG_PTR: {
+                void* v = st_nil;
+                cur = lg_fmt_get( cur, end, &v, sizeof( v ) );
+                /* Stored pointers cannot be written to ("%n"). */
+                if ( *( spec.end - 1 ) == 'p' )
+                    lg_fmt_render_spec( buf, fmt, spec.type, &v );
+                break;
+            }
+
+            case LG_FMT_ARG_STR: {
+                uint32_t slen = 0;
+                cur = lg_fmt_get( cur, end, &slen, sizeof( slen ) );
+                if ( cur + slen > end )
+                    slen = end - cur;
+                if ( !strcmp( fmt, "%s" ) ) {
+                    lg_fmt_buf_append( buf, cur, slen );
+                } else {
+                    char* str = po_malloc( slen + 1 );
+                    memcpy( str, cur, slen );
+                    str[ slen ] = 0;
+                    lg_fmt_render_spec( buf, fmt, spec.type, str );
+                    po_free( str );
+                }
+                cur += slen;
+                break;
+            }
+
+            default: lg_fmt_render_spec( buf, fmt, 0, st_nil ); break;
+        }
+
+        p = spec.end - 1;
+        lit = spec.end;
+    }
+
+    lg_fmt_buf_append( buf, lit, p - lit );
+
+    return cur - args;
+}
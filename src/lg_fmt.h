@@ -0,0 +1,90 @@
+#ifndef LG_FMT_H
+#define LG_FMT_H
+
+/**
+ * @file   lg_fmt.h
+ *
+ * @brief  Logger - Format argument capture and rendering.
+ *
+ * Format arguments are captured to a compact binary form, which can
+ * be rendered later (or elsewhere) to the same text as printf would
+ * produce. Strings are copied, and other arguments are stored by
+ * value.
+ *
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <sixten.h>
+
+
+/** Growable byte buffer. */
+st_struct( lg_fmt_buf )
+{
+    char*  data; /**< Data. */
+    size_t len;  /**< Used length. */
+    size_t size; /**< Allocated size. */
+};
+
+
+/**
+ * Initialize Buffer.
+ *
+ * @param buf Buffer.
+ */
+void lg_fmt_buf_init( lg_fmt_buf_t buf );
+
+
+/**
+ * Release Buffer storage.
+ *
+ * @param buf Buffer.
+ */
+void lg_fmt_buf_free( lg_fmt_buf_t buf );
+
+
+/**
+ * Append bytes to Buffer.
+ *
+ * @param buf  Buffer.
+ * @param data Data.
+ * @param len  Data length.
+ */
+void lg_fmt_buf_append( lg_fmt_buf_t buf, const void* data, size_t len );
+
+
+/**
+ * Capture format arguments.
+ *
+ * Arguments are appended to Buffer. Wide characters and strings
+ * ("%lc", "%ls"), unknown conversions and specs longer than 48
+ * characters are not captured. For them capture fails, Buffer is
+ * restored and the arguments must be formatted directly (from a copy
+ * of "ap" taken before the call).
+ *
+ * @param buf    Buffer.
+ * @param format Format.
+ * @param ap     Arguments.
+ *
+ * @return 1 on success, 0 if format can't be captured.
+ */
+int lg_fmt_encode( lg_fmt_buf_t buf, const char* format, va_list ap );
+
+
+/**
+ * Render format with captured arguments.
+ *
+ * Text is appended to Buffer and terminated with NUL (not included
+ * in length).
+ *
+ * @param buf    Buffer.
+ * @param format Format.
+ * @param args   Captured arguments.
+ * @param len    Length of captured arguments.
+ *
+ * @return Number of argument bytes consumed.
+ */
+size_t lg_fmt_render( lg_fmt_buf_t buf, const char* format, const char* args, size_t len );
+
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * @file   lg_hist.c
+ *
+ * @brief  Logger - Log-linear latency histogram.
+ *
+ */
+
+
+#include "lg_hist.h"
+
+
+
+/* ------------------------------------------------------------
+ * User API:
+ */
+
+
+uint64_t lg_hist_value( size_t idx )
+{
+    unsigned top;
+    uint64_t sub;
+
+    if ( idx < LG_HIST_SUB )
+        return idx;
+
+    top = idx / LG_HIST_SUB + LG_HIST_SUB_BITS - 1;
+    sub = idx % LG_HIST_SUB;
+
+    return ( (uint64_t)LG_HIST_SUB + sub ) << ( top - LG_HIST_SUB_BITS );
+}
+
+
+uint64_t lg_hist_percentile( const uint64_t* hist, double pct )
+{
+    uint64_t total;
+    uint64_t limit;
+    uint64_t sum;
+    size_t   i;
+
+    total = lg_hist_count( hist );
+    if ( total == 0 )
+        return 0;
+
+    limit = (uint64_t)( total * pct / 100.0 + 0.5 );
+    if ( limit == 0 )
+        limit = 1;
+
+    sum = 0;
+    for ( i = 0; i < LG_HIST_SIZE; i++ ) {
+        sum += hist[ i ];
+        if ( sum >= limit ) {
+            if ( i + 1 < LG_HIST_SIZE )
+                return lg_hist_value( i + 1 ) - 1;
+            return UINT64_MAX;
+        }
+    }
+
+    return UINT64_MAX; // GCOV_EXCL_LINE
+}
+
+
+uint64_t lg_hist_count( const uint64_t* hist )
+{
+    uint64_t total;
+    size_t   i;
+
+    total = 0;
+    for ( i = 0; i < LG_HIST_SIZE; i++ )
+        total += hist[ i ];
+
+    return total;
+}
@@ -0,0 +1,95 @@
+#ifndef LG_HIST_H
+#define LG_HIST_H
+
+/**
+ * @file   lg_hist.h
+ *
+ * @brief  Logger - Log-linear latency histogram.
+ *
+ * Values below 8 have own buckets. Larger values are bucketed by the
+ * highest set bit and the next 3 bits, hence bucket width is at most
+ * 1/8 of its value (as in HDR histograms with one significant
+ * digit). Any 64-bit value fits to LG_HIST_SIZE buckets.
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/** Sub-bucket bits. */
+#define LG_HIST_SUB_BITS 3
+
+/** Sub-bucket count. */
+#define LG_HIST_SUB ( 1 << LG_HIST_SUB_BITS )
+
+/** Bucket count. */
+#define LG_HIST_SIZE ( ( 64 - LG_HIST_SUB_BITS + 1 ) * LG_HIST_SUB )
+
+
+/**
+ * Bucket index for value.
+ *
+ * @param value Value.
+ *
+ * @return Bucket index.
+ */
+static inline size_t lg_hist_index( uint64_t value )
+{
+    unsigned top;
+
+    if ( value < LG_HIST_SUB )
+        return value;
+
+    top = 63 - __builtin_clzll( value );
+
+    return ( top - LG_HIST_SUB_BITS + 1 ) * LG_HIST_SUB
+           + ( ( value >> ( top - LG_HIST_SUB_BITS ) ) & ( LG_HIST_SUB - 1 ) );
+}
+
+
+/**
+ * Add value to histogram (relaxed atomic).
+ *
+ * @param hist  Histogram buckets.
+ * @param value Value.
+ */
+static inline void lg_hist_add( uint64_t* hist, uint64_t value )
+{
+    __atomic_fetch_add( &hist[ lg_hist_index( value ) ], 1, __ATOMIC_RELAXED );
+}
+
+
+/**
+ * Lowest value of bucket.
+ *
+ * @param idx Bucket index.
+ *
+ * @return Value.
+ */
+uint64_t lg_hist_value( size_t idx );
+
+
+/**
+ * Value at percentile, i.e. the highest value of the bucket where
+ * percentile is reached.
+ *
+ * @param hist Histogram buckets.
+ * @param pct  Percentile (0.0 - 100.0).
+ *
+ * @return Value (0 for empty histogram).
+ */
+uint64_t lg_hist_percentile( const uint64_t* hist, double pct );
+
+
+/**
+ * Value count in histogram.
+ *
+ * @param hist Histogram buckets.
+ *
+ * @return Count.
+ */
+uint64_t lg_hist_count( const uint64_t* hist );
+
+
+#endif
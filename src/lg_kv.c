@@ -0,0 +1,402 @@
+/**
+ * @file   lg_kv.c
+ *
+ * @brief  Logger - Structured key-value messages.
+ *
+ * Escaping scans 16 bytes at a time with SSE2 for characters that
+ * need escaping (or quoting in logfmt). Clean runs are copied as
+ * whole. Scalar scan is used without SSE2 and for the tail.
+ *
+ */
+
+
+#include "lg_kv.h"
+#include "lg_stamp.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+
+/* ------------------------------------------------------------
+ * Internal functions:
+ */
+
+
+static const char lg_kv_hex[] = "0123456789abcdef";
+
+
+static inline int lg_kv_special( unsigned char c, int logfmt )
+{
+    return c < 0x20 || c == '"' || c == '\\' || ( logfmt && ( c == ' ' || c == '=' ) );
+}
+
+
+/**
+ * Find first character that needs escaping. Space and "=" are
+ * included for logfmt.
+ *
+ * @return Index (or "len" if none).
+ */
+static size_t lg_kv_scan( const char* str, size_t len, int logfmt )
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8( '"' );
+    const __m128i slash = _mm_set1_epi8( '\\' );
+    const __m128i ctrl = _mm_set1_epi8( 0x1f );
+    const __m128i space = _mm_set1_epi8( ' ' );
+    const __m128i equal = _mm_set1_epi8( '=' );
+    __m128i       v;
+    __m128i       m;
+    int           mask;
+
+    for ( ; i + 16 <= len; i += 16 ) {
+        v = _mm_loadu_si128( (const __m128i*)( str + i ) );
+        m = _mm_or_si128( _mm_cmpeq_epi8( v, quote ), _mm_cmpeq_epi8( v, slash ) );
+        /* Unsigned v <= 0x1f. */
+        m = _mm_or_si128( m, _mm_cmpeq_epi8( _mm_max_epu8( v, ctrl ), ctrl ) );
+        if ( logfmt )
+            m = _mm_or_si128( m, _mm_or_si128( _mm_cmpeq_epi8( v, space ), _mm_cmpeq_epi8( v, equal ) ) );
+        mask = _mm_movemask_epi8( m );
+        if ( mask )
+            return i + __builtin_ctz( mask );
+    }
+#endif
+
+    for ( ; i < len; i++ )
+        if ( lg_kv_special( str[ i ], logfmt ) )
+            return i;
+
+    return len;
+}
+
+
+static void lg_kv_put( lg_fmt_buf_t out, const char* str )
+{
+    lg_fmt_buf_append( out, str, strlen( str ) );
+}
+
+
+static void lg_kv_put_i64( lg_fmt_buf_t out, int64_t value )
+{
+    char   buf[ LG_STAMP_MAX ];
+    size_t len = 0;
+
+    if ( value < 0 ) {
+        buf[ len++ ] = '-';
+        len += lg_stamp_uint( buf + len, -(uint64_t)value );
+    } else {
+        len += lg_stamp_uint( buf, value );
+    }
+
+    lg_fmt_buf_append( out, buf, len );
+}
+
+
+static void lg_kv_put_u64( lg_fmt_buf_t out, uint64_t value )
+{
+    char buf[ LG_STAMP_MAX ];
+    lg_fmt_buf_append( out, buf, lg_stamp_uint( buf, value ) );
+}
+
+
+static void lg_kv_put_f64( lg_fmt_buf_t out, double value, const char* format )
+{
+    char buf[ 32 ];
+    int  len;
+
+    len = snprintf( buf, sizeof( buf ), format, value );
+    lg_fmt_buf_append( out, buf, len );
+}
+
+
+/**
+ * Strip surrounding white space.
+ */
+static const char* lg_kv_strip( const char* str, size_t* len )
+{
+    while ( *len > 0 && ( *str == ' ' || *str == '\t' || *str == '\n' ) ) {
+        str++;
+        ( *len )--;
+    }
+
+    while ( *len > 0 && ( str[ *len - 1 ] == ' ' || str[ *len - 1 ] == '\t' || str[ *len - 1 ] == '\n' ) )
+        ( *len )--;
+
+    return str;
+}
+
+
+static void lg_kv_json_str( lg_fmt_buf_t out, const char* str, size_t len )
+{
+    lg_fmt_buf_append( out, "\"", 1 );
+    lg_kv_escape_json( out, str, len );
+    lg_fmt_buf_append( out, "\"", 1 );
+}
+
+
+static void lg_kv_json_key( lg_fmt_buf_t out, const char* key, int* first )
+{
+    if ( !*first )
+        lg_fmt_buf_append( out, ",", 1 );
+    *first = 0;
+    lg_kv_json_str( out, key, strlen( key ) );
+    lg_fmt_buf_append( out, ":", 1 );
+}
+
+
+/**
+ * Append key for text and logfmt, followed by "=". Characters that
+ * would end the key (control, space, "=", quote and DEL) are replaced
+ * with "_", and empty key is written as "_".
+ */
+static void lg_kv_put_key( lg_fmt_buf_t out, const char* key )
+{
+    size_t        i;
+    unsigned char c;
+
+    if ( *key == 0 )
+        lg_fmt_buf_append( out, "_", 1 );
+
+    for ( i = 0; key[ i ]; i++ ) {
+        c = key[ i ];
+        if ( c <= ' ' || c == '=' || c == '"' || c == 0x7f )
+            break;
+    }
+
+    lg_fmt_buf_append( out, key, i );
+    for ( ; key[ i ]; i++ ) {
+        c = key[ i ];
+        if ( c <= ' ' || c == '=' || c == '"' || c == 0x7f )
+            lg_fmt_buf_append( out, "_", 1 );
+        else
+            lg_fmt_buf_append( out, key + i, 1 );
+    }
+
+    lg_fmt_buf_append( out, "=", 1 );
+}
+
+
+static void lg_kv_logfmt_key( lg_fmt_buf_t out, const char* key, int* first )
+{
+    if ( !*first )
+        lg_fmt_buf_append( out, " ", 1 );
+    *first = 0;
+    lg_kv_put_key( out, key );
+}
+
+
+static void lg_kv_encode_text( lg_fmt_buf_t out, const char* msg, const lg_kv_s* kv, size_t cnt )
+{
+    size_t i;
+
+    lg_kv_put( out, msg );
+
+    for ( i = 0; i < cnt; i++ ) {
+        lg_fmt_buf_append( out, " ", 1 );
+        lg_kv_put_key( out, kv[ i ].key );
+        switch ( kv[ i ].type ) {
+            case LG_KV_I64: lg_kv_put_i64( out, kv[ i ].v.i ); break;
+            case LG_KV_U64: lg_kv_put_u64( out, kv[ i ].v.u ); break;
+            case LG_KV_F64: lg_kv_put_f64( out, kv[ i ].v.f, "%g" ); break;
+            case LG_KV_STR:
+                if ( kv[ i ].v.s )
+                    lg_kv_json_str( out, kv[ i ].v.s, strlen( kv[ i ].v.s ) );
+                else
+                    lg_kv_put( out, "null" );
+                break;
+            case LG_KV_BOOL: lg_kv_put( out, kv[ i ].v.i ? "true" : "false" ); break;
+        }
+    }
+}
+
+
+static void lg_kv_encode_json( lg_fmt_buf_t out,
+                               const char*  grp,
+                               const char*  prefix,
+                               size_t       pre,
+                               const char*  postfix,
+                               size_t       post,
+                               const char*  msg,
+                               const lg_kv_s* kv,
+                               size_t       cnt )
+{
+    int    first = 1;
+    size_t i;
+
+    lg_fmt_buf_append( out, "{", 1 );
+
+    if ( pre ) {
+        lg_kv_json_key( out, "prefix", &first );
+        lg_kv_json_str( out, prefix, pre );
+    }
+
+    lg_kv_json_key( out, "grp", &first );
+    lg_kv_json_str( out, grp, strlen( grp ) );
+    lg_kv_json_key( out, "msg", &first );
+    lg_kv_json_str( out, msg, strlen( msg ) );
+
+    for ( i = 0; i < cnt; i++ ) {
+        lg_kv_json_key( out, kv[ i ].key, &first );
+        switch ( kv[ i ].type ) {
+            case LG_KV_I64: lg_kv_put_i64( out, kv[ i ].v.i ); break;
+            case LG_KV_U64: lg_kv_put_u64( out, kv[ i ].v.u ); break;
+            case LG_KV_F64:
+                if ( isfinite( kv[ i ].v.f ) )
+                    lg_kv_put_f64( out, kv[ i ].v.f, "%.17g" );
+                else
+                    lg_kv_put( out, "null" );
+                break;
+            case LG_KV_STR:
+                if ( kv[ i ].v.s )
+                    lg_kv_json_str( out, kv[ i ].v.s, strlen( kv[ i ].v.s ) );
+                else
+                    lg_kv_put( out, "null" );
+                break;
+            case LG_KV_BOOL: lg_kv_put( out, kv[ i ].v.i ? "true" : "false" ); break;
+        }
+    }
+
+    if ( post ) {
+        lg_kv_json_key( out, "postfix", &first );
+        lg_kv_json_str( out, postfix, post );
+    }
+
+    lg_fmt_buf_append( out, "}", 1 );
+}
+
+
+static void lg_kv_encode_logfmt( lg_fmt_buf_t   out,
+                                 const char*    grp,
+                                 const char*    prefix,
+                                 size_t         pre,
+                                 const char*    postfix,
+                                 size_t         post,
+                                 const char*    msg,
+                                 const lg_kv_s* kv,
+                                 size_t         cnt )
+{
+    int    first = 1;
+    size_t i;
+
+    if ( pre ) {
+        lg_kv_logfmt_key( out, "prefix", &first );
+        lg_kv_escape_logfmt( out, prefix, pre );
+    }
+
+    lg_kv_logfmt_key( out, "grp", &first );
+    lg_kv_escape_logfmt( out, grp, strlen( grp ) );
+    lg_kv_logfmt_key( out, "msg", &first );
+    lg_kv_escape_logfmt( out, msg, strlen( msg ) );
+
+    for ( i = 0; i < cnt; i++ ) {
+        lg_kv_logfmt_key( out, kv[ i ].key, &first );
+        switch ( kv[ i ].type ) {
+            case LG_KV_I64: lg_kv_put_i64( out, kv[ i ].v.i ); break;
+            case LG_KV_U64: lg_kv_put_u64( out, kv[ i ].v.u ); break;
+            case LG_KV_F64: lg_kv_put_f64( out, kv[ i ].v.f, "%.17g" ); break;
+            case LG_KV_STR:
+                if ( kv[ i ].v.s )
+                    lg_kv_escape_logfmt( out, kv[ i ].v.s, strlen( kv[ i ].v.s ) );
+                break;
+            case LG_KV_BOOL: lg_kv_put( out, kv[ i ].v.i ? "true" : "false" ); break;
+        }
+    }
+
+    if ( post ) {
+        lg_kv_logfmt_key( out, "postfix", &first );
+        lg_kv_escape_logfmt( out, postfix, post );
+    }
+}
+
+
+
+/* ------------------------------------------------------------
+ * User API:
+ */
+
+
+void lg_kv_escape_json( lg_fmt_buf_t out, const char* str, size_t len )
+{
+    char   esc[ 6 ];
+    size_t run;
+    unsigned char c;
+
+    while ( len > 0 ) {
+
+        run = lg_kv_scan( str, len, 0 );
+        lg_fmt_buf_append( out, str, run );
+        if ( run == len )
+            break;
+
+        c = str[ run ];
+        esc[ 0 ] = '\\';
+        switch ( c ) {
+            case '"': esc[ 1 ] = '"'; lg_fmt_buf_append( out, esc, 2 ); break;
+            case '\\': esc[ 1 ] = '\\'; lg_fmt_buf_append( out, esc, 2 ); break;
+            case '\n': esc[ 1 ] = 'n'; lg_fmt_buf_append( out, esc, 2 ); break;
+            case '\r': esc[ 1 ] = 'r'; lg_fmt_buf_append( out, esc, 2 ); break;
+            case '\t': esc[ 1 ] = 't'; lg_fmt_buf_append( out, esc, 2 ); break;
+            default:
+                esc[ 1 ] = 'u';
+                esc[ 2 ] = '0';
+                esc[ 3 ] = '0';
+                esc[ 4 ] = lg_kv_hex[ c >> 4 ];
+                esc[ 5 ] = lg_kv_hex[ c & 0xf ];
+                lg_fmt_buf_append( out, esc, 6 );
+                break;
+        }
+
+        str += run + 1;
+        len -= run + 1;
+    }
+}
+
+
+void lg_kv_escape_logfmt( lg_fmt_buf_t out, const char* str, size_t len )
+{
+    if ( len > 0 && lg_kv_scan( str, len, 1 ) == len ) {
+        lg_fmt_buf_append( out, str, len );
+    } else {
+        lg_fmt_buf_append( out, "\"", 1 );
+        lg_kv_escape_json( out, str, len );
+        lg_fmt_buf_append( out, "\"", 1 );
+    }
+}
+
+
+void lg_kv_encode( lg_fmt_buf_t   out,
+                   lg_enc_t       enc,
+                   const char*    grp,
+                   const char*    prefix,
+                   size_t         pre,
+                   const char*    postfix,
+                   size_t         post,
+                   const char*    msg,
+                   const lg_kv_s* kv,
+                   size_t         cnt,
+                   int            newline )
+{
+    if ( enc == LG_ENC_TEXT ) {
+        lg_fmt_buf_append( out, prefix, pre );
+        lg_kv_encode_text( out, msg, kv, cnt );
+        lg_fmt_buf_append( out, postfix, post );
+    } else {
+        prefix = lg_kv_strip( prefix, &pre );
+        postfix = lg_kv_strip( postfix, &post );
+        if ( enc == LG_ENC_JSON )
+            lg_kv_encode_json( out, grp, prefix, pre, postfix, post, msg, kv, cnt );
+        else
+            lg_kv_encode_logfmt( out, grp, prefix, pre, postfix, post, msg, kv, cnt );
+    }
+
+    if ( newline )
+        lg_fmt_buf_append( out, "\n", 1 );
+}
@@ -0,0 +1,124 @@
+#ifndef LG_KV_H
+#define LG_KV_H
+
+/**
+ * @file   lg_kv.h
+ *
+ * @brief  Logger - Structured key-value messages.
+ *
+ * Message is a text and a list of typed fields. Fields are created
+ * with LG_I64(), LG_U64(), LG_F64(), LG_STR() and LG_BOOL(), and
+ * they are encoded without printf format parsing.
+ *
+ * Encodings:
+ *
+ *   LG_ENC_TEXT:   prefix msg key=value ... postfix
+ *   LG_ENC_JSON:   {"prefix":..,"grp":..,"msg":..,"key":value,..,"postfix":..}
+ *   LG_ENC_LOGFMT: prefix=.. grp=.. msg=.. key=value .. postfix=..
+ *
+ * In text, string values are quoted and escaped as in JSON, and
+ * missing string is written as null. In text and logfmt, characters
+ * of keys that would end the key are replaced with "_".
+ *
+ * In JSON and logfmt, Prefix and Postfix are included without
+ * surrounding white space, and only when they are not empty.
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sixten.h>
+
+#include "lg_fmt.h"
+
+
+/** Message encoding. */
+st_enum( lg_enc ){ LG_ENC_TEXT = 0, LG_ENC_JSON, LG_ENC_LOGFMT };
+
+/** Number of encodings. */
+#define LG_ENC_CNT 3
+
+/** Field type. */
+st_enum( lg_kv_type ){ LG_KV_I64 = 0, LG_KV_U64, LG_KV_F64, LG_KV_STR, LG_KV_BOOL };
+
+
+/** Field. */
+st_struct( lg_kv )
+{
+    const char*  key;  /**< Key. */
+    lg_kv_type_t type; /**< Value type. */
+    union
+    {
+        int64_t     i; /**< LG_KV_I64, LG_KV_BOOL. */
+        uint64_t    u; /**< LG_KV_U64. */
+        double      f; /**< LG_KV_F64. */
+        const char* s; /**< LG_KV_STR (NULL for null). */
+    } v;
+};
+
+
+/** Signed integer field. */
+#define LG_I64( key, value ) ( (lg_kv_s){ ( key ), LG_KV_I64, { .i = ( value ) } } )
+
+/** Unsigned integer field. */
+#define LG_U64( key, value ) ( (lg_kv_s){ ( key ), LG_KV_U64, { .u = ( value ) } } )
+
+/** Floating point field. */
+#define LG_F64( key, value ) ( (lg_kv_s){ ( key ), LG_KV_F64, { .f = ( value ) } } )
+
+/** String field. */
+#define LG_STR( key, value ) ( (lg_kv_s){ ( key ), LG_KV_STR, { .s = ( value ) } } )
+
+/** Boolean field. */
+#define LG_BOOL( key, value ) ( (lg_kv_s){ ( key ), LG_KV_BOOL, { .i = !!( value ) } } )
+
+
+/**
+ * Encode message to Buffer (appended).
+ *
+ * @param out     Output.
+ * @param enc     Encoding.
+ * @param grp     Group name.
+ * @param prefix  Prefix text.
+ * @param pre     Prefix length.
+ * @param postfix Postfix text.
+ * @param post    Postfix length.
+ * @param msg     Message.
+ * @param kv      Fields.
+ * @param cnt     Field count.
+ * @param newline Terminate with newline.
+ */
+void lg_kv_encode( lg_fmt_buf_t    out,
+                   lg_enc_t        enc,
+                   const char*     grp,
+                   const char*     prefix,
+                   size_t          pre,
+                   const char*     postfix,
+                   size_t          post,
+                   const char*     msg,
+                   const lg_kv_s*  kv,
+                   size_t          cnt,
+                   int             newline );
+
+
+/**
+ * Append string as JSON string contents (without quotes).
+ *
+ * @param out Output.
+ * @param str String.
+ * @param len String length.
+ */
+void lg_kv_escape_json( lg_fmt_buf_t out, const char* str, size_t len );
+
+
+/**
+ * Append string as logfmt value (quoted if needed).
+ *
+ * @param out Output.
+ * @param str String.
+ * @param len String length.
+ */
+void lg_kv_escape_logfmt( lg_fmt_buf_t out, const char* str, size_t len );
+
+
+#endif
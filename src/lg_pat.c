@@ -0,0 +1,231 @@
+/**
+ * @file   lg_pat.c
+ *
+ * @brief  Logger - Compiled Prefix and Postfix patterns.
+ *
+ * Rendering collects short items to a local buffer, which is
+ * appended to output once. Long literals are appended directly.
+ *
+ */
+
+
+#include "lg_pat.h"
+#include "lg_stamp.h"
+
+#include <string.h>
+#include <postor.h>
+
+
+
+/* ------------------------------------------------------------
+ * Internal functions:
+ */
+
+
+/** Local render buffer size. */
+#define LG_PAT_BUF 256
+
+/** Maximum literal length per op. */
+#define LG_PAT_LIT_MAX 65535
+
+
+/**
+ * Emit literal op to "prog" (if not NULL).
+ */
+static size_t lg_pat_lit( uint8_t* prog, const char* text, size_t len )
+{
+    size_t   size;
+    size_t   part;
+    uint16_t plen;
+
+    size = 0;
+
+    while ( len > 0 ) {
+        part = len > LG_PAT_LIT_MAX ? LG_PAT_LIT_MAX : len;
+        if ( prog ) {
+            plen = part;
+            prog[ size ] = LG_PAT_LIT;
+            memcpy( prog + size + 1, &plen, sizeof( plen ) );
+            memcpy( prog + size + 3, text, part );
+            prog[ size + 3 + part ] = 0;
+        }
+        size += 1 + sizeof( plen ) + part + 1;
+        text += part;
+        len -= part;
+    }
+
+    return size;
+}
+
+
+/**
+ * Write pointer value in hex ("0x..."). Pointer is not dereferenced,
+ * since Host data is opaque.
+ */
+static size_t lg_pat_ptr( char* buf, const void* ptr )
+{
+    static const char hex[] = "0123456789abcdef";
+    uintptr_t         value = (uintptr_t)ptr;
+    char              tmp[ 2 * sizeof( value ) ];
+    size_t            cnt;
+    size_t            len;
+
+    cnt = 0;
+    do {
+        tmp[ cnt++ ] = hex[ value & 0xf ];
+        value >>= 4;
+    } while ( value );
+
+    buf[ 0 ] = '0';
+    buf[ 1 ] = 'x';
+    len = 2;
+    while ( cnt > 0 )
+        buf[ len++ ] = tmp[ --cnt ];
+
+    return len;
+}
+
+
+static void lg_pat_flush( char* local, size_t* len, sl_p buf )
+{
+    if ( *len > 0 ) {
+        local[ *len ] = 0;
+        sl_concatenate_c( buf, local );
+        *len = 0;
+    }
+}
+
+
+
+/* ------------------------------------------------------------
+ * User API:
+ */
+
+
+size_t lg_pat_compile( const char* pattern, const char* grp, uint8_t* prog )
+{
+    size_t      size;
+    size_t      lit_len;
+    char*       lit;
+    const char* p;
+    uint8_t     op;
+
+    /* Literal can't be longer than pattern with Group names. */
+    lit = po_malloc( strlen( pattern ) * ( strlen( grp ) + 1 ) + 1 );
+    lit_len = 0;
+    size = 0;
+
+    for ( p = pattern; *p; p++ ) {
+
+        if ( *p != '%' || p[ 1 ] == 0 ) {
+            lit[ lit_len++ ] = *p;
+            continue;
+        }
+
+        p++;
+        op = LG_PAT_END;
+
+        switch ( *p ) {
+            case 'g':
+                memcpy( lit + lit_len, grp, strlen( grp ) );
+                lit_len += strlen( grp );
+                break;
+            case '%': lit[ lit_len++ ] = '%'; break;
+            case 'T': op = LG_PAT_TIME; break;
+            case 'M': op = LG_PAT_MONO; break;
+            case 't': op = LG_PAT_TID; break;
+            case 'n': op = LG_PAT_SEQ; break;
+            case 'd': op = LG_PAT_DATA; break;
+            default:
+                /* Unknown conversion is kept as is. */
+                lit[ lit_len++ ] = '%';
+                lit[ lit_len++ ] = *p;
+                break;
+        }
+
+        if ( op != LG_PAT_END ) {
+            size += lg_pat_lit( prog ? prog + size : NULL, lit, lit_len );
+            lit_len = 0;
+            if ( prog )
+                prog[ size ] = op;
+            size++;
+        }
+    }
+
+    size += lg_pat_lit( prog ? prog + size : NULL, lit, lit_len );
+    if ( prog )
+        prog[ size ] = LG_PAT_END;
+    size++;
+
+    po_free( lit );
+
+    return size;
+}
+
+
+int lg_pat_has_seq( const uint8_t* prog )
+{
+    uint16_t plen;
+
+    if ( prog == NULL )
+        return 0;
+
+    for ( ;; ) {
+        switch ( *prog++ ) {
+            case LG_PAT_END: return 0;
+            case LG_PAT_SEQ: return 1;
+            case LG_PAT_LIT:
+                memcpy( &plen, prog, sizeof( plen ) );
+                prog += sizeof( plen ) + plen + 1;
+                break;
+            default: break;
+        }
+    }
+}
+
+
+void lg_pat_render( const uint8_t* prog, const void* data, uint64_t seq, sl_p buf )
+{
+    char     local[ LG_PAT_BUF ];
+    size_t   len;
+    uint16_t plen;
+
+    len = 0;
+
+    for ( ;; ) {
+
+        /* Room for any non-literal item. */
+        if ( len + LG_STAMP_MAX >= LG_PAT_BUF )
+            lg_pat_flush( local, &len, buf );
+
+        switch ( *prog++ ) {
+
+            case LG_PAT_END: lg_pat_flush( local, &len, buf ); return;
+
+            case LG_PAT_LIT:
+                memcpy( &plen, prog, sizeof( plen ) );
+                prog += sizeof( plen );
+                if ( len + plen < LG_PAT_BUF ) {
+                    memcpy( local + len, prog, plen );
+                    len += plen;
+                } else {
+                    lg_pat_flush( local, &len, buf );
+                    sl_concatenate_c( buf, (const char*)prog );
+                }
+                prog += plen + 1;
+                break;
+
+            case LG_PAT_TIME: len += lg_stamp_wall( local + len ); break;
+
+            case LG_PAT_MONO: len += lg_stamp_mono( local + len ); break;
+
+            case LG_PAT_TID: len += lg_stamp_tid( local + len ); break;
+
+            case LG_PAT_SEQ: len += lg_stamp_uint( local + len, seq ); break;
+
+            case LG_PAT_DATA: len += lg_pat_ptr( local + len, data ); break;
+
+            default: return;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef LG_PAT_H
+#define LG_PAT_H
+
+/**
+ * @file   lg_pat.h
+ *
+ * @brief  Logger - Compiled Prefix and Postfix patterns.
+ *
+ * Pattern is text with conversions:
+ *
+ *   %T: Wall clock time ("YYYY-MM-DD HH:MM:SS.uuuuuu").
+ *   %M: Monotonic time ("sssss.uuuuuu").
+ *   %g: Group name.
+ *   %t: Thread id.
+ *   %n: Group message sequence number (same in Prefix and Postfix).
+ *   %d: Host data as pointer value ("0x..."), not dereferenced.
+ *   %%: "%".
+ *
+ * Pattern is compiled to a program, where text and Group name are
+ * merged to literals. Program is a byte sequence of ops: literal is
+ * op, length (u16), text and NUL, and other ops are single bytes.
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <slinky.h>
+
+
+/** Pattern ops. */
+#define LG_PAT_END 0
+#define LG_PAT_LIT 1
+#define LG_PAT_TIME 2
+#define LG_PAT_MONO 3
+#define LG_PAT_TID 4
+#define LG_PAT_SEQ 5
+#define LG_PAT_DATA 6
+
+
+/**
+ * Compile pattern.
+ *
+ * @param pattern Pattern.
+ * @param grp     Group name (for "%g").
+ * @param prog    Program output (or NULL for size only).
+ *
+ * @return Program size.
+ */
+size_t lg_pat_compile( const char* pattern, const char* grp, uint8_t* prog );
+
+
+/**
+ * Check if program uses sequence number.
+ *
+ * @param prog Program (or NULL).
+ *
+ * @return 1 if "%n" is used.
+ */
+int lg_pat_has_seq( const uint8_t* prog );
+
+
+/**
+ * Render program to buffer.
+ *
+ * @param prog Program.
+ * @param data Host data (for "%d").
+ * @param seq  Sequence number of message (for "%n").
+ * @param buf  Output buffer (appended).
+ */
+void lg_pat_render( const uint8_t* prog, const void* data, uint64_t seq, sl_p buf );
+
+
+#endif
@@ -0,0 +1,163 @@
+/**
+ * @file   lg_queue.c
+ *
+ * @brief  Logger - Bounded lock-free message queue.
+ *
+ * Implementation follows the bounded MPMC queue by D. Vyukov. Each
+ * Slot has a sequence number, which tells whether the Slot is free
+ * for the producer or ready for the consumer at given position.
+ *
+ */
+
+
+#include "lg_queue.h"
+
+#include <string.h>
+#include <postor.h>
+
+
+
+/* ------------------------------------------------------------
+ * User API:
+ */
+
+
+lg_queue_t lg_queue_new( size_t capacity )
+{
+    lg_queue_t queue;
+    uint64_t   size;
+    uint64_t   i;
+
+    size = 2;
+    while ( size < capacity )
+        size <<= 1;
+
+    queue = po_malloc( sizeof( lg_queue_s ) );
+    queue->mask = size - 1;
+    queue->slots = po_malloc( size * sizeof( lg_queue_slot_s ) );
+    queue->head = 0;
+    queue->tail = 0;
+
+    for ( i = 0; i < size; i++ ) {
+        queue->slots[ i ].seq = i;
+        queue->slots[ i ].ext = st_nil;
+    }
+
+    return queue;
+}
+
+
+void lg_queue_del( lg_queue_t queue )
+{
+    lg_queue_slot_t slot;
+
+    while ( ( slot = lg_queue_take( queue ) ) )
+        lg_queue_release( queue, slot );
+
+    po_free( queue->slots );
+    po_free( queue );
+}
+
+
+lg_queue_slot_t lg_queue_claim( lg_queue_t queue )
+{
+    lg_queue_slot_t slot;
+    uint64_t        pos;
+    uint64_t        seq;
+    int64_t         dif;
+
+    pos = __atomic_load_n( &queue->head, __ATOMIC_RELAXED );
+
+    for ( ;; ) {
+        slot = &queue->slots[ pos & queue->mask ];
+        seq = __atomic_load_n( &slot->seq, __ATOMIC_ACQUIRE );
+        dif = (int64_t)seq - (int64_t)pos;
+        if ( dif == 0 ) {
+            if ( __atomic_compare_exchange_n(
+                     &queue->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+                break;
+        } else if ( dif < 0 ) {
+            return st_nil;
+        } else {
+            pos = __atomic_load_n( &queue->head, __ATOMIC_RELAXED );
+        }
+    }
+
+    slot->pos = pos;
+
+    return slot;
+}
+
+
+void lg_queue_store( lg_queue_slot_t slot, void* ref, uint32_t kind, const char* msg, size_t len )
+{
+    slot->ref = ref;
+    slot->kind = kind;
+    slot->len = len;
+
+    if ( len <= LG_QUEUE_SLOT_DATA ) {
+        memcpy( slot->data, msg, len );
+    } else {
+        slot->ext = po_malloc( len );
+        memcpy( slot->ext, msg, len );
+    }
+}
+
+
+void lg_queue_publish( lg_queue_slot_t slot )
+{
+    __atomic_store_n( &slot->seq, slot->pos + 1, __ATOMIC_RELEASE );
+}
+
+
+lg_queue_slot_t lg_queue_take( lg_queue_t queue )
+{
+    lg_queue_slot_t slot;
+    uint64_t        pos;
+    uint64_t        seq;
+    int64_t         dif;
+
+    pos = __atomic_load_n( &queue->tail, __ATOMIC_RELAXED );
+
+    for ( ;; ) {
+        slot = &queue->slots[ pos & queue->mask ];
+        seq = __atomic_load_n( &slot->seq, __ATOMIC_ACQUIRE );
+        dif = (int64_t)seq - (int64_t)( pos + 1 );
+        if ( dif == 0 ) {
+            if ( __atomic_compare_exchange_n(
+                     &queue->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+                break;
+        } else if ( dif < 0 ) {
+            return st_nil;
+        } else {
+            pos = __atomic_load_n( &queue->tail, __ATOMIC_RELAXED );
+        }
+    }
+
+    slot->pos = pos;
+
+    return slot;
+}
+
+
+const char* lg_queue_data( lg_queue_slot_t slot )
+{
+    return slot->ext ? slot->ext : slot->data;
+}
+
+
+void lg_queue_release( lg_queue_t queue, lg_queue_slot_t slot )
+{
+    if ( slot->ext ) {
+        po_free( slot->ext );
+        slot->ext = st_nil;
+    }
+
+    __atomic_store_n( &slot->seq, slot->pos + queue->mask + 1, __ATOMIC_RELEASE );
+}
+
+
+uint64_t lg_queue_claimed( lg_queue_t queue )
+{
+    return __atomic_load_n( &queue->head, __ATOMIC_ACQUIRE );
+}
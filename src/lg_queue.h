@@ -0,0 +1,132 @@
+#ifndef LG_QUEUE_H
+#define LG_QUEUE_H
+
+/**
+ * @file   lg_queue.h
+ *
+ * @brief  Logger - Bounded lock-free message queue.
+ *
+ * Queue is a ring of Slots, and it can be used by multiple producers
+ * and consumers concurrently. Slot is first claimed, then filled (or
+ * read), and finally published (or released).
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sixten.h>
+
+
+/** Inline data size of Slot. Longer messages are stored to heap. */
+#define LG_QUEUE_SLOT_DATA 240
+
+
+st_struct( lg_queue_slot )
+{
+    uint64_t seq;                        /**< Slot sequence. */
+    uint64_t pos;                        /**< Queue position of claim. */
+    void*    ref;                        /**< Message target. */
+    uint32_t kind;                       /**< Message kind. */
+    size_t   len;                        /**< Message length. */
+    char*    ext;                        /**< Heap data (or NULL). */
+    char     data[ LG_QUEUE_SLOT_DATA ]; /**< Inline data. */
+};
+
+
+st_struct( lg_queue )
+{
+    uint64_t        mask;                           /**< Capacity mask. */
+    lg_queue_slot_t slots;                          /**< Slot ring. */
+    uint64_t head __attribute__( ( aligned( 64 ) ) ); /**< Enqueue position. */
+    uint64_t tail __attribute__( ( aligned( 64 ) ) ); /**< Dequeue position. */
+};
+
+
+/**
+ * Create Queue.
+ *
+ * @param capacity Capacity (rounded up to power of two).
+ *
+ * @return Queue.
+ */
+lg_queue_t lg_queue_new( size_t capacity );
+
+
+/**
+ * Destroy Queue.
+ *
+ * @param queue Queue.
+ */
+void lg_queue_del( lg_queue_t queue );
+
+
+/**
+ * Claim Slot for writing.
+ *
+ * @param queue Queue.
+ *
+ * @return Slot (or NULL if Queue is full).
+ */
+lg_queue_slot_t lg_queue_claim( lg_queue_t queue );
+
+
+/**
+ * Store message to claimed Slot.
+ *
+ * @param slot Slot.
+ * @param ref  Message target.
+ * @param kind Message kind (user defined).
+ * @param msg  Message.
+ * @param len  Message length.
+ */
+void lg_queue_store( lg_queue_slot_t slot, void* ref, uint32_t kind, const char* msg, size_t len );
+
+
+/**
+ * Publish claimed Slot to consumers.
+ *
+ * @param slot Slot.
+ */
+void lg_queue_publish( lg_queue_slot_t slot );
+
+
+/**
+ * Take Slot for reading.
+ *
+ * @param queue Queue.
+ *
+ * @return Slot (or NULL if Queue is empty).
+ */
+lg_queue_slot_t lg_queue_take( lg_queue_t queue );
+
+
+/**
+ * Return message data of Slot.
+ *
+ * @param slot Slot.
+ *
+ * @return Message.
+ */
+const char* lg_queue_data( lg_queue_slot_t slot );
+
+
+/**
+ * Release taken Slot back to producers.
+ *
+ * @param queue Queue.
+ * @param slot  Slot.
+ */
+void lg_queue_release( lg_queue_t queue, lg_queue_slot_t slot );
+
+
+/**
+ * Return number of claimed Slots since creation.
+ *
+ * @param queue Queue.
+ *
+ * @return Count.
+ */
+uint64_t lg_queue_claimed( lg_queue_t queue );
+
+
+#endif
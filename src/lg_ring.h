@@ -0,0 +1,39 @@
+#ifndef LG_RING_H
+#define LG_RING_H
+
+/**
+ * @file   lg_ring.h
+ *
+ * @brief  Logger - Flight recorder ring File format.
+ *
+ * Ring File has a fixed size header, which is followed by the ring
+ * data area. Numbers are stored in host byte order.
+ *
+ * Header: magic (4 bytes), version (u32), data size (u64), write
+ * position (u64).
+ *
+ * Write position is the total number of bytes written. Data is at
+ * "position % size", hence the oldest data starts at the write
+ * position after the ring has wrapped around. Position is updated
+ * after the data has been copied.
+ *
+ */
+
+#include <stdint.h>
+
+
+/** Ring File magic. */
+#define LG_RING_MAGIC "LGR\x01"
+
+/** Ring File version. */
+#define LG_RING_VERSION 1
+
+/** Header size (data area offset). */
+#define LG_RING_HEAD 64
+
+/** Header field offsets. */
+#define LG_RING_OFF_SIZE 8
+#define LG_RING_OFF_POS 16
+
+
+#endif
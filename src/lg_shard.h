@@ -0,0 +1,46 @@
+#ifndef LG_SHARD_H
+#define LG_SHARD_H
+
+/**
+ * @file   lg_shard.h
+ *
+ * @brief  Logger - Sharded Log format.
+ *
+ * Sharded Log "<file>" is written to shard Files "<file>.shard<n>",
+ * one per writer thread (modulo shard count). Numbers are stored in
+ * host byte order.
+ *
+ * File header: magic (4 bytes), version (u32), shard index (u32),
+ * shard count (u32), run id (u64).
+ *
+ * Record: sequence (u64), timestamp in ns (u64), message length
+ * (u32), message.
+ *
+ * Sequence is global for the Log, and records are in sequence order
+ * within a shard. Merging the shards by sequence gives the messages
+ * in the order they were logged. Timestamp is informational. Shards
+ * of one Log share the run id, which is new each time the Log is
+ * created.
+ *
+ */
+
+#include <stdint.h>
+
+
+/** Shard File magic. */
+#define LG_SHARD_MAGIC "LGS\x01"
+
+/** Shard File version. */
+#define LG_SHARD_VERSION 2
+
+/** Shard File header size. */
+#define LG_SHARD_HEAD ( 4 + 4 + 4 + 4 + 8 )
+
+/** Record header size. */
+#define LG_SHARD_REC_HEAD ( 8 + 8 + 4 )
+
+/** Maximum shard count. */
+#define LG_SHARD_MAX 64
+
+
+#endif
@@ -0,0 +1,270 @@
+/**
+ * @file   lg_stamp.c
+ *
+ * @brief  Logger - Timestamp Prefix functions.
+ *
+ * Date and time part of wall clock timestamp is formatted once per
+ * second per thread, and only the sub-second digits are written for
+ * each message. Digits are written without stdio. The formatting
+ * functions are shared with Prefix patterns (see lg_pat.h).
+ *
+ */
+
+
+#include "logger.h"
+#include "lg_stamp.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+
+
+/* ------------------------------------------------------------
+ * Internal functions:
+ */
+
+
+/** Thread local cache of formatted second. */
+static __thread time_t lg_stamp_sec = -1;
+static __thread char   lg_stamp_date[ 32 ];
+static __thread size_t lg_stamp_len;
+static __thread long   lg_stamp_tid_id = -1;
+
+
+/**
+ * Write "value" as "width" digits (zero padded).
+ */
+static char* lg_stamp_digits( char* p, uint64_t value, int width )
+{
+    int i;
+
+    for ( i = width - 1; i >= 0; i-- ) {
+        p[ i ] = '0' + value % 10;
+        value /= 10;
+    }
+
+    return p + width;
+}
+
+
+/**
+ * Write "value" in decimal (at least "width" digits).
+ */
+static char* lg_stamp_number( char* p, uint64_t value, int width )
+{
+    char tmp[ 24 ];
+    int  n;
+
+    n = 0;
+    do {
+        tmp[ n++ ] = '0' + value % 10;
+        value /= 10;
+    } while ( value );
+
+    while ( n < width )
+        tmp[ n++ ] = ' ';
+
+    while ( n > 0 )
+        *p++ = tmp[ --n ];
+
+    return p;
+}
+
+
+/**
+ * Write "sssss.uuuuuu" for "ns".
+ */
+static size_t lg_stamp_elapsed( char* buf, uint64_t ns )
+{
+    char* p = buf;
+
+    p = lg_stamp_number( p, ns / 1000000000, 5 );
+    *p++ = '.';
+    p = lg_stamp_digits( p, ( ns % 1000000000 ) / 1000, 6 );
+
+    return p - buf;
+}
+
+
+/**
+ * Append "[<elapsed>] " for "ns".
+ */
+static void lg_stamp_elapsed_prefix( uint64_t ns, sl_p outbuf )
+{
+    char  buf[ LG_STAMP_MAX + 4 ];
+    char* p = buf;
+
+    *p++ = '[';
+    p += lg_stamp_elapsed( p, ns );
+    *p++ = ']';
+    *p++ = ' ';
+    *p = 0;
+
+    sl_concatenate_c( outbuf, buf );
+}
+
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+
+#include <x86intrin.h>
+
+/** First calibration after 100 ms, and then at 10 times longer periods. */
+#define LG_TSC_CALIB 100000000
+
+static pthread_once_t lg_tsc_once = PTHREAD_ONCE_INIT;
+static uint64_t       lg_tsc_base;
+static uint64_t       lg_tsc_mono;
+static double         lg_tsc_ns = 0;
+static uint64_t       lg_tsc_next = LG_TSC_CALIB;
+
+
+static uint64_t lg_tsc_clock( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+ * Take reference pair of TSC and monotonic clock.
+ */
+static void lg_tsc_start( void )
+{
+    lg_tsc_mono = lg_tsc_clock();
+    lg_tsc_base = __rdtsc();
+}
+
+
+/**
+ * Monotonic time from TSC. Until the first calibration the clock is
+ * read directly. Calibration uses the reference pair and a pair read
+ * when the period has passed, hence there is no waiting.
+ */
+static uint64_t lg_tsc_now( void )
+{
+    uint64_t tsc;
+    uint64_t next;
+    uint64_t now;
+    double   ns;
+
+    pthread_once( &lg_tsc_once, lg_tsc_start );
+
+    tsc = __rdtsc();
+    next = __atomic_load_n( &lg_tsc_next, __ATOMIC_ACQUIRE );
+    __atomic_load( &lg_tsc_ns, &ns, __ATOMIC_ACQUIRE );
+
+    if ( ns > 0 && ( tsc - lg_tsc_base ) * ns < next )
+        return lg_tsc_mono + ( tsc - lg_tsc_base ) * ns;
+
+    now = lg_tsc_clock();
+    if ( now - lg_tsc_mono >= next && tsc > lg_tsc_base
+         && __atomic_compare_exchange_n(
+             &lg_tsc_next, &next, next * 10, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) ) {
+        ns = (double)( now - lg_tsc_mono ) / (double)( tsc - lg_tsc_base );
+        __atomic_store( &lg_tsc_ns, &ns, __ATOMIC_RELEASE );
+    }
+
+    return now;
+}
+
+#endif
+
+
+
+/* ------------------------------------------------------------
+ * User API:
+ */
+
+
+size_t lg_stamp_wall( char* buf )
+{
+    struct timespec ts;
+    struct tm       tm;
+
+    clock_gettime( CLOCK_REALTIME, &ts );
+
+    if ( ts.tv_sec != lg_stamp_sec ) {
+        localtime_r( &ts.tv_sec, &tm );
+        lg_stamp_len = strftime( lg_stamp_date, sizeof( lg_stamp_date ), "%Y-%m-%d %H:%M:%S.", &tm );
+        lg_stamp_sec = ts.tv_sec;
+    }
+
+    memcpy( buf, lg_stamp_date, lg_stamp_len );
+    lg_stamp_digits( buf + lg_stamp_len, ts.tv_nsec / 1000, 6 );
+
+    return lg_stamp_len + 6;
+}
+
+
+size_t lg_stamp_mono( char* buf )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return lg_stamp_elapsed( buf, (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec );
+}
+
+
+size_t lg_stamp_tid( char* buf )
+{
+    if ( lg_stamp_tid_id < 0 )
+        lg_stamp_tid_id = syscall( SYS_gettid );
+
+    return lg_stamp_uint( buf, lg_stamp_tid_id );
+}
+
+
+size_t lg_stamp_uint( char* buf, uint64_t value )
+{
+    return lg_stamp_number( buf, value, 0 ) - buf;
+}
+
+
+void lg_prefix_wall( const lg_host_t host, const lg_grp_t grp, const char* msg, sl_p outbuf )
+{
+    char   buf[ LG_STAMP_MAX + 2 ];
+    size_t len;
+
+    (void)host;
+    (void)grp;
+    (void)msg;
+
+    len = lg_stamp_wall( buf );
+    buf[ len++ ] = ' ';
+    buf[ len ] = 0;
+
+    sl_concatenate_c( outbuf, buf );
+}
+
+
+void lg_prefix_mono( const lg_host_t host, const lg_grp_t grp, const char* msg, sl_p outbuf )
+{
+    struct timespec ts;
+
+    (void)host;
+    (void)grp;
+    (void)msg;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    lg_stamp_elapsed_prefix( (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec, outbuf );
+}
+
+
+void lg_prefix_tsc( const lg_host_t host, const lg_grp_t grp, const char* msg, sl_p outbuf )
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    (void)host;
+    (void)grp;
+    (void)msg;
+
+    lg_stamp_elapsed_prefix( lg_tsc_now(), outbuf );
+#else
+    lg_prefix_mono( host, grp, msg, outbuf );
+#endif
+}
@@ -0,0 +1,64 @@
+#ifndef LG_STAMP_H
+#define LG_STAMP_H
+
+/**
+ * @file   lg_stamp.h
+ *
+ * @brief  Logger - Timestamp formatting.
+ *
+ * Formatting functions write to "buf" without terminating NUL, and
+ * return the number of characters written. LG_STAMP_MAX is enough
+ * for any of them.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** Maximum timestamp length. */
+#define LG_STAMP_MAX 40
+
+
+/**
+ * Write wall clock time: "YYYY-MM-DD HH:MM:SS.uuuuuu".
+ *
+ * @param buf Output.
+ *
+ * @return Length.
+ */
+size_t lg_stamp_wall( char* buf );
+
+
+/**
+ * Write monotonic time: "sssss.uuuuuu" (seconds space padded).
+ *
+ * @param buf Output.
+ *
+ * @return Length.
+ */
+size_t lg_stamp_mono( char* buf );
+
+
+/**
+ * Write calling thread id.
+ *
+ * @param buf Output.
+ *
+ * @return Length.
+ */
+size_t lg_stamp_tid( char* buf );
+
+
+/**
+ * Write decimal number.
+ *
+ * @param buf   Output.
+ * @param value Number.
+ *
+ * @return Length.
+ */
+size_t lg_stamp_uint( char* buf, uint64_t value );
+
+
+#endif
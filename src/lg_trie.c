@@ -0,0 +1,356 @@
+/**
+ * @file   lg_trie.c
+ *
+ * @brief  Logger - Hierarchical name index.
+ *
+ * Few kids are searched linearly, and wider nodes have a hash map
+ * of kids by segment. Each glob walk has a number, and a node stores
+ * the walk number when its value is collected. Hence a name matched
+ * through multiple "**" expansions is collected once.
+ *
+ */
+
+
+#include "lg_trie.h"
+
+#include <fnmatch.h>
+#include <string.h>
+
+
+
+/* ------------------------------------------------------------
+ * Internal functions:
+ */
+
+
+/** Maximum segment count in glob pattern. */
+#define LG_TRIE_SEGS 64
+
+/** Segment length that is looked up without allocation. */
+#define LG_TRIE_SEG_BUF 128
+
+
+static lg_trie_t lg_trie_node( const char* seg, size_t len )
+{
+    lg_trie_t node;
+
+    node = po_malloc( sizeof( lg_trie_s ) );
+    node->seg = po_malloc( len + 1 );
+    memcpy( node->seg, seg, len );
+    node->seg[ len ] = 0;
+    node->value = NULL;
+    node->mark = 0;
+    node->walk = 0;
+    node->kids = po_new_descriptor( &node->kids_desc );
+    node->kids_map = NULL;
+
+    return node;
+}
+
+
+/**
+ * Find kid with segment name.
+ */
+static lg_trie_t lg_trie_kid( lg_trie_t node, const char* seg, size_t len )
+{
+    lg_trie_t kid;
+    char      buf[ LG_TRIE_SEG_BUF ];
+    char*     key;
+
+    if ( node->kids_map == NULL ) {
+        po_each( node->kids, kid, lg_trie_t )
+        {
+            if ( !strncmp( kid->seg, seg, len ) && kid->seg[ len ] == 0 )
+                return kid;
+        }
+        return NULL;
+    }
+
+    /* Map key is terminated segment. */
+    key = ( len < LG_TRIE_SEG_BUF ) ? buf : po_malloc( len + 1 );
+    memcpy( key, seg, len );
+    key[ len ] = 0;
+    kid = mp_get_key( node->kids_map, (const po_d)key );
+    if ( key != buf )
+        po_free( key );
+
+    return kid;
+}
+
+
+/**
+ * Add kid to node. Map is created when node becomes wide.
+ */
+static void lg_trie_add_kid( lg_trie_t node, lg_trie_t kid )
+{
+    lg_trie_t old;
+    size_t    cnt;
+
+    po_add( node->kids, kid );
+
+    if ( node->kids_map ) {
+        mp_put_key( node->kids_map, kid->seg, kid );
+        return;
+    }
+
+    cnt = 0;
+    po_each( node->kids, old, lg_trie_t )
+    {
+        cnt++;
+    }
+
+    if ( cnt >= LG_TRIE_LINEAR ) {
+        node->kids_map = mp_new_full( NULL, mp_key_hash_cstr, mp_key_comp_cstr, 16, 50 );
+        po_each( node->kids, old, lg_trie_t )
+        {
+            mp_put_key( node->kids_map, old->seg, old );
+        }
+    }
+}
+
+
+/**
+ * Find node for name (or NULL).
+ */
+static lg_trie_t lg_trie_find( lg_trie_t node, const char* name )
+{
+    const char* end;
+
+    for ( ;; ) {
+        end = strchr( name, '/' );
+        if ( end == NULL )
+            end = name + strlen( name );
+        node = lg_trie_kid( node, name, end - name );
+        if ( node == NULL || *end == 0 )
+            return node;
+        name = end + 1;
+    }
+}
+
+
+static size_t lg_trie_collect( lg_trie_t node, uint64_t walk, po_t out )
+{
+    if ( node->mark == walk || node->value == NULL )
+        return 0;
+
+    node->mark = walk;
+    po_add( out, node->value );
+
+    return 1;
+}
+
+
+static size_t lg_trie_subtree( lg_trie_t node, uint64_t walk, po_t out )
+{
+    lg_trie_t kid;
+    size_t    cnt;
+
+    cnt = lg_trie_collect( node, walk, out );
+
+    po_each( node->kids, kid, lg_trie_t )
+    {
+        cnt += lg_trie_subtree( kid, walk, out );
+    }
+
+    return cnt;
+}
+
+
+/**
+ * Split "str" (modified) to segments.
+ *
+ * @return Segment count (or -1 if too many).
+ */
+static int lg_trie_split( char* str, char** segs, int collapse )
+{
+    int n;
+
+    n = 0;
+    for ( ;; ) {
+        if ( n == LG_TRIE_SEGS )
+            return -1;
+        /* Consecutive "**" segments are equal to one. */
+        if ( !( collapse && n > 0 && !strcmp( segs[ n - 1 ], "**" ) && !strncmp( str, "**", 2 )
+                && ( str[ 2 ] == '/' || str[ 2 ] == 0 ) ) )
+            segs[ n++ ] = str;
+        str = strchr( str, '/' );
+        if ( str == NULL )
+            break;
+        *str++ = 0;
+    }
+
+    return n;
+}
+
+
+static int lg_trie_name_segs( char** pats, int i, int np, char** segs, int j, int ns )
+{
+    if ( i == np )
+        return j == ns;
+
+    if ( !strcmp( pats[ i ], "**" ) )
+        return lg_trie_name_segs( pats, i + 1, np, segs, j, ns )
+               || ( j < ns && lg_trie_name_segs( pats, i, np, segs, j + 1, ns ) );
+
+    if ( j == ns || fnmatch( pats[ i ], segs[ j ], 0 ) )
+        return 0;
+
+    return lg_trie_name_segs( pats, i + 1, np, segs, j + 1, ns );
+}
+
+
+static size_t lg_trie_match( lg_trie_t node, char** segs, size_t i, size_t n, uint64_t walk, po_t out )
+{
+    lg_trie_t kid;
+    size_t    cnt;
+
+    if ( i == n )
+        return lg_trie_collect( node, walk, out );
+
+    cnt = 0;
+
+    if ( !strcmp( segs[ i ], "**" ) ) {
+        /* Zero segments, or one more segment. */
+        cnt += lg_trie_match( node, segs, i + 1, n, walk, out );
+        po_each( node->kids, kid, lg_trie_t )
+        {
+            cnt += lg_trie_match( kid, segs, i, n, walk, out );
+        }
+    } else if ( !lg_trie_is_glob( segs[ i ] ) ) {
+        kid = lg_trie_kid( node, segs[ i ], strlen( segs[ i ] ) );
+        if ( kid )
+            cnt += lg_trie_match( kid, segs, i + 1, n, walk, out );
+    } else {
+        po_each( node->kids, kid, lg_trie_t )
+        {
+            if ( fnmatch( segs[ i ], kid->seg, 0 ) == 0 )
+                cnt += lg_trie_match( kid, segs, i + 1, n, walk, out );
+        }
+    }
+
+    return cnt;
+}
+
+
+
+/* ------------------------------------------------------------
+ * User API:
+ */
+
+
+lg_trie_t lg_trie_new( void )
+{
+    return lg_trie_node( "", 0 );
+}
+
+
+void lg_trie_del( lg_trie_t trie )
+{
+    lg_trie_t kid;
+
+    po_each( trie->kids, kid, lg_trie_t )
+    {
+        lg_trie_del( kid );
+    }
+
+    po_destroy_storage( trie->kids );
+    if ( trie->kids_map )
+        mp_destroy( trie->kids_map );
+    po_free( trie->seg );
+    po_free( trie );
+}
+
+
+void lg_trie_put( lg_trie_t trie, const char* name, void* value )
+{
+    lg_trie_t   node;
+    lg_trie_t   kid;
+    const char* end;
+
+    node = trie;
+
+    for ( ;; ) {
+        end = strchr( name, '/' );
+        if ( end == NULL )
+            end = name + strlen( name );
+        kid = lg_trie_kid( node, name, end - name );
+        if ( kid == NULL ) {
+            kid = lg_trie_node( name, end - name );
+            lg_trie_add_kid( node, kid );
+        }
+        node = kid;
+        if ( *end == 0 )
+            break;
+        name = end + 1;
+    }
+
+    node->value = value;
+}
+
+
+int lg_trie_is_glob( const char* name )
+{
+    return strpbrk( name, "*?[\\" ) != NULL;
+}
+
+
+int lg_trie_name_match( const char* pattern, const char* name )
+{
+    char* copy;
+    char* pats[ LG_TRIE_SEGS ];
+    char* segs[ LG_TRIE_SEGS ];
+    int   np;
+    int   ns;
+    int   ret;
+
+    copy = po_malloc( strlen( pattern ) + strlen( name ) + 2 );
+    strcpy( copy, pattern );
+    strcpy( copy + strlen( pattern ) + 1, name );
+
+    ret = 0;
+    ns = lg_trie_split( copy + strlen( pattern ) + 1, segs, 0 );
+    np = lg_trie_split( copy, pats, 1 );
+    if ( np >= 0 && ns >= 0 )
+        ret = lg_trie_name_segs( pats, 0, np, segs, 0, ns );
+
+    po_free( copy );
+
+    return ret;
+}
+
+
+size_t lg_trie_glob( lg_trie_t trie, const char* pattern, po_t out )
+{
+    char*  copy;
+    char*  segs[ LG_TRIE_SEGS ];
+    int    n;
+    size_t cnt;
+
+    copy = po_malloc( strlen( pattern ) + 1 );
+    strcpy( copy, pattern );
+
+    cnt = 0;
+    n = lg_trie_split( copy, segs, 1 );
+    if ( n >= 0 )
+        cnt = lg_trie_match( trie, segs, 0, n, ++trie->walk, out );
+
+    po_free( copy );
+
+    return cnt;
+}
+
+
+size_t lg_trie_prefix( lg_trie_t trie, const char* prefix, po_t out )
+{
+    lg_trie_t node;
+
+    if ( *prefix == 0 )
+        node = trie;
+    else
+        node = lg_trie_find( trie, prefix );
+
+    if ( node == NULL )
+        return 0;
+
+    return lg_trie_subtree( node, ++trie->walk, out );
+}
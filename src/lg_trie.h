@@ -0,0 +1,114 @@
+#ifndef LG_TRIE_H
+#define LG_TRIE_H
+
+/**
+ * @file   lg_trie.h
+ *
+ * @brief  Logger - Hierarchical name index.
+ *
+ * Names are split to segments at "/", and each segment is a node in
+ * the trie. Node has value if a name ends at the node.
+ *
+ * Glob pattern is matched segment by segment, hence only matching
+ * subtrees are visited. Pattern segment can have "*", "?" and "[...]"
+ * (as in fnmatch), which do not match "/", and "\\" escapes the next
+ * character. Segment "**" matches zero or more segments.
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sixten.h>
+#include <postor.h>
+#include <mapper.h>
+
+
+/** Kid count from which kids are hashed. */
+#define LG_TRIE_LINEAR 8
+
+
+st_struct( lg_trie )
+{
+    char*    seg;       /**< Segment name. */
+    void*    value;     /**< Value (or NULL if no name ends here). */
+    uint64_t mark;      /**< Last walk where value was collected. */
+    uint64_t walk;      /**< Walk counter (root). */
+    po_s     kids_desc; /**< Postor descriptor for kids. */
+    po_t     kids;      /**< Child nodes. */
+    mp_t     kids_map;  /**< Kids by segment (or NULL if few kids). */
+};
+
+
+/**
+ * Create empty index.
+ *
+ * @return Root node.
+ */
+lg_trie_t lg_trie_new( void );
+
+
+/**
+ * Destroy index. Values are not freed.
+ *
+ * @param trie Root node.
+ */
+void lg_trie_del( lg_trie_t trie );
+
+
+/**
+ * Add name with value to index.
+ *
+ * @param trie  Root node.
+ * @param name  Name.
+ * @param value Value.
+ */
+void lg_trie_put( lg_trie_t trie, const char* name, void* value );
+
+
+/**
+ * Check if string has glob characters (including escape).
+ *
+ * @param name Name or pattern.
+ *
+ * @return 1 if pattern.
+ */
+int lg_trie_is_glob( const char* name );
+
+
+/**
+ * Match name against glob pattern.
+ *
+ * @param pattern Glob pattern.
+ * @param name    Name.
+ *
+ * @return 1 if name matches.
+ */
+int lg_trie_name_match( const char* pattern, const char* name );
+
+
+/**
+ * Collect values of names matching glob pattern.
+ *
+ * @param trie    Root node.
+ * @param pattern Glob pattern.
+ * @param out     Values (appended).
+ *
+ * @return Number of values collected.
+ */
+size_t lg_trie_glob( lg_trie_t trie, const char* pattern, po_t out );
+
+
+/**
+ * Collect values of name "prefix" and names below it. Prefix is
+ * matched by whole segments, and empty prefix collects all values.
+ *
+ * @param trie   Root node.
+ * @param prefix Name prefix.
+ * @param out    Values (appended).
+ *
+ * @return Number of values collected.
+ */
+size_t lg_trie_prefix( lg_trie_t trie, const char* prefix, po_t out );
+
+
+#endif
@@ -0,0 +1,223 @@
+/**
+ * @file   lg_uring.c
+ *
+ * @brief  Logger - Minimal io_uring interface for File writes.
+ *
+ * Ring setup and access follow the io_uring system call interface
+ * directly. Submission tail and completion head are owned by user,
+ * and the other ends by kernel, hence the ring indeces are accessed
+ * with acquire/release ordering.
+ *
+ */
+
+
+#include "lg_uring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <postor.h>
+
+
+
+/* ------------------------------------------------------------
+ * Internal functions:
+ */
+
+
+static int lg_uring_enter( int fd, uint32_t submit, uint32_t complete, uint32_t flags )
+{
+    return (int)syscall( __NR_io_uring_enter, fd, submit, complete, flags, NULL, 0 );
+}
+
+
+
+/* ------------------------------------------------------------
+ * User API:
+ */
+
+
+lg_uring_t lg_uring_new( uint32_t entries )
+{
+    struct io_uring_params p;
+    lg_uring_t             ring;
+    int                    fd;
+
+    memset( &p, 0, sizeof( p ) );
+    fd = (int)syscall( __NR_io_uring_setup, entries, &p );
+    if ( fd < 0 )
+        return st_nil;
+
+    ring = po_malloc( sizeof( lg_uring_s ) );
+    memset( ring, 0, sizeof( lg_uring_s ) );
+    ring->fd = fd;
+    ring->entries = p.sq_entries;
+
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof( uint32_t );
+    ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe );
+    if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+        if ( ring->cq_size > ring->sq_size )
+            ring->sq_size = ring->cq_size;
+        ring->cq_size = 0;
+    }
+
+    ring->sq_ptr = mmap( NULL,
+                         ring->sq_size,
+                         PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE,
+                         fd,
+                         IORING_OFF_SQ_RING );
+    if ( ring->sq_ptr == MAP_FAILED )
+        goto fail_sq;
+
+    if ( ring->cq_size ) {
+        ring->cq_ptr = mmap( NULL,
+                             ring->cq_size,
+                             PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE,
+                             fd,
+                             IORING_OFF_CQ_RING );
+        if ( ring->cq_ptr == MAP_FAILED )
+            goto fail_cq;
+    } else {
+        ring->cq_ptr = ring->sq_ptr;
+    }
+
+    ring->sqes_size = p.sq_entries * sizeof( struct io_uring_sqe );
+    ring->sqes = mmap( NULL,
+                       ring->sqes_size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE,
+                       fd,
+                       IORING_OFF_SQES );
+    if ( ring->sqes == MAP_FAILED )
+        goto fail_sqes;
+
+    ring->sq_head = (uint32_t*)( (char*)ring->sq_ptr + p.sq_off.head );
+    ring->sq_tail = (uint32_t*)( (char*)ring->sq_ptr + p.sq_off.tail );
+    ring->sq_mask = *(uint32_t*)( (char*)ring->sq_ptr + p.sq_off.ring_mask );
+    ring->sq_array = (uint32_t*)( (char*)ring->sq_ptr + p.sq_off.array );
+    ring->cq_head = (uint32_t*)( (char*)ring->cq_ptr + p.cq_off.head );
+    ring->cq_tail = (uint32_t*)( (char*)ring->cq_ptr + p.cq_off.tail );
+    ring->cq_mask = *(uint32_t*)( (char*)ring->cq_ptr + p.cq_off.ring_mask );
+    ring->cqes = (char*)ring->cq_ptr + p.cq_off.cqes;
+
+    pthread_mutex_init( &ring->lock, NULL );
+
+    return ring;
+
+fail_sqes:
+    if ( ring->cq_size )
+        munmap( ring->cq_ptr, ring->cq_size );
+fail_cq:
+    munmap( ring->sq_ptr, ring->sq_size );
+fail_sq:
+    close( fd );
+    po_free( ring );
+    return st_nil;
+}
+
+
+void lg_uring_del( lg_uring_t ring )
+{
+    munmap( ring->sqes, ring->sqes_size );
+    if ( ring->cq_size )
+        munmap( ring->cq_ptr, ring->cq_size );
+    munmap( ring->sq_ptr, ring->sq_size );
+    close( ring->fd );
+    pthread_mutex_destroy( &ring->lock );
+    po_free( ring );
+}
+
+
+int lg_uring_write( lg_uring_t  ring,
+                    int         fd,
+                    const void* buf,
+                    uint32_t    len,
+                    uint64_t    off,
+                    uint64_t    user )
+{
+    struct io_uring_sqe* sqe;
+    uint32_t             tail;
+    uint32_t             head;
+    uint32_t             idx;
+
+    tail = *ring->sq_tail;
+    head = __atomic_load_n( ring->sq_head, __ATOMIC_ACQUIRE );
+    if ( tail - head >= ring->entries )
+        return -1;
+
+    /* Completion queue is twice the size of submission queue. */
+    if ( ring->inflight >= 2 * ring->entries )
+        return -1;
+
+    idx = tail & ring->sq_mask;
+    sqe = &( (struct io_uring_sqe*)ring->sqes )[ idx ];
+    memset( sqe, 0, sizeof( *sqe ) );
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->user_data = user;
+
+    ring->sq_array[ idx ] = idx;
+    __atomic_store_n( ring->sq_tail, tail + 1, __ATOMIC_RELEASE );
+
+    __atomic_store_n( &ring->queued, ring->queued + 1, __ATOMIC_RELAXED );
+    ring->inflight++;
+
+    return 0;
+}
+
+
+void lg_uring_submit( lg_uring_t ring )
+{
+    int ret;
+
+    while ( ring->queued > 0 ) {
+        ret = lg_uring_enter( ring->fd, ring->queued, 0, 0 );
+        if ( ret < 0 ) {
+            if ( errno == EINTR || errno == EAGAIN || errno == EBUSY )
+                continue;
+            return;
+        }
+        __atomic_store_n( &ring->queued, ring->queued - ret, __ATOMIC_RELAXED );
+    }
+}
+
+
+int lg_uring_reap( lg_uring_t ring, int wait, lg_uring_fn_p fn, void* arg )
+{
+    struct io_uring_cqe* cqe;
+    uint32_t             head;
+    uint32_t             tail;
+    int                  cnt;
+
+    cnt = 0;
+
+    for ( ;; ) {
+
+        head = *ring->cq_head;
+        tail = __atomic_load_n( ring->cq_tail, __ATOMIC_ACQUIRE );
+
+        while ( head != tail ) {
+            cqe = &( (struct io_uring_cqe*)ring->cqes )[ head & ring->cq_mask ];
+            fn( cqe->user_data, cqe->res, arg );
+            head++;
+            cnt++;
+            ring->inflight--;
+        }
+
+        __atomic_store_n( ring->cq_head, head, __ATOMIC_RELEASE );
+
+        if ( cnt > 0 || !wait || ring->inflight == 0 )
+            return cnt;
+
+        if ( lg_uring_enter( ring->fd, 0, 1, IORING_ENTER_GETEVENTS ) < 0 && errno != EINTR )
+            return -1;
+    }
+}
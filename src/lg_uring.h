@@ -0,0 +1,118 @@
+#ifndef LG_URING_H
+#define LG_URING_H
+
+/**
+ * @file   lg_uring.h
+ *
+ * @brief  Logger - Minimal io_uring interface for File writes.
+ *
+ * Ring is used through raw system calls, hence no library is needed.
+ * Writes are first queued, then submitted as one batch, and finally
+ * reaped. Ring is not thread safe, and users must hold "lock".
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sixten.h>
+
+
+/** Default Ring size. */
+#define LG_URING_ENTRIES 64
+
+
+/**
+ * Completion callback.
+ *
+ * @param user User data of write.
+ * @param res  Bytes written (or negative errno).
+ * @param arg  Callback argument.
+ */
+typedef void ( *lg_uring_fn_p )( uint64_t user, int32_t res, void* arg );
+
+
+st_struct( lg_uring )
+{
+    int             fd;       /**< Ring file descriptor. */
+    uint32_t        entries;  /**< Submission queue size. */
+    uint32_t        queued;   /**< Queued, not submitted. */
+    uint32_t        inflight; /**< Queued or submitted, not reaped. */
+    void*           sq_ptr;   /**< Submission ring mapping. */
+    size_t          sq_size;  /**< Submission ring mapping size. */
+    void*           cq_ptr;   /**< Completion ring mapping. */
+    size_t          cq_size;  /**< Completion ring mapping size. */
+    void*           sqes;     /**< Submission entries mapping. */
+    size_t          sqes_size; /**< Submission entries mapping size. */
+    uint32_t*       sq_head;  /**< Submission head (kernel). */
+    uint32_t*       sq_tail;  /**< Submission tail (user). */
+    uint32_t        sq_mask;  /**< Submission mask. */
+    uint32_t*       sq_array; /**< Submission index array. */
+    uint32_t*       cq_head;  /**< Completion head (user). */
+    uint32_t*       cq_tail;  /**< Completion tail (kernel). */
+    uint32_t        cq_mask;  /**< Completion mask. */
+    void*           cqes;     /**< Completion entries. */
+    pthread_mutex_t lock;     /**< User lock. */
+};
+
+
+/**
+ * Create Ring.
+ *
+ * @param entries Submission queue size.
+ *
+ * @return Ring (or NULL if io_uring is not available).
+ */
+lg_uring_t lg_uring_new( uint32_t entries );
+
+
+/**
+ * Destroy Ring. Ring should not have writes in flight.
+ *
+ * @param ring Ring.
+ */
+void lg_uring_del( lg_uring_t ring );
+
+
+/**
+ * Queue write.
+ *
+ * @param ring Ring.
+ * @param fd   File descriptor.
+ * @param buf  Data (valid until completion).
+ * @param len  Data length.
+ * @param off  File offset.
+ * @param user User data for completion.
+ *
+ * @return 0 on success, -1 if submission queue is full.
+ */
+int lg_uring_write( lg_uring_t  ring,
+                    int         fd,
+                    const void* buf,
+                    uint32_t    len,
+                    uint64_t    off,
+                    uint64_t    user );
+
+
+/**
+ * Submit queued writes.
+ *
+ * @param ring Ring.
+ */
+void lg_uring_submit( lg_uring_t ring );
+
+
+/**
+ * Reap completions.
+ *
+ * @param ring Ring.
+ * @param wait Wait for at least one completion.
+ * @param fn   Completion callback.
+ * @param arg  Callback argument.
+ *
+ * @return Number of completions (-1 on failure).
+ */
+int lg_uring_reap( lg_uring_t ring, int wait, lg_uring_fn_p fn, void* arg );
+
+
+#endif
@@ -9,9 +9,32 @@
 
 
 #include "logger.h"
+#include "lg_bin.h"
+#include "lg_ring.h"
+#include "lg_shard.h"
 
 #include <linux/limits.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <signal.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <zlib.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 
 void lg_void_assert( void );
 
@@ -23,6 +46,219 @@ void gdb_breakpoint( void );
  * Internal functions:
  */
 
+/** Message kinds in async queue. */
+#define LG_MSG_TEXT 0
+#define LG_MSG_DEFERRED 1
+#define LG_MSG_KV 2
+
+
+/** Deferred message header. */
+st_struct( lg_defer )
+{
+    lg_grp_t    grp;     /**< Group. */
+    const char* format;  /**< Format. */
+    int         newline; /**< Add newline. */
+};
+
+
+/** Key-value message header (encodings follow). */
+st_struct( lg_kv_msg )
+{
+    uint32_t off[ LG_ENC_CNT ]; /**< Encoding offset from message start. */
+    uint32_t len[ LG_ENC_CNT ]; /**< Encoding length. */
+};
+
+
+/** Thread local formatting buffers (threaded Host). */
+static __thread sl_t         lg_tls_buf = st_nil;
+static __thread lg_fmt_buf_s lg_tls_args;
+static pthread_key_t         lg_tls_key;
+static pthread_once_t        lg_tls_once = PTHREAD_ONCE_INIT;
+
+/** Alternate signal stack of thread (or NULL). */
+static __thread void* lg_tls_altstack = st_nil;
+
+static void lg_crash_thread( void );
+
+/** Thread index (-1 if not assigned). */
+static __thread int32_t lg_tls_index = -1;
+static uint32_t         lg_thread_next = 0;
+
+
+static void lg_tls_buf_del( void* arg )
+{
+    stack_t ss;
+
+    (void)arg;
+
+    if ( lg_tls_buf )
+        sl_del( &lg_tls_buf );
+    lg_fmt_buf_free( &lg_tls_args );
+
+    if ( lg_tls_altstack ) {
+        memset( &ss, 0, sizeof( ss ) );
+        ss.ss_flags = SS_DISABLE;
+        sigaltstack( &ss, NULL );
+        po_free( lg_tls_altstack );
+        lg_tls_altstack = st_nil;
+    }
+}
+
+
+static void lg_tls_init( void )
+{
+    pthread_key_create( &lg_tls_key, lg_tls_buf_del );
+}
+
+
+static void lg_tls_setup( void )
+{
+    if ( lg_tls_buf == st_nil ) {
+        pthread_once( &lg_tls_once, lg_tls_init );
+        lg_tls_buf = sl_new( 256 );
+        lg_fmt_buf_init( &lg_tls_args );
+        /* Key value is only a marker for running the destructor. */
+        pthread_setspecific( lg_tls_key, &lg_tls_buf );
+        lg_crash_thread();
+    }
+}
+
+
+/**
+ * Return index of calling thread. Indices are assigned in order of
+ * first use.
+ */
+static uint32_t lg_thread_index( void )
+{
+    if ( lg_tls_index < 0 )
+        lg_tls_index = __atomic_fetch_add( &lg_thread_next, 1, __ATOMIC_RELAXED ) & INT32_MAX;
+
+    return lg_tls_index;
+}
+
+
+static sl_p lg_host_buf( lg_host_t host )
+{
+    if ( !host->threaded )
+        return &host->buf;
+
+    lg_tls_setup();
+
+    return &lg_tls_buf;
+}
+
+
+static lg_fmt_buf_t lg_host_args( lg_host_t host )
+{
+    if ( !host->threaded )
+        return &host->args;
+
+    lg_tls_setup();
+
+    return &lg_tls_args;
+}
+
+
+static void lg_host_lock( lg_host_t host )
+{
+    if ( host->threaded )
+        pthread_mutex_lock( &host->lock );
+}
+
+
+static void lg_host_unlock( lg_host_t host )
+{
+    if ( host->threaded )
+        pthread_mutex_unlock( &host->lock );
+}
+
+
+/**
+ * Enter section where plans and Group strings are used without Host
+ * lock. Retired memory is freed only when no section of its epoch is
+ * active.
+ *
+ * @return Epoch parity for lg_host_exit().
+ */
+static int lg_host_enter( lg_host_t host )
+{
+    lg_reader_t reader;
+    uint64_t    epoch;
+
+    if ( !host->threaded )
+        return 0;
+
+    reader = &host->readers[ lg_thread_index() % LG_READERS ];
+
+    /* Registration counts only if epoch did not change meanwhile. */
+    for ( ;; ) {
+        epoch = __atomic_load_n( &host->epoch, __ATOMIC_SEQ_CST );
+        __atomic_add_fetch( &reader->cnt[ epoch & 1 ], 1, __ATOMIC_SEQ_CST );
+        if ( __atomic_load_n( &host->epoch, __ATOMIC_SEQ_CST ) == epoch )
+            break;
+        __atomic_sub_fetch( &reader->cnt[ epoch & 1 ], 1, __ATOMIC_RELEASE );
+    }
+
+    return epoch & 1;
+}
+
+
+static void lg_host_exit( lg_host_t host, int parity )
+{
+    if ( !host->threaded )
+        return;
+
+    __atomic_sub_fetch(
+        &host->readers[ lg_thread_index() % LG_READERS ].cnt[ parity ], 1, __ATOMIC_RELEASE );
+}
+
+
+/**
+ * Free memory retired two epochs ago, and advance epoch, if no
+ * reader or queued async message can refer to it. Host lock must be
+ * held.
+ */
+static void lg_host_reclaim( lg_host_t host )
+{
+    uint64_t next;
+    uint64_t cnt;
+    void*    mem;
+    int      i;
+
+    next = ( host->epoch + 1 ) & 1;
+
+    cnt = 0;
+    for ( i = 0; i < LG_READERS; i++ )
+        cnt += __atomic_load_n( &host->readers[ i ].cnt[ next ], __ATOMIC_SEQ_CST );
+    if ( cnt )
+        return;
+
+    if ( host->async
+         && __atomic_load_n( &host->async->consumed, __ATOMIC_ACQUIRE ) < host->retire_mark )
+        return;
+
+    po_each( host->retired[ next ], mem, void* )
+    {
+        po_free( mem );
+    }
+    po_reset( host->retired[ next ] );
+
+    host->retire_mark = host->async ? lg_queue_claimed( host->async->queue ) : 0;
+    __atomic_store_n( &host->epoch, host->epoch + 1, __ATOMIC_SEQ_CST );
+}
+
+
+static void lg_host_retire( lg_host_t host, void* mem )
+{
+    if ( host->threaded || host->async ) {
+        po_add( host->retired[ host->epoch & 1 ], mem );
+        lg_host_reclaim( host );
+    } else {
+        po_free( mem );
+    }
+}
+
+
 static lg_grp_t lg_host_get_grp( lg_host_t host, const char* name )
 {
     lg_grp_t grp;
@@ -43,10 +279,105 @@ static lg_grp_t lg_host_check_grp( lg_host_t host, const char* name )
 }
 
 
+static lg_names_t lg_names_new( size_t size )
+{
+    lg_names_t names;
+
+    names = po_malloc( sizeof( lg_names_s ) + size * sizeof( lg_name_s ) );
+    memset( names, 0, sizeof( lg_names_s ) + size * sizeof( lg_name_s ) );
+    names->mask = size - 1;
+
+    return names;
+}
+
+
+/**
+ * Put Group to free entry of name table. Entry is published with
+ * release, hence readers see either free entry or complete entry.
+ */
+static void lg_names_put( lg_names_t names, uint64_t hash, lg_grp_t grp )
+{
+    size_t i;
+
+    for ( i = hash & names->mask; names->ents[ i ].grp; i = ( i + 1 ) & names->mask )
+        ;
+
+    names->ents[ i ].hash = hash;
+    __atomic_store_n( &names->ents[ i ].grp, grp, __ATOMIC_RELEASE );
+    names->cnt++;
+}
+
+
+/**
+ * Add Group to name table of Host. Table is replaced with double
+ * size when half full, and old table is retired. Host lock must be
+ * held.
+ */
+static void lg_host_add_name( lg_host_t host, lg_grp_t grp )
+{
+    lg_names_t names = host->lookup;
+    lg_names_t next;
+    lg_grp_t   ent;
+    size_t     i;
+
+    if ( names == st_nil || ( names->cnt + 1 ) * 2 > names->mask + 1 ) {
+        next = lg_names_new( names ? ( names->mask + 1 ) * 2 : 64 );
+        if ( names ) {
+            for ( i = 0; i <= names->mask; i++ ) {
+                ent = names->ents[ i ].grp;
+                if ( ent )
+                    lg_names_put( next, names->ents[ i ].hash, ent );
+            }
+        }
+        lg_names_put( next, mp_key_hash_cstr( (const po_d)grp->name ), grp );
+        __atomic_store_n( &host->lookup, next, __ATOMIC_RELEASE );
+        if ( names )
+            lg_host_retire( host, names );
+    } else {
+        lg_names_put( names, mp_key_hash_cstr( (const po_d)grp->name ), grp );
+    }
+}
+
+
+/**
+ * Get Group for logging call. Name table is read without Host lock,
+ * and reclamation section protects a table that is being replaced.
+ */
+static lg_grp_t lg_host_find_grp( lg_host_t host, const char* name )
+{
+    lg_names_t names;
+    lg_grp_t   grp;
+    uint64_t   hash;
+    size_t     i;
+    int        parity;
+
+    hash = mp_key_hash_cstr( (const po_d)name );
+
+    parity = lg_host_enter( host );
+    names = __atomic_load_n( &host->lookup, __ATOMIC_ACQUIRE );
+    grp = st_nil;
+    if ( names ) {
+        for ( i = hash & names->mask;; i = ( i + 1 ) & names->mask ) {
+            grp = __atomic_load_n( &names->ents[ i ].grp, __ATOMIC_ACQUIRE );
+            if ( grp == st_nil || ( names->ents[ i ].hash == hash && !strcmp( grp->name, name ) ) )
+                break;
+        }
+    }
+    lg_host_exit( host, parity );
+
+    if ( grp == st_nil )
+        lg_assert( 0 ); // GCOV_EXCL_LINE
+
+    return grp;
+}
+
+
 static void lg_host_add_grp( lg_host_t host, lg_grp_t grp )
 {
     if ( lg_host_check_grp( host, grp->name ) == st_nil ) {
         mp_put_key( host->grps, grp->name, grp );
+        lg_trie_put( host->names, grp->name, grp );
+        lg_host_add_name( host, grp );
     } else {
         lg_assert( 0 ); // GCOV_EXCL_LINE
     }
@@ -59,342 +390,3961 @@ static lg_log_t lg_host_check_log( lg_host_t host, const char* name )
 }
 
 
+/**
+ * Find File of any type by name (or NULL).
+ */
+static lg_log_t lg_host_find_file( lg_host_t host, const char* name )
+{
+    if ( strcmp( name, "<stdout>" ) ) {
+        realpath( name, host->buf );
+        sl_refresh( host->buf );
+        name = host->buf;
+    }
+
+    return lg_host_check_log( host, name );
+}
+
+
 static void lg_host_add_log( lg_host_t host, lg_log_t log )
 {
+    log->hist = po_malloc( sizeof( uint64_t ) * LG_HIST_SIZE );
+    memset( log->hist, 0, sizeof( uint64_t ) * LG_HIST_SIZE );
     mp_put_key( host->logs, log->name, log );
+    po_add( host->files, log );
+}
+
+
+static uint64_t lg_time_ns( clockid_t clock )
+{
+    struct timespec ts;
+
+    clock_gettime( clock, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+ * Add to statistics counter that is updated without Log lock, i.e.
+ * Group counters and write counters of Ring completions.
+ */
+static inline void lg_stat_add( uint64_t* cnt, uint64_t value )
+{
+    __atomic_fetch_add( cnt, value, __ATOMIC_RELAXED );
+}
+
+
+/**
+ * Add to statistics counter under Log lock. Only the lock owner
+ * updates, hence plain add suffices. Store is atomic for readers.
+ */
+static inline void lg_stat_add_locked( uint64_t* cnt, uint64_t value )
+{
+    __atomic_store_n( cnt, __atomic_load_n( cnt, __ATOMIC_RELAXED ) + value, __ATOMIC_RELAXED );
 }
 
 
 static lg_log_t lg_log_new( lg_log_type_t type, const char* name )
 {
     lg_log_t log;
+    int      i;
 
     log = po_malloc( sizeof( lg_log_s ) );
     log->type = type;
     if ( name )
         log->name = strdup( name );
-    log->fh = st_nil;
+    log->grp = st_nil;
+    log->fd = -1;
+    pthread_mutex_init( &log->lock, NULL );
+    log->iov = st_nil;
+    log->iovcnt = 0;
+    log->seq = 0;
+    log->strs = st_nil;
+    log->grps = st_nil;
+    log->str_cnt = 0;
+    log->grp_cnt = 0;
+    memset( log->fmt_ptr, 0, sizeof( log->fmt_ptr ) );
+    lg_fmt_buf_init( &log->rec );
+
+    log->policy = ( type == LG_LOG_TYPE_STDOUT ) ? LG_BUF_LINE : LG_BUF_SIZE;
+    log->obuf = st_nil;
+    log->olen = 0;
+    log->osize = LG_BUF_DEFAULT;
+    log->interval = 0;
+    log->flushed = 0;
+    log->shared = 0;
+    log->map = st_nil;
+    log->mlen = 0;
+    log->msize = 0;
+    log->ring = st_nil;
+    log->off = 0;
+    memset( log->ubufs, 0, sizeof( log->ubufs ) );
+    for ( i = 0; i < LG_URING_BUFS; i++ )
+        log->ubufs[ i ].log = log;
+    log->ubusy = 0;
+    log->size = 0;
+    log->rot_size = 0;
+    log->rot_interval = 0;
+    log->rot_start = 0;
+    log->rot_keep = 0;
+    log->rot_seq = 0;
+    log->rot_compress = 0;
+    log->rotor = st_nil;
+    log->spare_fd = -1;
+    log->spare_map = st_nil;
+    log->spare_buf = st_nil;
+    pthread_cond_init( &log->spare_ready, NULL );
+    log->enc = LG_ENC_TEXT;
+    log->shards = st_nil;
+    log->shard_cnt = 0;
+    log->shard_run = 0;
+    log->stat_msgs = 0;
+    log->stat_bytes = 0;
+    log->stat_writes = 0;
+    log->stat_errors = 0;
+    log->hist = st_nil;
+
+    if ( type == LG_LOG_TYPE_RING )
+        log->msize = LG_RING_SIZE;
+
+    if ( type == LG_LOG_TYPE_BIN ) {
+        log->strs = mp_new_full( NULL, mp_key_hash_cstr, mp_key_comp_cstr, 16, 50 );
+        log->grps = mp_new_full( NULL, mp_key_hash_cstr, mp_key_comp_cstr, 16, 50 );
+    }
 
     return log;
 }
 
 
-static void lg_log_del( lg_log_t log )
+static void lg_log_bin_key_del_fn( po_d key, po_d value, void* arg )
 {
-    if ( log->type == LG_LOG_TYPE_FILE && log->fh )
-        fclose( log->fh );
-
-    if ( log->name )
-        po_free( log->name );
+    (void)value;
+    (void)arg;
 
-    po_free( log );
+    po_free( key );
 }
 
 
-static lg_log_t lg_log_new_file( lg_host_t host, const char* name )
+static void lg_log_sys_write( lg_log_t log, const char* data, size_t len )
 {
-    lg_log_t log;
-    lg_log_t file;
+    ssize_t ret;
+
+    /* Previous stdio output must precede. */
+    if ( log->type == LG_LOG_TYPE_STDOUT )
+        fflush( stdout );
+
+    while ( len > 0 ) {
+        if ( log->ring )
+            ret = pwrite( log->fd, data, len, log->off );
+        else
+            ret = write( log->fd, data, len );
+        lg_stat_add( &log->stat_writes, 1 );
+        if ( ret < 0 ) {
+            if ( errno == EINTR )
+                continue;
+            lg_stat_add( &log->stat_errors, 1 );
+            return;
+        }
+        data += ret;
+        len -= ret;
+        log->off += ret;
+    }
+}
 
-    if ( !strcmp( name, "<stdout>" ) ) {
 
-        file = lg_host_check_log( host, name );
-        if ( file == st_nil ) {
-            file = lg_log_new( LG_LOG_TYPE_STDOUT, name );
-            file->fh = stdout;
-            lg_host_add_log( host, file );
+static void lg_log_sys_writev( lg_log_t log, struct iovec* iov, int cnt )
+{
+    ssize_t ret;
+
+    if ( log->type == LG_LOG_TYPE_STDOUT )
+        fflush( stdout );
+
+    while ( cnt > 0 ) {
+
+        if ( log->ring )
+            ret = pwritev( log->fd, iov, cnt < IOV_MAX ? cnt : IOV_MAX, log->off );
+        else
+            ret = writev( log->fd, iov, cnt < IOV_MAX ? cnt : IOV_MAX );
+        lg_stat_add( &log->stat_writes, 1 );
+        if ( ret < 0 ) {
+            if ( errno == EINTR )
+                continue;
+            lg_stat_add( &log->stat_errors, 1 );
+            return;
         }
-        log = lg_log_new( LG_LOG_TYPE_LOGREF, file->name );
-        log->log = file;
 
-    } else {
+        log->off += ret;
 
-        realpath( name, host->buf );
-        sl_refresh( host->buf );
+        while ( cnt > 0 && (size_t)ret >= iov->iov_len ) {
+            ret -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
 
-        file = lg_host_check_log( host, host->buf );
-        if ( file == st_nil ) {
-            file = lg_log_new( LG_LOG_TYPE_FILE, host->buf );
-            lg_host_add_log( host, file );
+        if ( cnt > 0 ) {
+            iov->iov_base = (char*)iov->iov_base + ret;
+            iov->iov_len -= ret;
         }
-        log = lg_log_new( LG_LOG_TYPE_LOGREF, file->name );
-        log->log = file;
     }
-
-    return log;
 }
 
 
-static void lg_log_write( lg_log_t log, const sl_t msg )
+/**
+ * Grow mapping to fit "len" more bytes.
+ */
+static void lg_log_map_grow( lg_log_t log, size_t len )
 {
-    if ( log->type == LG_LOG_TYPE_FILE ) {
+    size_t size;
 
-        if ( log->fh == st_nil ) {
-            log->fh = fopen( log->name, "w" );
-            if ( log->fh == st_nil )
-                lg_assert( 0 ); // GCOV_EXCL_LINE
-        }
+    size = log->msize;
+    do {
+        size += LG_MMAP_CHUNK;
+    } while ( size < log->mlen + len );
 
-        fwrite( msg, 1, sl_length( msg ), log->fh );
+    if ( log->map )
+        munmap( log->map, log->msize );
 
-    } else if ( log->type == LG_LOG_TYPE_STDOUT ) {
+    if ( posix_fallocate( log->fd, 0, size ) != 0 )
+        if ( ftruncate( log->fd, size ) != 0 )
+            lg_assert( 0 ); // GCOV_EXCL_LINE
 
-        fwrite( msg, 1, sl_length( msg ), log->fh );
+    log->map = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, log->fd, 0 );
+    if ( log->map == MAP_FAILED )
+        lg_assert( 0 ); // GCOV_EXCL_LINE
 
-    } else if ( log->type == LG_LOG_TYPE_LOGREF ) {
+    log->msize = size;
+}
 
-        lg_log_write( log->log, msg );
 
-    } else if ( log->type == LG_LOG_TYPE_GRPREF ) {
+static void lg_log_map_append( lg_log_t log, const char* data, size_t len )
+{
+    if ( log->mlen + len > log->msize )
+        lg_log_map_grow( log, len );
 
-        if ( log->grp->logs ) {
-            lg_log_t ref;
-            po_each( log->grp->logs, ref, lg_log_t )
-            {
-                lg_log_write( ref, msg );
-            }
-        }
+    memcpy( log->map + log->mlen, data, len );
+    log->mlen += len;
+}
 
-    } else {
-        lg_assert( 0 ); // GCOV_EXCL_LINE
+
+/**
+ * Unmap and truncate File to written length.
+ */
+static void lg_log_map_close( lg_log_t log )
+{
+    if ( log->map ) {
+        munmap( log->map, log->msize );
+        log->map = st_nil;
     }
+
+    if ( ftruncate( log->fd, log->mlen ) != 0 )
+        lg_assert( 0 ); // GCOV_EXCL_LINE
+
+    log->mlen = 0;
+    log->msize = 0;
 }
 
 
-static lg_grp_t lg_grp_new( lg_host_t host, lg_grp_type_t type, const char* name )
+/**
+ * Create and map flight recorder File.
+ */
+static void lg_log_ring_open( lg_log_t log )
 {
-    lg_grp_t grp;
+    size_t      total;
+    uint32_t    version = LG_RING_VERSION;
+    uint64_t    size = log->msize;
+    struct stat st;
+    int         reuse;
+
+    total = LG_RING_HEAD + log->msize;
+
+    /* Ring of previous run is continued if the format matches. */
+    reuse = ( fstat( log->fd, &st ) == 0 && (size_t)st.st_size == total );
+
+    if ( !reuse ) {
+        if ( ftruncate( log->fd, 0 ) != 0 )
+            lg_assert( 0 ); // GCOV_EXCL_LINE
+        if ( posix_fallocate( log->fd, 0, total ) != 0 )
+            if ( ftruncate( log->fd, total ) != 0 )
+                lg_assert( 0 ); // GCOV_EXCL_LINE
+    }
 
-    grp = po_malloc( sizeof( lg_grp_s ) );
-    grp->type = type;
-    grp->name = strdup( name );
-    grp->prefix = st_nil;
-    grp->postfix = st_nil;
-    grp->logs = po_new_descriptor( &grp->logs_desc );
-    grp->active = host->conf_active;
-    grp->top = st_nil;
-    grp->subs = po_new_descriptor( &grp->subs_desc );
+    log->map = mmap( NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, log->fd, 0 );
+    if ( log->map == MAP_FAILED )
+        lg_assert( 0 ); // GCOV_EXCL_LINE
 
-    lg_host_add_grp( host, grp );
+    if ( reuse && !memcmp( log->map, LG_RING_MAGIC, 4 )
+         && !memcmp( log->map + 4, &version, sizeof( version ) )
+         && !memcmp( log->map + LG_RING_OFF_SIZE, &size, sizeof( size ) ) )
+        return;
 
-    return grp;
+    memset( log->map, 0, LG_RING_HEAD );
+    memcpy( log->map, LG_RING_MAGIC, 4 );
+    memcpy( log->map + 4, &version, sizeof( version ) );
+    memcpy( log->map + LG_RING_OFF_SIZE, &size, sizeof( size ) );
 }
 
 
-static void lg_grp_del_logs( lg_grp_t grp )
+static void lg_log_ring_append( lg_log_t log, const char* data, size_t len )
 {
-    lg_log_t log;
-    if ( grp->logs ) {
-        po_each( grp->logs, log, lg_log_t )
-        {
-            lg_log_del( log );
-        }
-        po_reset( grp->logs );
+    uint64_t* posp = (uint64_t*)( log->map + LG_RING_OFF_POS );
+    char*     ring = log->map + LG_RING_HEAD;
+    uint64_t  pos;
+    size_t    at;
+    size_t    part;
+
+    pos = *posp;
+
+    /* Only the tail of an oversized message fits. */
+    if ( len > log->msize ) {
+        pos += len - log->msize;
+        data += len - log->msize;
+        len = log->msize;
     }
-}
 
+    at = pos % log->msize;
+    part = log->msize - at;
+    if ( part > len )
+        part = len;
 
-static void lg_grp_del( lg_grp_t grp )
-{
-    po_free( grp->name );
-    lg_grp_del_logs( grp );
-    po_destroy_storage( grp->logs );
-    po_destroy_storage( grp->subs );
-}
+    memcpy( ring + at, data, part );
+    memcpy( ring, data + part, len - part );
 
+    __atomic_store_n( posp, pos + len, __ATOMIC_RELEASE );
+}
 
 
-static void lg_grp_enable( lg_grp_t grp )
+/**
+ * Ring completion. Incomplete or failed write is finished with
+ * pwrite.
+ */
+static void lg_log_uring_done( uint64_t user, int32_t res, void* arg )
 {
-    if ( grp->type == LG_GRP_TYPE_TOP ) {
-        if ( grp->subs ) {
-            lg_grp_t sub;
-            po_each( grp->subs, sub, lg_grp_t )
-            {
-                lg_grp_enable( sub );
-            }
+    lg_ubuf_t ub = (lg_ubuf_t)(uintptr_t)user;
+    lg_log_t  log = ub->log;
+    size_t    done;
+    ssize_t   ret;
+
+    (void)arg;
+
+    if ( res < 0 )
+        lg_stat_add( &log->stat_errors, 1 );
+
+    done = ( res > 0 ) ? (size_t)res : 0;
+    while ( done < ub->len ) {
+        ret = pwrite( ub->fd, ub->data + done, ub->len - done, ub->off + done );
+        lg_stat_add( &log->stat_writes, 1 );
+        if ( ret < 0 ) {
+            if ( errno == EINTR )
+                continue;
+            lg_stat_add( &log->stat_errors, 1 );
+            break;
         }
+        done += ret;
     }
 
-    grp->active = st_true;
+    ub->busy = 0;
+    log->ubusy--;
 }
 
 
-static void lg_grp_disable( lg_grp_t grp )
+/**
+ * Ring failure, write buffers in flight synchronously.
+ */
+static void lg_log_uring_sync( lg_log_t log )
 {
-    if ( grp->type == LG_GRP_TYPE_TOP ) {
-        if ( grp->subs ) {
-            lg_grp_t sub;
-            po_each( grp->subs, sub, lg_grp_t )
-            {
-                lg_grp_disable( sub );
-            }
-        }
-    }
+    int i;
 
-    grp->active = st_false;
+    for ( i = 0; i < LG_URING_BUFS; i++ )
+        if ( log->ubufs[ i ].busy )
+            lg_log_uring_done( (uint64_t)(uintptr_t)&log->ubufs[ i ], 0, st_nil );
 }
 
 
-static lg_grp_fn_p lg_grp_get_prefix( lg_grp_t grp )
-{
-    if ( grp->prefix ) {
-        return grp->prefix;
-    } else if ( grp->top ) {
-        return lg_grp_get_prefix( grp->top );
+/**
+ * Wait until buffers of Log are written. Ring lock must be held.
+ */
+static void lg_log_uring_wait( lg_log_t log )
+{
+    lg_uring_submit( log->ring );
+    while ( log->ubusy ) {
+        if ( lg_uring_reap( log->ring, 1, lg_log_uring_done, st_nil ) < 0 )
+            lg_log_uring_sync( log );
+    }
+}
+
+
+/**
+ * Release Ring buffers. Buffers must not be in flight.
+ */
+static void lg_log_uring_free( lg_log_t log )
+{
+    int i;
+
+    for ( i = 0; i < LG_URING_BUFS; i++ ) {
+        if ( log->ubufs[ i ].data ) {
+            po_free( log->ubufs[ i ].data );
+            log->ubufs[ i ].data = st_nil;
+        }
+    }
+}
+
+
+/**
+ * Queue buffered data to Ring, and continue with a free buffer. The
+ * caller waits only when all buffers of Log are in flight.
+ */
+static void lg_log_uring_drain( lg_log_t log )
+{
+    lg_uring_t ring = log->ring;
+    lg_ubuf_t  ub;
+    char*      buf;
+    int        i;
+
+    pthread_mutex_lock( &ring->lock );
+
+    lg_uring_reap( ring, 0, lg_log_uring_done, st_nil );
+    while ( log->ubusy == LG_URING_BUFS ) {
+        lg_uring_submit( ring );
+        if ( lg_uring_reap( ring, 1, lg_log_uring_done, st_nil ) < 0 )
+            lg_log_uring_sync( log );
+    }
+
+    for ( i = 0; log->ubufs[ i ].busy; i++ )
+        ;
+    ub = &log->ubufs[ i ];
+
+    buf = ub->data;
+    if ( buf == st_nil )
+        buf = po_malloc( log->osize );
+
+    ub->data = log->obuf;
+    ub->len = log->olen;
+    ub->off = log->off;
+    ub->fd = log->fd;
+    ub->busy = 1;
+    log->ubusy++;
+    log->obuf = buf;
+    log->off += log->olen;
+    lg_stat_add( &log->stat_writes, 1 );
+
+    while ( lg_uring_write( ring, log->fd, ub->data, ub->len, ub->off, (uint64_t)(uintptr_t)ub ) < 0 ) {
+        lg_uring_submit( ring );
+        if ( lg_uring_reap( ring, 1, lg_log_uring_done, st_nil ) < 0 ) {
+            lg_log_uring_done( (uint64_t)(uintptr_t)ub, 0, st_nil );
+            break;
+        }
+    }
+
+    pthread_mutex_unlock( &ring->lock );
+}
+
+
+/**
+ * Submit queued Ring writes of Host, and reap completed.
+ */
+static void lg_host_uring_submit( lg_host_t host )
+{
+    lg_uring_t ring = host->ring;
+
+    if ( ring == st_nil || __atomic_load_n( &ring->queued, __ATOMIC_RELAXED ) == 0 )
+        return;
+
+    pthread_mutex_lock( &ring->lock );
+    lg_uring_submit( ring );
+    lg_uring_reap( ring, 0, lg_log_uring_done, st_nil );
+    pthread_mutex_unlock( &ring->lock );
+}
+
+
+/**
+ * Write buffered data.
+ */
+static void lg_log_drain( lg_log_t log )
+{
+    if ( log->olen > 0 ) {
+        if ( log->ring && log->obuf )
+            lg_log_uring_drain( log );
+        else
+            lg_log_sys_write( log, log->obuf, log->olen );
+        log->olen = 0;
+    }
+
+    if ( log->policy == LG_BUF_TIME )
+        log->flushed = lg_time_ns( CLOCK_MONOTONIC );
+}
+
+
+static void lg_log_open( lg_log_t log )
+{
+    if ( log->fd >= 0 )
+        return;
+
+    if ( log->type == LG_LOG_TYPE_STDOUT ) {
+
+        log->fd = STDOUT_FILENO;
+
     } else {
-        return st_nil;
+
+        int flags;
+
+        flags = ( log->type == LG_LOG_TYPE_MMAP || log->type == LG_LOG_TYPE_RING ) ? O_RDWR
+                                                                                   : O_WRONLY;
+        if ( log->type != LG_LOG_TYPE_RING )
+            flags |= O_TRUNC;
+        log->fd = open( log->name, flags | O_CREAT | O_CLOEXEC, 0644 );
+        if ( log->fd < 0 )
+            lg_assert( 0 ); // GCOV_EXCL_LINE
+
+        if ( log->type == LG_LOG_TYPE_MMAP ) {
+            lg_log_map_grow( log, 0 );
+            log->rot_start = lg_time_ns( CLOCK_REALTIME );
+            return;
+        }
+
+        if ( log->type == LG_LOG_TYPE_RING ) {
+            lg_log_ring_open( log );
+            return;
+        }
+
+        if ( log->type == LG_LOG_TYPE_BIN ) {
+            uint32_t version = LG_BIN_VERSION;
+            lg_log_sys_write( log, LG_BIN_MAGIC, 4 );
+            lg_log_sys_write( log, (const char*)&version, sizeof( version ) );
+        }
     }
+
+    if ( log->policy != LG_BUF_NONE )
+        log->obuf = po_malloc( log->osize );
+
+    log->flushed = lg_time_ns( CLOCK_MONOTONIC );
+    log->rot_start = lg_time_ns( CLOCK_REALTIME );
 }
 
 
-static lg_grp_fn_p lg_grp_get_postfix( lg_grp_t grp )
+static char* lg_log_segment( lg_log_t log, uint32_t seq )
 {
-    if ( grp->postfix ) {
-        return grp->postfix;
-    } else if ( grp->top ) {
-        return lg_grp_get_postfix( grp->top );
+    char* path;
+
+    path = po_malloc( strlen( log->name ) + 12 );
+    sprintf( path, "%s.%u", log->name, seq );
+
+    return path;
+}
+
+
+/**
+ * Path of next File prepared by rotation worker.
+ */
+static char* lg_log_next( lg_log_t log )
+{
+    char* path;
+
+    path = po_malloc( strlen( log->name ) + 6 );
+    sprintf( path, "%s.next", log->name );
+
+    return path;
+}
+
+
+/**
+ * Compress segment to "<path>.gz" and remove the original.
+ */
+static void lg_rotor_compress( const char* path )
+{
+    char    buf[ 65536 ];
+    char*   gzpath;
+    gzFile  gz;
+    ssize_t ret;
+    int     fd;
+
+    fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+        return;
+
+    gzpath = po_malloc( strlen( path ) + 4 );
+    sprintf( gzpath, "%s.gz", path );
+
+    gz = gzopen( gzpath, "wb" );
+    if ( gz == NULL ) {
+        po_free( gzpath );
+        close( fd );
+        return;
+    }
+
+    while ( ( ret = read( fd, buf, sizeof( buf ) ) ) != 0 ) {
+        if ( ret < 0 ) {
+            if ( errno == EINTR )
+                continue;
+            break;
+        }
+        if ( gzwrite( gz, buf, ret ) != ret )
+            break;
+    }
+
+    close( fd );
+
+    /* Original is kept if compression failed. */
+    if ( gzclose( gz ) == Z_OK && ret == 0 )
+        unlink( path );
+    else
+        unlink( gzpath );
+
+    po_free( gzpath );
+}
+
+
+/**
+ * Write data to File descriptor of rotated File.
+ */
+static void lg_rotor_write( lg_log_t log, int fd, const char* data, size_t len )
+{
+    ssize_t ret;
+
+    while ( len > 0 ) {
+        ret = write( fd, data, len );
+        lg_stat_add( &log->stat_writes, 1 );
+        if ( ret < 0 ) {
+            if ( errno == EINTR )
+                continue;
+            lg_stat_add( &log->stat_errors, 1 );
+            return;
+        }
+        data += ret;
+        len -= ret;
+    }
+}
+
+
+/**
+ * Continue with rotated File after its rename failed. Data written
+ * to the next File so far is moved to the end of it.
+ */
+static void lg_rotor_restore( lg_rotor_job_t job, const char* next )
+{
+    lg_log_t log = job->log;
+    char     buf[ 65536 ];
+    char*    map;
+    size_t   mlen;
+    size_t   msize;
+    ssize_t  ret;
+    int      fd;
+
+    pthread_mutex_lock( &log->lock );
+
+    lg_stat_add( &log->stat_errors, 1 );
+
+    if ( log->type == LG_LOG_TYPE_MMAP ) {
+
+        map = log->map;
+        mlen = log->mlen;
+        msize = log->msize;
+        close( log->fd );
+        log->fd = job->old_fd;
+        log->map = job->old_map;
+        log->mlen = job->old_mlen;
+        log->msize = job->old_msize;
+        lg_log_map_append( log, map, mlen );
+        munmap( map, msize );
+
     } else {
-        return st_nil;
+
+        if ( log->ring ) {
+            pthread_mutex_lock( &log->ring->lock );
+            lg_log_uring_wait( log );
+            pthread_mutex_unlock( &log->ring->lock );
+        }
+
+        lseek( job->old_fd, 0, SEEK_END );
+        fd = open( next, O_RDONLY | O_CLOEXEC );
+        while ( fd >= 0 && ( ret = read( fd, buf, sizeof( buf ) ) ) != 0 ) {
+            if ( ret < 0 ) {
+                if ( errno == EINTR )
+                    continue;
+                break;
+            }
+            lg_rotor_write( log, job->old_fd, buf, ret );
+        }
+        if ( fd >= 0 )
+            close( fd );
+
+        close( log->fd );
+        log->fd = job->old_fd;
+        log->off = lseek( log->fd, 0, SEEK_END );
+    }
+
+    unlink( next );
+    log->rot_seq--;
+
+    pthread_mutex_unlock( &log->lock );
+}
+
+
+/**
+ * Complete rotation started by logging thread: rename rotated File
+ * to segment and next File to current, and close rotated File.
+ */
+static void lg_rotor_rotate( lg_rotor_job_t job )
+{
+    lg_log_t log = job->log;
+    char*    path;
+    char*    next;
+
+    /* Pending writes precede rename, so that the rotated File is
+     * complete if the rename fails. */
+    if ( job->obuf ) {
+        lg_rotor_write( log, job->old_fd, job->obuf, job->olen );
+        po_free( job->obuf );
+    }
+
+    if ( log->ring ) {
+        pthread_mutex_lock( &log->ring->lock );
+        lg_log_uring_wait( log );
+        pthread_mutex_unlock( &log->ring->lock );
+    }
+
+    path = lg_log_segment( log, job->seq );
+    next = lg_log_next( log );
+
+    if ( rename( log->name, path ) != 0 ) {
+        lg_rotor_restore( job, next );
+        po_free( next );
+        po_free( path );
+        return;
+    }
+
+    if ( rename( next, log->name ) != 0 )
+        lg_stat_add( &log->stat_errors, 1 );
+    po_free( next );
+
+    /* Mapped File is closed at its written length. */
+    if ( job->old_map ) {
+        munmap( job->old_map, job->old_msize );
+        if ( ftruncate( job->old_fd, job->old_mlen ) != 0 )
+            lg_assert( 0 ); // GCOV_EXCL_LINE
+    }
+    close( job->old_fd );
+
+    job->path = path;
+    if ( job->keep && job->seq > job->keep )
+        job->expired = lg_log_segment( log, job->seq - job->keep );
+}
+
+
+/**
+ * Open and publish next File of Log, so that rotation only swaps the
+ * File descriptor. Mapped File gets its first chunk here.
+ */
+static void lg_rotor_spare( lg_log_t log )
+{
+    char* next;
+    char* map;
+    int   fd;
+
+    next = lg_log_next( log );
+    fd = open( next,
+               ( log->type == LG_LOG_TYPE_MMAP ? O_RDWR : O_WRONLY ) | O_CREAT | O_TRUNC | O_CLOEXEC,
+               0644 );
+    po_free( next );
+
+    map = st_nil;
+    if ( fd >= 0 && log->type == LG_LOG_TYPE_MMAP ) {
+        if ( posix_fallocate( fd, 0, LG_MMAP_CHUNK ) != 0 )
+            if ( ftruncate( fd, LG_MMAP_CHUNK ) != 0 )
+                lg_assert( 0 ); // GCOV_EXCL_LINE
+        map = mmap( NULL, LG_MMAP_CHUNK, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        if ( map == MAP_FAILED )
+            lg_assert( 0 ); // GCOV_EXCL_LINE
+    }
+
+    pthread_mutex_lock( &log->lock );
+
+    if ( fd < 0 ) {
+        /* Rotation waits for the next attempt. */
+        lg_stat_add( &log->stat_errors, 1 );
+        fd = -2;
+    }
+
+    log->spare_fd = fd;
+    log->spare_map = map;
+    if ( log->spare_buf == st_nil && log->type != LG_LOG_TYPE_MMAP && log->ring == st_nil
+         && log->policy != LG_BUF_NONE )
+        log->spare_buf = po_malloc( log->osize );
+    pthread_cond_signal( &log->spare_ready );
+
+    pthread_mutex_unlock( &log->lock );
+}
+
+
+static void lg_rotor_run( lg_rotor_job_t job )
+{
+    char* gzpath;
+
+    if ( job->log ) {
+        if ( job->old_fd >= 0 )
+            lg_rotor_rotate( job );
+        lg_rotor_spare( job->log );
+    }
+
+    if ( job->path && job->compress )
+        lg_rotor_compress( job->path );
+
+    if ( job->expired ) {
+        unlink( job->expired );
+        gzpath = po_malloc( strlen( job->expired ) + 4 );
+        sprintf( gzpath, "%s.gz", job->expired );
+        unlink( gzpath );
+        po_free( gzpath );
+        po_free( job->expired );
+    }
+
+    if ( job->path )
+        po_free( job->path );
+    po_free( job );
+}
+
+
+static void lg_cond_wait_ms( pthread_cond_t* cond, pthread_mutex_t* lock, long ms )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_REALTIME, &ts );
+    ts.tv_nsec += ms * 1000000;
+    ts.tv_sec += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+
+    pthread_cond_timedwait( cond, lock, &ts );
+}
+
+
+/**
+ * Lock Log for writing. Return true if lock was taken.
+ */
+static int lg_log_lock( lg_host_t host, lg_log_t log )
+{
+    if ( host->threaded || __atomic_load_n( &log->shared, __ATOMIC_ACQUIRE ) ) {
+        pthread_mutex_lock( &log->lock );
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static void lg_log_unlock( lg_log_t log, int locked )
+{
+    if ( locked )
+        pthread_mutex_unlock( &log->lock );
+}
+
+
+static void lg_grp_dup_expire( lg_host_t host, lg_grp_t grp );
+
+
+/**
+ * Write buffers of timed Logs whose interval has passed, and expired
+ * repeat summaries.
+ */
+static void lg_rotor_tick( lg_rotor_t rotor )
+{
+    lg_log_t log;
+    lg_grp_t grp;
+    uint64_t now;
+
+    pthread_mutex_lock( &rotor->tick_lock );
+
+    now = lg_time_ns( CLOCK_MONOTONIC );
+
+    po_each( rotor->timed, log, lg_log_t )
+    {
+        pthread_mutex_lock( &log->lock );
+        if ( log->policy == LG_BUF_TIME && log->olen > 0
+             && now - log->flushed >= log->interval )
+            lg_log_drain( log );
+        pthread_mutex_unlock( &log->lock );
+    }
+
+    po_each( rotor->dups, grp, lg_grp_t )
+    {
+        lg_grp_dup_expire( rotor->host, grp );
+    }
+
+    pthread_mutex_unlock( &rotor->tick_lock );
+}
+
+
+static void* lg_rotor_worker( void* arg )
+{
+    lg_rotor_t     rotor = (lg_rotor_t)arg;
+    lg_rotor_job_t job;
+    uint64_t       now;
+
+    pthread_mutex_lock( &rotor->lock );
+
+    for ( ;; ) {
+
+        while ( rotor->head == st_nil && !rotor->stop ) {
+            if ( rotor->tick == 0 ) {
+                pthread_cond_wait( &rotor->wake, &rotor->lock );
+                continue;
+            }
+            now = lg_time_ns( CLOCK_MONOTONIC );
+            if ( now >= rotor->due ) {
+                rotor->due = now + rotor->tick;
+                pthread_mutex_unlock( &rotor->lock );
+                lg_rotor_tick( rotor );
+                pthread_mutex_lock( &rotor->lock );
+            } else {
+                lg_cond_wait_ms( &rotor->wake, &rotor->lock,
+                                 ( rotor->due - now + 999999 ) / 1000000 );
+            }
+        }
+
+        job = rotor->head;
+        if ( job == st_nil )
+            break;
+
+        rotor->head = job->next;
+        if ( rotor->head == st_nil )
+            rotor->tail = st_nil;
+        rotor->busy = 1;
+
+        pthread_mutex_unlock( &rotor->lock );
+        lg_rotor_run( job );
+        pthread_mutex_lock( &rotor->lock );
+
+        rotor->busy = 0;
+        if ( rotor->head == st_nil )
+            pthread_cond_broadcast( &rotor->idle );
+    }
+
+    pthread_mutex_unlock( &rotor->lock );
+
+    return NULL;
+}
+
+
+static lg_rotor_t lg_rotor_new( lg_host_t host )
+{
+    lg_rotor_t rotor;
+
+    rotor = po_malloc( sizeof( lg_rotor_s ) );
+    pthread_mutex_init( &rotor->lock, NULL );
+    pthread_cond_init( &rotor->wake, NULL );
+    rotor->stop = 0;
+    rotor->head = st_nil;
+    rotor->tail = st_nil;
+    rotor->busy = 0;
+    pthread_cond_init( &rotor->idle, NULL );
+    pthread_mutex_init( &rotor->tick_lock, NULL );
+    rotor->timed = po_new_descriptor( &rotor->timed_desc );
+    rotor->dups = po_new_descriptor( &rotor->dups_desc );
+    rotor->host = host;
+    rotor->tick = 0;
+    rotor->due = 0;
+    pthread_create( &rotor->thread, NULL, lg_rotor_worker, rotor );
+
+    return rotor;
+}
+
+
+/**
+ * Complete pending jobs and stop worker.
+ */
+static void lg_rotor_del( lg_rotor_t rotor )
+{
+    pthread_mutex_lock( &rotor->lock );
+    rotor->stop = 1;
+    pthread_cond_signal( &rotor->wake );
+    pthread_mutex_unlock( &rotor->lock );
+
+    pthread_join( rotor->thread, NULL );
+
+    po_destroy_storage( rotor->timed );
+    po_destroy_storage( rotor->dups );
+    pthread_mutex_destroy( &rotor->tick_lock );
+    pthread_cond_destroy( &rotor->idle );
+    pthread_cond_destroy( &rotor->wake );
+    pthread_mutex_destroy( &rotor->lock );
+    po_free( rotor );
+}
+
+
+/**
+ * Add item to timed list, with check at half of its interval. Host
+ * lock must not be held, since checks take it.
+ */
+static void lg_rotor_time( lg_rotor_t rotor, po_t list, void* item, uint64_t interval )
+{
+    uint64_t tick;
+
+    tick = interval / 2;
+    if ( tick < 1000000 )
+        tick = 1000000;
+
+    pthread_mutex_lock( &rotor->tick_lock );
+    if ( po_find( list, item ) == PO_NOT_INDEX )
+        po_add( list, item );
+    pthread_mutex_unlock( &rotor->tick_lock );
+
+    pthread_mutex_lock( &rotor->lock );
+    if ( rotor->tick == 0 || tick < rotor->tick ) {
+        rotor->tick = tick;
+        rotor->due = lg_time_ns( CLOCK_MONOTONIC ) + tick;
+    }
+    pthread_cond_signal( &rotor->wake );
+    pthread_mutex_unlock( &rotor->lock );
+}
+
+
+/**
+ * Stop timed flushes before Logs are deleted.
+ */
+static void lg_rotor_untime( lg_rotor_t rotor )
+{
+    pthread_mutex_lock( &rotor->tick_lock );
+    po_reset( rotor->timed );
+    po_reset( rotor->dups );
+    pthread_mutex_unlock( &rotor->tick_lock );
+
+    pthread_mutex_lock( &rotor->lock );
+    rotor->tick = 0;
+    pthread_mutex_unlock( &rotor->lock );
+}
+
+
+/**
+ * Wait until queued jobs are completed.
+ */
+static void lg_rotor_sync( lg_rotor_t rotor )
+{
+    pthread_mutex_lock( &rotor->lock );
+    while ( rotor->head || rotor->busy )
+        pthread_cond_wait( &rotor->idle, &rotor->lock );
+    pthread_mutex_unlock( &rotor->lock );
+}
+
+
+static lg_rotor_job_t lg_rotor_job_new( lg_log_t log )
+{
+    lg_rotor_job_t job;
+
+    job = po_malloc( sizeof( lg_rotor_job_s ) );
+    job->path = st_nil;
+    job->compress = 0;
+    job->expired = st_nil;
+    job->log = log;
+    job->seq = 0;
+    job->keep = 0;
+    job->old_fd = -1;
+    job->old_map = st_nil;
+    job->old_mlen = 0;
+    job->old_msize = 0;
+    job->obuf = st_nil;
+    job->olen = 0;
+
+    return job;
+}
+
+
+static void lg_rotor_put( lg_rotor_t rotor, lg_rotor_job_t job )
+{
+    job->next = st_nil;
+
+    pthread_mutex_lock( &rotor->lock );
+    if ( rotor->tail )
+        rotor->tail->next = job;
+    else
+        rotor->head = job;
+    rotor->tail = job;
+    pthread_cond_signal( &rotor->wake );
+    pthread_mutex_unlock( &rotor->lock );
+}
+
+
+/**
+ * Find last existing segment number of File, so that numbering
+ * continues after restart.
+ */
+static uint32_t lg_log_segment_last( lg_log_t log )
+{
+    DIR*           dir;
+    struct dirent* ent;
+    const char*    base;
+    char*          path;
+    char*          end;
+    size_t         len;
+    unsigned long  seq;
+    uint32_t       last;
+
+    base = strrchr( log->name, '/' );
+    if ( base ) {
+        path = strndup( log->name, base - log->name + 1 );
+        base++;
+    } else {
+        path = strdup( "." );
+        base = log->name;
+    }
+
+    last = 0;
+    len = strlen( base );
+    dir = opendir( path );
+
+    while ( dir && ( ent = readdir( dir ) ) ) {
+        if ( strncmp( ent->d_name, base, len ) || ent->d_name[ len ] != '.'
+             || ent->d_name[ len + 1 ] < '0' || ent->d_name[ len + 1 ] > '9' )
+            continue;
+        seq = strtoul( ent->d_name + len + 1, &end, 10 );
+        if ( ( *end == 0 || !strcmp( end, ".gz" ) ) && seq > last && seq <= UINT32_MAX )
+            last = seq;
     }
+
+    if ( dir )
+        closedir( dir );
+    po_free( path );
+
+    return last;
+}
+
+
+/**
+ * Switch to next File prepared by rotation worker. Renames, closing
+ * of the rotated File and segment handling are left to the worker.
+ */
+static void lg_log_rotate_now( lg_log_t log )
+{
+    lg_rotor_job_t job;
+
+    /* Rotation is fast enough, unless worker is behind. */
+    while ( log->spare_fd == -1 )
+        pthread_cond_wait( &log->spare_ready, &log->lock );
+
+    /* Next File could not be opened, retry at next limit. */
+    if ( log->spare_fd < 0 ) {
+        log->spare_fd = -1;
+        log->size = 0;
+        log->rot_start = lg_time_ns( CLOCK_REALTIME );
+        lg_rotor_put( log->rotor, lg_rotor_job_new( log ) );
+        return;
+    }
+
+    job = lg_rotor_job_new( log );
+    job->seq = ++log->rot_seq;
+    job->keep = log->rot_keep;
+    job->compress = log->rot_compress;
+    job->old_fd = log->fd;
+
+    if ( log->type == LG_LOG_TYPE_MMAP ) {
+        job->old_map = log->map;
+        job->old_mlen = log->mlen;
+        job->old_msize = log->msize;
+        log->map = log->spare_map;
+        log->mlen = 0;
+        log->msize = LG_MMAP_CHUNK;
+        log->spare_map = st_nil;
+    } else if ( log->ring ) {
+        lg_log_drain( log );
+    } else if ( log->olen > 0 ) {
+        job->obuf = log->obuf;
+        job->olen = log->olen;
+        log->obuf = log->spare_buf ? log->spare_buf : po_malloc( log->osize );
+        log->spare_buf = st_nil;
+        log->olen = 0;
+    }
+
+    log->fd = log->spare_fd;
+    log->spare_fd = -1;
+    log->off = 0;
+    log->size = 0;
+    log->rot_start = lg_time_ns( CLOCK_REALTIME );
+
+    lg_rotor_put( log->rotor, job );
+}
+
+
+/**
+ * Rotate File if "len" more bytes exceed the size limit, or if
+ * interval has passed.
+ */
+static void lg_log_rotate_check( lg_log_t log, size_t len )
+{
+    if ( log->rot_size && log->size > 0 && log->size + len > log->rot_size )
+        lg_log_rotate_now( log );
+    else if ( log->rot_interval
+              && lg_time_ns( CLOCK_REALTIME ) - log->rot_start >= log->rot_interval )
+        lg_log_rotate_now( log );
+
+    log->size += len;
+}
+
+
+/**
+ * Flush buffer if policy requires, after "data" was appended.
+ */
+static void lg_log_check( lg_log_t log, const char* data, size_t len )
+{
+    if ( log->policy == LG_BUF_LINE ) {
+        if ( memchr( data, '\n', len ) )
+            lg_log_drain( log );
+    } else if ( log->policy == LG_BUF_TIME ) {
+        if ( lg_time_ns( CLOCK_MONOTONIC ) - log->flushed >= log->interval )
+            lg_log_drain( log );
+    }
+}
+
+
+static void lg_log_append( lg_log_t log, const char* data, size_t len )
+{
+    lg_log_open( log );
+
+    if ( log->type == LG_LOG_TYPE_MMAP ) {
+        if ( log->rotor )
+            lg_log_rotate_check( log, len );
+        lg_log_map_append( log, data, len );
+        return;
+    }
+
+    if ( log->type == LG_LOG_TYPE_RING ) {
+        lg_log_ring_append( log, data, len );
+        return;
+    }
+
+    if ( log->rotor )
+        lg_log_rotate_check( log, len );
+
+    if ( log->policy == LG_BUF_NONE || len > log->osize ) {
+        lg_log_drain( log );
+        lg_log_sys_write( log, data, len );
+        return;
+    }
+
+    if ( log->olen + len > log->osize )
+        lg_log_drain( log );
+
+    memcpy( log->obuf + log->olen, data, len );
+    log->olen += len;
+
+    lg_log_check( log, data, len );
+}
+
+
+/**
+ * Append vector of data. Vector has a free slot at index 0 for
+ * buffered data, and data starts from index 1.
+ */
+static void lg_log_appendv( lg_log_t log, struct iovec* iov, int cnt )
+{
+    size_t total;
+    int    i;
+
+    lg_log_open( log );
+
+    if ( log->type == LG_LOG_TYPE_MMAP ) {
+        for ( i = 1; i <= cnt; i++ ) {
+            if ( log->rotor )
+                lg_log_rotate_check( log, iov[ i ].iov_len );
+            lg_log_map_append( log, iov[ i ].iov_base, iov[ i ].iov_len );
+        }
+        return;
+    }
+
+    if ( log->type == LG_LOG_TYPE_RING ) {
+        for ( i = 1; i <= cnt; i++ )
+            lg_log_ring_append( log, iov[ i ].iov_base, iov[ i ].iov_len );
+        return;
+    }
+
+    total = 0;
+    for ( i = 1; i <= cnt; i++ )
+        total += iov[ i ].iov_len;
+
+    if ( log->rotor )
+        lg_log_rotate_check( log, total );
+
+    if ( log->policy != LG_BUF_NONE && log->olen + total <= log->osize ) {
+
+        for ( i = 1; i <= cnt; i++ ) {
+            memcpy( log->obuf + log->olen, iov[ i ].iov_base, iov[ i ].iov_len );
+            log->olen += iov[ i ].iov_len;
+        }
+
+        lg_log_check( log, log->obuf, log->olen );
+
+    } else {
+
+        /* Buffered data and the new data with one call. */
+        iov[ 0 ].iov_base = log->obuf;
+        iov[ 0 ].iov_len = log->olen;
+        if ( log->olen > 0 )
+            lg_log_sys_writev( log, iov, cnt + 1 );
+        else
+            lg_log_sys_writev( log, iov + 1, cnt );
+        log->olen = 0;
+        if ( log->policy == LG_BUF_TIME )
+            log->flushed = lg_time_ns( CLOCK_MONOTONIC );
+    }
+}
+
+
+static void lg_log_del( lg_log_t log )
+{
+    uint32_t i;
+    char*    next;
+
+    if ( log->fd >= 0 ) {
+        if ( log->type == LG_LOG_TYPE_MMAP )
+            lg_log_map_close( log );
+        else if ( log->type == LG_LOG_TYPE_RING )
+            munmap( log->map, LG_RING_HEAD + log->msize );
+        else
+            lg_log_drain( log );
+        if ( log->ring ) {
+            pthread_mutex_lock( &log->ring->lock );
+            lg_log_uring_wait( log );
+            pthread_mutex_unlock( &log->ring->lock );
+        }
+        if ( log->type != LG_LOG_TYPE_STDOUT )
+            close( log->fd );
+    }
+
+    if ( log->obuf )
+        po_free( log->obuf );
+
+    /* Unused next File is removed. */
+    if ( log->spare_fd >= 0 ) {
+        if ( log->spare_map )
+            munmap( log->spare_map, LG_MMAP_CHUNK );
+        close( log->spare_fd );
+        next = lg_log_next( log );
+        unlink( next );
+        po_free( next );
+    }
+    if ( log->spare_buf )
+        po_free( log->spare_buf );
+    pthread_cond_destroy( &log->spare_ready );
+
+    lg_log_uring_free( log );
+
+    if ( log->strs ) {
+        mp_each_key( log->strs, lg_log_bin_key_del_fn, st_nil );
+        mp_destroy( log->strs );
+    }
+
+    if ( log->grps ) {
+        mp_each_key( log->grps, lg_log_bin_key_del_fn, st_nil );
+        mp_destroy( log->grps );
+    }
+
+    lg_fmt_buf_free( &log->rec );
+
+    if ( log->shards ) {
+        for ( i = 0; i < log->shard_cnt; i++ )
+            lg_log_del( log->shards[ i ] );
+        po_free( log->shards );
+    }
+
+    pthread_mutex_destroy( &log->lock );
+
+    if ( log->iov )
+        po_free( log->iov );
+
+    if ( log->hist )
+        po_free( log->hist );
+
+    if ( log->name )
+        po_free( log->name );
+
+    po_free( log );
+}
+
+
+/**
+ * Create "cnt" shard Files for Log (0 for default count). Previous
+ * shards are removed, and shard Files of earlier runs are deleted,
+ * also those beyond "cnt". Shards get a new run id.
+ */
+static void lg_log_shard_init( lg_log_t log, uint32_t cnt )
+{
+    char*    name;
+    uint32_t i;
+    long     cpus;
+
+    if ( cnt == 0 ) {
+        cpus = sysconf( _SC_NPROCESSORS_ONLN );
+        cnt = ( cpus > 0 ) ? cpus : 1;
+    }
+
+    if ( cnt > LG_SHARD_MAX )
+        cnt = LG_SHARD_MAX;
+
+    if ( log->shards ) {
+        for ( i = 0; i < log->shard_cnt; i++ )
+            lg_log_del( log->shards[ i ] );
+        po_free( log->shards );
+    }
+
+    log->shard_cnt = cnt;
+    log->shards = po_malloc( cnt * sizeof( lg_log_t ) );
+    log->shard_run = lg_time_ns( CLOCK_REALTIME ) ^ ( (uint64_t)getpid() << 40 );
+
+    name = po_malloc( strlen( log->name ) + 16 );
+    for ( i = 0; i < LG_SHARD_MAX; i++ ) {
+        sprintf( name, "%s.shard%u", log->name, i );
+        unlink( name );
+    }
+
+    for ( i = 0; i < cnt; i++ ) {
+        sprintf( name, "%s.shard%u", log->name, i );
+        log->shards[ i ] = lg_log_new( LG_LOG_TYPE_FILE, name );
+        log->shards[ i ]->hist = po_malloc( sizeof( uint64_t ) * LG_HIST_SIZE );
+        memset( log->shards[ i ]->hist, 0, sizeof( uint64_t ) * LG_HIST_SIZE );
+    }
+    po_free( name );
+}
+
+
+/**
+ * Return terminal Log for file, and create it if needed.
+ */
+static lg_log_t lg_host_file( lg_host_t host, const char* name, lg_log_type_t type )
+{
+    lg_log_t file;
+
+    if ( !strcmp( name, "<stdout>" ) ) {
+
+        file = lg_host_check_log( host, name );
+        if ( file == st_nil ) {
+            file = lg_log_new( LG_LOG_TYPE_STDOUT, name );
+            lg_host_add_log( host, file );
+        }
+
+    } else {
+
+        realpath( name, host->buf );
+        sl_refresh( host->buf );
+
+        file = lg_host_check_log( host, host->buf );
+        if ( file == st_nil ) {
+            file = lg_log_new( type, host->buf );
+            if ( type == LG_LOG_TYPE_FILE || type == LG_LOG_TYPE_BIN )
+                file->ring = host->ring;
+            if ( type == LG_LOG_TYPE_SHARD )
+                lg_log_shard_init( file, 0 );
+            lg_host_add_log( host, file );
+        } else if ( file->type != type ) {
+            lg_assert( 0 ); // GCOV_EXCL_LINE
+        }
+    }
+
+    return file;
+}
+
+
+static lg_log_t lg_log_new_file( lg_host_t host, const char* name, lg_log_type_t type )
+{
+    lg_log_t log;
+    lg_log_t file;
+
+    file = lg_host_file( host, name, type );
+    log = lg_log_new( LG_LOG_TYPE_LOGREF, file->name );
+    log->log = file;
+
+    return log;
+}
+
+
+/**
+ * Count message to Log statistics. Log lock must be held.
+ */
+static void lg_log_count( lg_host_t host, lg_log_t log, size_t len )
+{
+    if ( !host->stats )
+        return;
+
+    lg_stat_add_locked( &log->stat_msgs, 1 );
+    lg_stat_add_locked( &log->stat_bytes, len );
+}
+
+
+/**
+ * Write message record to shard of calling thread. Sequence is global
+ * for the Log, and it is taken under shard lock, hence records are in
+ * order within shard. Sequence is the only counter shared by shards.
+ *
+ * @return Shard written.
+ */
+static lg_log_t lg_log_shard_write( lg_host_t host, lg_log_t log, const char* msg, size_t len )
+{
+    lg_log_t shard;
+    uint32_t idx;
+    uint32_t num;
+    uint64_t seq;
+    uint64_t ns;
+    char     head[ LG_SHARD_HEAD ]; /* Also record header. */
+
+    idx = lg_thread_index() % log->shard_cnt;
+    shard = log->shards[ idx ];
+
+    if ( host->threaded )
+        pthread_mutex_lock( &shard->lock );
+
+    if ( shard->fd < 0 ) {
+        memcpy( head, LG_SHARD_MAGIC, 4 );
+        num = LG_SHARD_VERSION;
+        memcpy( head + 4, &num, 4 );
+        memcpy( head + 8, &idx, 4 );
+        memcpy( head + 12, &log->shard_cnt, 4 );
+        memcpy( head + 16, &log->shard_run, 8 );
+        lg_log_append( shard, head, LG_SHARD_HEAD );
+    }
+
+    seq = __atomic_fetch_add( &log->seq, 1, __ATOMIC_RELAXED );
+    ns = lg_time_ns( CLOCK_REALTIME );
+    num = len;
+    memcpy( head, &seq, 8 );
+    memcpy( head + 8, &ns, 8 );
+    memcpy( head + 16, &num, 4 );
+    lg_log_append( shard, head, LG_SHARD_REC_HEAD );
+    lg_log_append( shard, msg, len );
+    lg_log_count( host, shard, len );
+
+    if ( host->threaded )
+        pthread_mutex_unlock( &shard->lock );
+
+    return shard;
+}
+
+
+static void lg_log_write( lg_host_t host, lg_log_t log, const char* msg, size_t len )
+{
+    uint64_t start = 0;
+    int      locked;
+
+    if ( host->stats )
+        start = lg_time_ns( CLOCK_MONOTONIC );
+
+    if ( log->type == LG_LOG_TYPE_SHARD ) {
+
+        log = lg_log_shard_write( host, log, msg, len );
+
+    } else if ( log->type == LG_LOG_TYPE_FILE || log->type == LG_LOG_TYPE_STDOUT
+                || log->type == LG_LOG_TYPE_MMAP || log->type == LG_LOG_TYPE_RING ) {
+
+        locked = lg_log_lock( host, log );
+        lg_log_append( log, msg, len );
+        lg_log_count( host, log, len );
+        lg_log_unlock( log, locked );
+
+    } else {
+        lg_assert( 0 ); // GCOV_EXCL_LINE
+    }
+
+    if ( start )
+        lg_hist_add( log->hist, lg_time_ns( CLOCK_MONOTONIC ) - start );
+}
+
+
+static void lg_log_flush( lg_host_t host, lg_log_t log )
+{
+    uint32_t i;
+    int      locked;
+
+    for ( i = 0; i < log->shard_cnt; i++ )
+        lg_log_flush( host, log->shards[ i ] );
+
+    locked = lg_log_lock( host, log );
+
+    if ( log->fd >= 0 )
+        lg_log_drain( log );
+
+    if ( log->ring ) {
+        pthread_mutex_lock( &log->ring->lock );
+        lg_log_uring_wait( log );
+        pthread_mutex_unlock( &log->ring->lock );
+    }
+
+    lg_log_unlock( log, locked );
+}
+
+
+static void lg_log_bin_head( lg_log_t log, uint8_t type, size_t len )
+{
+    uint32_t size = len;
+
+    lg_fmt_buf_append( &log->rec, &type, 1 );
+    lg_fmt_buf_append( &log->rec, &size, sizeof( size ) );
+}
+
+
+static uint32_t lg_log_bin_id( lg_log_t log, mp_t ids, uint32_t* cnt, uint8_t type, const char* str )
+{
+    po_d     id;
+    uint32_t num;
+    size_t   len;
+
+    id = mp_get_key( ids, (const po_d)str );
+    if ( id )
+        return (uint32_t)( (uintptr_t)id - 1 );
+
+    num = ( *cnt )++;
+    mp_put_key( ids, strdup( str ), (po_d)(uintptr_t)( num + 1 ) );
+
+    len = strlen( str );
+    lg_log_bin_head( log, type, sizeof( num ) + len );
+    lg_fmt_buf_append( &log->rec, &num, sizeof( num ) );
+    lg_fmt_buf_append( &log->rec, str, len );
+
+    return num;
+}
+
+
+/**
+ * Get format id, cached by format address.
+ *
+ * Formats are expected to be constant strings, so the address
+ * identifies the format and the text is hashed only on cache miss.
+ */
+static uint32_t lg_log_bin_fmt( lg_log_t log, const char* format )
+{
+    size_t slot;
+
+    slot = ( (uintptr_t)format >> 3 ) & ( LG_BIN_CACHE - 1 );
+    if ( log->fmt_ptr[ slot ] != format ) {
+        log->fmt_id[ slot ] = lg_log_bin_id( log, log->strs, &log->str_cnt, LG_BIN_REC_STR, format );
+        log->fmt_ptr[ slot ] = format;
+    }
+
+    return log->fmt_id[ slot ];
+}
+
+
+/**
+ * Write binary message record.
+ *
+ * "msg" contains the rendered text message, where prefix ends at
+ * "pre" and postfix starts at "post". Postfix ends before the newline
+ * (if any).
+ */
+static void lg_log_write_bin( lg_host_t    host,
+                              lg_log_t     log,
+                              lg_grp_t     grp,
+                              const char*  format,
+                              int          newline,
+                              const sl_t   msg,
+                              size_t       pre,
+                              size_t       post,
+                              lg_fmt_buf_t args )
+{
+    uint32_t grp_id;
+    uint32_t fmt_id;
+    uint64_t stamp;
+    uint32_t len;
+    uint8_t  nl;
+    size_t   rec_len;
+    uint64_t start = 0;
+    int      locked;
+
+    if ( host->stats )
+        start = lg_time_ns( CLOCK_MONOTONIC );
+
+    locked = lg_log_lock( host, log );
+
+    log->rec.len = 0;
+
+    grp_id = lg_log_bin_id( log, log->grps, &log->grp_cnt, LG_BIN_REC_GRP, grp->name );
+    fmt_id = lg_log_bin_fmt( log, format );
+
+    stamp = lg_time_ns( CLOCK_REALTIME );
+    nl = newline;
+
+    rec_len = sizeof( grp_id ) + sizeof( log->seq ) + sizeof( stamp ) + sizeof( fmt_id ) + 1
+              + sizeof( len ) + pre + sizeof( len ) + ( sl_length( msg ) - newline - post )
+              + args->len;
+
+    lg_log_bin_head( log, LG_BIN_REC_MSG, rec_len );
+    lg_fmt_buf_append( &log->rec, &grp_id, sizeof( grp_id ) );
+    lg_fmt_buf_append( &log->rec, &log->seq, sizeof( log->seq ) );
+    lg_fmt_buf_append( &log->rec, &stamp, sizeof( stamp ) );
+    lg_fmt_buf_append( &log->rec, &fmt_id, sizeof( fmt_id ) );
+    lg_fmt_buf_append( &log->rec, &nl, 1 );
+    len = pre;
+    lg_fmt_buf_append( &log->rec, &len, sizeof( len ) );
+    lg_fmt_buf_append( &log->rec, msg, pre );
+    len = sl_length( msg ) - newline - post;
+    lg_fmt_buf_append( &log->rec, &len, sizeof( len ) );
+    lg_fmt_buf_append( &log->rec, msg + post, len );
+    lg_fmt_buf_append( &log->rec, args->data, args->len );
+
+    log->seq++;
+
+    lg_log_append( log, log->rec.data, log->rec.len );
+    lg_log_count( host, log, log->rec.len );
+
+    lg_log_unlock( log, locked );
+
+    if ( start )
+        lg_hist_add( log->hist, lg_time_ns( CLOCK_MONOTONIC ) - start );
+}
+
+
+static void lg_host_touch( lg_host_t host )
+{
+    __atomic_add_fetch( &host->gen, 1, __ATOMIC_RELEASE );
+}
+
+
+static void lg_plan_collect_grp( lg_grp_t grp, po_t sinks, po_t visited, size_t* cnt );
+
+
+static void lg_plan_collect_log( lg_log_t log, po_t sinks, po_t visited, size_t* cnt )
+{
+    if ( log->type == LG_LOG_TYPE_FILE || log->type == LG_LOG_TYPE_STDOUT
+         || log->type == LG_LOG_TYPE_BIN || log->type == LG_LOG_TYPE_MMAP
+         || log->type == LG_LOG_TYPE_RING || log->type == LG_LOG_TYPE_SHARD ) {
+
+        if ( po_find( sinks, log ) == PO_NOT_INDEX ) {
+            po_add( sinks, log );
+            ( *cnt )++;
+        }
+
+    } else if ( log->type == LG_LOG_TYPE_LOGREF ) {
+
+        lg_plan_collect_log( log->log, sinks, visited, cnt );
+
+    } else if ( log->type == LG_LOG_TYPE_GRPREF ) {
+
+        lg_plan_collect_grp( log->grp, sinks, visited, cnt );
+
+    } else {
+        lg_assert( 0 ); // GCOV_EXCL_LINE
+    }
+}
+
+
+static void lg_plan_collect_grp( lg_grp_t grp, po_t sinks, po_t visited, size_t* cnt )
+{
+    lg_log_t log;
+
+    /* Each Group is expanded only once, which also breaks cycles. */
+    if ( po_find( visited, grp ) != PO_NOT_INDEX )
+        return;
+    po_add( visited, grp );
+
+    if ( grp->logs ) {
+        po_each( grp->logs, log, lg_log_t )
+        {
+            lg_plan_collect_log( log, sinks, visited, cnt );
+        }
+    }
+}
+
+
+static lg_grp_t lg_grp_get_prefix( lg_grp_t grp )
+{
+    if ( grp->prefix || grp->prefix_str || grp->prefix_pat ) {
+        return grp;
+    } else if ( grp->top ) {
+        return lg_grp_get_prefix( grp->top );
+    } else {
+        return st_nil;
+    }
+}
+
+
+static lg_grp_t lg_grp_get_postfix( lg_grp_t grp )
+{
+    if ( grp->postfix || grp->postfix_str || grp->postfix_pat ) {
+        return grp;
+    } else if ( grp->top ) {
+        return lg_grp_get_postfix( grp->top );
+    } else {
+        return st_nil;
+    }
+}
+
+
+static lg_plan_t lg_plan_new( lg_host_t host, lg_grp_t grp )
+{
+    lg_plan_t plan;
+    po_s      sinks_desc;
+    po_t      sinks;
+    po_s      visited_desc;
+    po_t      visited;
+    size_t    cnt;
+    lg_log_t  log;
+    lg_grp_t  pre;
+    lg_grp_t  post;
+    size_t    logs_size;
+    size_t    pre_size;
+    size_t    post_size;
+    uint8_t*  prog;
+
+    sinks = po_new_descriptor( &sinks_desc );
+    visited = po_new_descriptor( &visited_desc );
+    cnt = 0;
+
+    lg_plan_collect_grp( grp, sinks, visited, &cnt );
+
+    pre = lg_grp_get_prefix( grp );
+    post = lg_grp_get_postfix( grp );
+
+    /* Pattern programs are stored after Logs, compiled for "grp". */
+    logs_size = sizeof( lg_plan_s ) + cnt * sizeof( lg_log_t );
+    pre_size = ( pre && pre->prefix_pat ) ? lg_pat_compile( pre->prefix_pat, grp->name, st_nil ) : 0;
+    post_size =
+        ( post && post->postfix_pat ) ? lg_pat_compile( post->postfix_pat, grp->name, st_nil ) : 0;
+
+    plan = po_malloc( logs_size + pre_size + post_size );
+    plan->gen = host->gen;
+    prog = (uint8_t*)plan + logs_size;
+
+    plan->prefix = pre ? pre->prefix : st_nil;
+    plan->prefix_str = pre ? pre->prefix_str : st_nil;
+    plan->prefix_pat = st_nil;
+    if ( pre_size ) {
+        lg_pat_compile( pre->prefix_pat, grp->name, prog );
+        plan->prefix_pat = prog;
+    }
+
+    plan->postfix = post ? post->postfix : st_nil;
+    plan->postfix_str = post ? post->postfix_str : st_nil;
+    plan->postfix_pat = st_nil;
+    if ( post_size ) {
+        lg_pat_compile( post->postfix_pat, grp->name, prog + pre_size );
+        plan->postfix_pat = prog + pre_size;
+    }
+
+    /* Sequence number is taken once per message. */
+    plan->seq = ( lg_pat_has_seq( plan->prefix_pat ) || lg_pat_has_seq( plan->postfix_pat ) );
+
+    /* Text Logs first, then binary Logs. */
+    plan->cnt = 0;
+    po_each( sinks, log, lg_log_t )
+    {
+        if ( log->type != LG_LOG_TYPE_BIN )
+            plan->logs[ plan->cnt++ ] = log;
+    }
+
+    plan->bin_cnt = 0;
+    po_each( sinks, log, lg_log_t )
+    {
+        if ( log->type == LG_LOG_TYPE_BIN )
+            plan->logs[ plan->cnt + plan->bin_cnt++ ] = log;
+    }
+
+    po_destroy_storage( sinks );
+    po_destroy_storage( visited );
+
+    return plan;
+}
+
+
+static int lg_plan_is_stale( lg_host_t host, lg_plan_t plan )
+{
+    return ( plan == st_nil || plan->gen != __atomic_load_n( &host->gen, __ATOMIC_ACQUIRE ) );
+}
+
+
+static lg_plan_t lg_grp_plan( lg_host_t host, lg_grp_t grp )
+{
+    lg_plan_t plan;
+    lg_plan_t old;
+
+    plan = __atomic_load_n( &grp->plan, __ATOMIC_ACQUIRE );
+
+    if ( lg_plan_is_stale( host, plan ) ) {
+
+        /* Plans are immutable. Stale plan is replaced under Host lock
+         * and retired after unpublishing, since other threads might
+         * still use it. Retiring may advance the epoch, hence readers
+         * entering after it must not find the old plan. */
+        lg_host_lock( host );
+        old = grp->plan;
+        plan = old;
+        if ( lg_plan_is_stale( host, plan ) ) {
+            plan = lg_plan_new( host, grp );
+            __atomic_store_n( &grp->plan, plan, __ATOMIC_RELEASE );
+            if ( old )
+                lg_host_retire( host, old );
+        }
+        lg_host_unlock( host );
+    }
+
+    return plan;
+}
+
+
+/**
+ * Update effective state of Group.
+ */
+static void lg_grp_update( lg_host_t host, lg_grp_t grp )
+{
+    __atomic_store_n( &grp->on,
+                      !__atomic_load_n( &host->disabled, __ATOMIC_RELAXED )
+                          && __atomic_load_n( &grp->active, __ATOMIC_RELAXED ),
+                      __ATOMIC_RELAXED );
+}
+
+
+static void lg_grp_set_active( lg_host_t host, lg_grp_t grp, st_bool_t active )
+{
+    if ( grp->type == LG_GRP_TYPE_TOP ) {
+        if ( grp->subs ) {
+            lg_grp_t sub;
+            po_each( grp->subs, sub, lg_grp_t )
+            {
+                lg_grp_set_active( host, sub, active );
+            }
+        }
+    }
+
+    __atomic_store_n( &grp->active, active, __ATOMIC_RELAXED );
+    lg_grp_update( host, grp );
+}
+
+
+static void lg_grp_enable( lg_host_t host, lg_grp_t grp )
+{
+    lg_grp_set_active( host, grp, st_true );
+}
+
+
+static void lg_grp_disable( lg_host_t host, lg_grp_t grp )
+{
+    lg_grp_set_active( host, grp, st_false );
+}
+
+
+static void lg_grp_apply_rule_list( lg_grp_t grp, po_t rules )
+{
+    lg_rule_t rule;
+
+    po_each( rules, rule, lg_rule_t )
+    {
+        if ( rule->glob ? lg_trie_name_match( rule->pattern, grp->name )
+                        : !strcmp( rule->pattern, grp->name ) )
+            __atomic_store_n( &grp->active, rule->value, __ATOMIC_RELAXED );
+    }
+}
+
+
+/**
+ * Apply Host rules to new Group.
+ */
+static void lg_grp_apply_rules( lg_host_t host, lg_grp_t grp )
+{
+    lg_grp_apply_rule_list( grp, host->rules );
+    lg_grp_apply_rule_list( grp, host->file_rules );
+    lg_grp_update( host, grp );
+}
+
+
+static lg_grp_t lg_grp_new( lg_host_t host, lg_grp_type_t type, const char* name )
+{
+    lg_grp_t grp;
+
+    grp = po_malloc( sizeof( lg_grp_s ) );
+    grp->type = type;
+    grp->name = strdup( name );
+    grp->prefix = st_nil;
+    grp->postfix = st_nil;
+    grp->prefix_str = st_nil;
+    grp->postfix_str = st_nil;
+    grp->prefix_pat = st_nil;
+    grp->postfix_pat = st_nil;
+    grp->seq = 0;
+    grp->logs = po_new_descriptor( &grp->logs_desc );
+    grp->active = host->conf_active;
+    grp->top = st_nil;
+    grp->subs = po_new_descriptor( &grp->subs_desc );
+    grp->plan = st_nil;
+    grp->deferred = st_false;
+    grp->throttled = st_false;
+    grp->limit_ns = 0;
+    grp->limit_tau = 0;
+    grp->limit_tat = 0;
+    grp->sample = 0;
+    grp->sample_cnt = 0;
+    grp->suppressed = 0;
+    grp->rejected = 0;
+    grp->coalesce = st_false;
+    grp->dup = st_nil;
+    grp->stat_msgs = 0;
+    grp->stat_inactive = 0;
+
+    lg_host_add_grp( host, grp );
+    lg_grp_apply_rules( host, grp );
+
+    return grp;
+}
+
+
+static void lg_grp_add_file( lg_host_t     host,
+                             lg_grp_t      grp,
+                             const char*   filename,
+                             lg_log_type_t type )
+{
+    po_add( grp->logs, lg_log_new_file( host, filename, type ) );
+    lg_host_touch( host );
+}
+
+
+static void lg_grp_del_logs( lg_host_t host, lg_grp_t grp )
+{
+    lg_log_t log;
+
+    lg_host_touch( host );
+
+    if ( grp->logs ) {
+        po_each( grp->logs, log, lg_log_t )
+        {
+            lg_log_del( log );
+        }
+        po_reset( grp->logs );
+    }
+}
+
+
+static lg_dup_t lg_dup_new( uint64_t timeout )
+{
+    lg_dup_t dup;
+
+    dup = po_malloc( sizeof( lg_dup_s ) );
+    pthread_mutex_init( &dup->lock, NULL );
+    dup->timeout = timeout;
+    dup->hash = 0;
+    dup->last = sl_new( 128 );
+    dup->cnt = 0;
+    dup->start = 0;
+    dup->buf = sl_new( 128 );
+
+    return dup;
+}
+
+
+static void lg_dup_del( lg_dup_t dup )
+{
+    pthread_mutex_destroy( &dup->lock );
+    sl_del( &dup->last );
+    sl_del( &dup->buf );
+    po_free( dup );
+}
+
+
+static void lg_grp_del( lg_host_t host, lg_grp_t grp )
+{
+    po_free( grp->name );
+    if ( grp->prefix_str )
+        po_free( grp->prefix_str );
+    if ( grp->postfix_str )
+        po_free( grp->postfix_str );
+    if ( grp->prefix_pat )
+        po_free( grp->prefix_pat );
+    if ( grp->postfix_pat )
+        po_free( grp->postfix_pat );
+    lg_grp_del_logs( host, grp );
+    if ( grp->plan )
+        po_free( grp->plan );
+    if ( grp->dup )
+        lg_dup_del( grp->dup );
+    po_destroy_storage( grp->logs );
+    po_destroy_storage( grp->subs );
+}
+
+
+
+/**
+ * Apply "fn" to all Groups matching glob pattern.
+ */
+static void lg_host_set_grps( lg_host_t host, const char* pattern, void ( *fn )( lg_host_t host, lg_grp_t grp ) )
+{
+    po_s     desc;
+    po_t     grps;
+    lg_grp_t grp;
+
+    grps = po_new_descriptor( &desc );
+    lg_trie_glob( host->names, pattern, grps );
+    po_each( grps, grp, lg_grp_t )
+    {
+        fn( host, grp );
+    }
+    po_destroy_storage( grps );
+}
+
+
+/**
+ * Call "fn" for collected Groups, and release collection.
+ */
+static void lg_host_each_grp( lg_host_t host, po_t grps, lg_grp_each_fn_p fn, void* arg )
+{
+    lg_grp_t grp;
+
+    po_each( grps, grp, lg_grp_t )
+    {
+        fn( host, grp, arg );
+    }
+    po_destroy_storage( grps );
+}
+
+
+static int lg_async_pending( lg_async_t async )
+{
+    return lg_queue_claimed( async->queue )
+           != __atomic_load_n( &async->consumed, __ATOMIC_ACQUIRE );
+}
+
+
+static void lg_async_wake( lg_async_t async )
+{
+    if ( __atomic_load_n( &async->sleeping, __ATOMIC_SEQ_CST ) ) {
+        pthread_mutex_lock( &async->lock );
+        pthread_cond_signal( &async->wake );
+        pthread_mutex_unlock( &async->lock );
+    }
+}
+
+
+static uint64_t lg_grp_write_prefix( lg_host_t   host,
+                                     lg_grp_t    grp,
+                                     lg_plan_t   plan,
+                                     const char* format,
+                                     sl_p        buf );
+static void     lg_grp_write_postfix( lg_host_t   host,
+                                      lg_grp_t    grp,
+                                      lg_plan_t   plan,
+                                      uint64_t    seq,
+                                      int         newline,
+                                      const char* format,
+                                      sl_p        buf );
+
+
+static void lg_async_render( lg_async_t async, lg_plan_t plan, lg_queue_slot_t slot, sl_p buf )
+{
+    lg_defer_s  defer;
+    const char* data;
+    uint64_t    seq;
+
+    data = lg_queue_data( slot );
+    memcpy( &defer, data, sizeof( defer ) );
+
+    seq = lg_grp_write_prefix( async->host, defer.grp, plan, defer.format, buf );
+
+    async->args.len = 0;
+    lg_fmt_render( &async->args,
+                   defer.format,
+                   data + sizeof( defer ),
+                   slot->len - sizeof( defer ) );
+    lg_fast_append( buf, async->args.data, async->args.len );
+
+    lg_grp_write_postfix( async->host, defer.grp, plan, seq, defer.newline, defer.format, buf );
+}
+
+
+static void lg_async_write_batch( lg_async_t async, lg_queue_slot_t* batch, size_t cnt )
+{
+    lg_plan_t   plan;
+    lg_log_t    log;
+    size_t      i;
+    size_t      j;
+    lg_kv_msg_s kvh;
+    lg_enc_t    enc;
+
+    const char* msg;
+    size_t      len;
+    int         locked;
+
+    po_reset( async->touched );
+
+    /* Collect per Log vectors, in order of messages. */
+    for ( i = 0; i < cnt; i++ ) {
+
+        plan = (lg_plan_t)batch[ i ]->ref;
+
+        if ( batch[ i ]->kind == LG_MSG_DEFERRED ) {
+            lg_async_render( async, plan, batch[ i ], &async->render[ i ] );
+            msg = async->render[ i ];
+            len = sl_length( async->render[ i ] );
+        } else {
+            msg = lg_queue_data( batch[ i ] );
+            len = batch[ i ]->len;
+            if ( batch[ i ]->kind == LG_MSG_KV )
+                memcpy( &kvh, msg, sizeof( kvh ) );
+        }
+
+        for ( j = 0; j < plan->cnt; j++ ) {
+            log = plan->logs[ j ];
+            if ( batch[ i ]->kind == LG_MSG_KV ) {
+                enc = __atomic_load_n( &log->enc, __ATOMIC_RELAXED );
+                msg = (const char*)lg_queue_data( batch[ i ] ) + kvh.off[ enc ];
+                len = kvh.len[ enc ];
+            }
+            /* Shard records are framed per message. */
+            if ( log->type == LG_LOG_TYPE_SHARD ) {
+                lg_log_write( async->host, log, msg, len );
+                continue;
+            }
+            if ( log->iov == st_nil )
+                log->iov = po_malloc( ( LG_ASYNC_BATCH + 1 ) * sizeof( struct iovec ) );
+            if ( log->iovcnt == 0 )
+                po_add( async->touched, log );
+            log->iovcnt++;
+            log->iov[ log->iovcnt ].iov_base = (void*)msg;
+            log->iov[ log->iovcnt ].iov_len = len;
+        }
+    }
+
+    po_each( async->touched, log, lg_log_t )
+    {
+        locked = lg_log_lock( async->host, log );
+        lg_log_appendv( log, log->iov, log->iovcnt );
+        lg_log_unlock( log, locked );
+        log->iovcnt = 0;
+    }
+
+    lg_host_uring_submit( async->host );
+}
+
+
+static void* lg_async_writer( void* arg )
+{
+    lg_async_t      async = (lg_async_t)arg;
+    lg_queue_slot_t batch[ LG_ASYNC_BATCH ];
+    size_t          cnt;
+    size_t          i;
+
+    for ( ;; ) {
+
+        cnt = 0;
+        while ( cnt < LG_ASYNC_BATCH && ( batch[ cnt ] = lg_queue_take( async->queue ) ) )
+            cnt++;
+
+        if ( cnt > 0 ) {
+
+            lg_async_write_batch( async, batch, cnt );
+
+            for ( i = 0; i < cnt; i++ )
+                lg_queue_release( async->queue, batch[ i ] );
+
+            pthread_mutex_lock( &async->lock );
+            __atomic_add_fetch( &async->consumed, cnt, __ATOMIC_RELEASE );
+            pthread_cond_broadcast( &async->done );
+            pthread_mutex_unlock( &async->lock );
+
+        } else {
+
+            pthread_mutex_lock( &async->lock );
+            if ( async->stop && !lg_async_pending( async ) ) {
+                pthread_mutex_unlock( &async->lock );
+                break;
+            }
+            __atomic_store_n( &async->sleeping, 1, __ATOMIC_SEQ_CST );
+            if ( !lg_async_pending( async ) )
+                lg_cond_wait_ms( &async->wake, &async->lock, 10 );
+            __atomic_store_n( &async->sleeping, 0, __ATOMIC_SEQ_CST );
+            pthread_mutex_unlock( &async->lock );
+        }
+    }
+
+    return NULL;
+}
+
+
+static void lg_async_put( lg_host_t   host,
+                          lg_plan_t   plan,
+                          uint32_t    kind,
+                          const char* msg,
+                          size_t      len )
+{
+    lg_async_t      async = host->async;
+    lg_queue_slot_t slot;
+    uint64_t        seen;
+
+    if ( plan->cnt == 0 )
+        return;
+
+    for ( ;; ) {
+
+        seen = __atomic_load_n( &async->consumed, __ATOMIC_ACQUIRE );
+        slot = lg_queue_claim( async->queue );
+        if ( slot )
+            break;
+
+        if ( async->policy == LG_ASYNC_DROP_NEWEST ) {
+
+            __atomic_add_fetch( &async->dropped, 1, __ATOMIC_RELAXED );
+            return;
+
+        } else if ( async->policy == LG_ASYNC_DROP_OLDEST ) {
+
+            lg_queue_slot_t old;
+            old = lg_queue_take( async->queue );
+            if ( old ) {
+                lg_queue_release( async->queue, old );
+                __atomic_add_fetch( &async->dropped, 1, __ATOMIC_RELAXED );
+                __atomic_add_fetch( &async->consumed, 1, __ATOMIC_RELEASE );
+            }
+
+        } else {
+
+            /* Sleep until writer has consumed messages. Writer
+             * updates "consumed" under the lock, hence no wakeup is
+             * lost. */
+            pthread_mutex_lock( &async->lock );
+            pthread_cond_signal( &async->wake );
+            while ( __atomic_load_n( &async->consumed, __ATOMIC_ACQUIRE ) == seen )
+                lg_cond_wait_ms( &async->done, &async->lock, 10 );
+            pthread_mutex_unlock( &async->lock );
+        }
+    }
+
+    lg_queue_store( slot, plan, kind, msg, len );
+    lg_queue_publish( slot );
+
+    lg_async_wake( async );
+}
+
+
+static void lg_async_drain( lg_async_t async )
+{
+    uint64_t target;
+
+    target = lg_queue_claimed( async->queue );
+
+    pthread_mutex_lock( &async->lock );
+    while ( __atomic_load_n( &async->consumed, __ATOMIC_ACQUIRE ) < target ) {
+        pthread_cond_signal( &async->wake );
+        lg_cond_wait_ms( &async->done, &async->lock, 10 );
+    }
+    pthread_mutex_unlock( &async->lock );
+}
+
+
+static void lg_async_del( lg_async_t async )
+{
+    int i;
+
+    lg_async_drain( async );
+
+    pthread_mutex_lock( &async->lock );
+    async->stop = 1;
+    pthread_cond_signal( &async->wake );
+    pthread_mutex_unlock( &async->lock );
+
+    pthread_join( async->writer, NULL );
+
+    lg_queue_del( async->queue );
+    po_destroy_storage( async->touched );
+    for ( i = 0; i < LG_ASYNC_BATCH; i++ )
+        sl_del( &async->render[ i ] );
+    lg_fmt_buf_free( &async->args );
+    pthread_cond_destroy( &async->wake );
+    pthread_cond_destroy( &async->done );
+    pthread_mutex_destroy( &async->lock );
+    po_free( async );
+}
+
+
+static void lg_grp_write_msg( lg_host_t host, lg_plan_t plan, const sl_t msg )
+{
+    size_t i;
+
+    for ( i = 0; i < plan->cnt; i++ )
+        lg_log_write( host, plan->logs[ i ], msg, sl_length( msg ) );
+
+    lg_host_uring_submit( host );
+}
+
+
+/**
+ * Write Prefix of message.
+ *
+ * @return Sequence number of message for Postfix.
+ */
+static uint64_t lg_grp_write_prefix( lg_host_t   host,
+                                     lg_grp_t    grp,
+                                     lg_plan_t   plan,
+                                     const char* format,
+                                     sl_p        buf )
+{
+    uint64_t seq = 0;
+
+    sl_clear( *buf );
+
+    if ( plan->seq )
+        seq = __atomic_fetch_add( &grp->seq, 1, __ATOMIC_RELAXED );
+
+    if ( plan->prefix_str )
+        sl_concatenate_c( buf, plan->prefix_str );
+    else if ( plan->prefix_pat )
+        lg_pat_render( plan->prefix_pat, host->data, seq, buf );
+    else if ( plan->prefix )
+        plan->prefix( host, grp, format, buf );
+
+    return seq;
+}
+
+
+static void lg_grp_write_postfix( lg_host_t   host,
+                                  lg_grp_t    grp,
+                                  lg_plan_t   plan,
+                                  uint64_t    seq,
+                                  int         newline,
+                                  const char* format,
+                                  sl_p        buf )
+{
+    if ( plan->postfix_str )
+        sl_concatenate_c( buf, plan->postfix_str );
+    else if ( plan->postfix_pat )
+        lg_pat_render( plan->postfix_pat, host->data, seq, buf );
+    else if ( plan->postfix )
+        plan->postfix( host, grp, format, buf );
+
+    if ( newline )
+        sl_append_char( buf, '\n' );
+}
+
+
+/**
+ * Queue message with captured arguments for formatting in writer.
+ *
+ * @return 1 if queued, 0 if arguments can't be captured ("ap" is not
+ * consumed).
+ */
+static int lg_grp_defer( lg_host_t   host,
+                         lg_grp_t    grp,
+                         lg_plan_t   plan,
+                         int         newline,
+                         const char* format,
+                         va_list     ap )
+{
+    lg_fmt_buf_t args;
+    lg_defer_s   defer;
+    va_list      cap;
+    int          ok;
+
+    defer.grp = grp;
+    defer.format = format;
+    defer.newline = newline;
+
+    args = lg_host_args( host );
+    args->len = 0;
+    lg_fmt_buf_append( args, &defer, sizeof( defer ) );
+    va_copy( cap, ap );
+    ok = lg_fmt_encode( args, format, cap );
+    va_end( cap );
+
+    if ( ok )
+        lg_async_put( host, plan, LG_MSG_DEFERRED, args->data, args->len );
+
+    return ok;
+}
+
+
+static void lg_grp_encode( lg_fmt_buf_t args, const char* format, ... )
+{
+    va_list ap;
+
+    va_start( ap, format );
+    lg_fmt_encode( args, format, ap );
+    va_end( ap );
+}
+
+
+static void lg_grp_write_bin( lg_host_t   host,
+                              lg_grp_t    grp,
+                              lg_plan_t   plan,
+                              int         newline,
+                              const char* format,
+                              const sl_t  msg,
+                              size_t      pre,
+                              size_t      post,
+                              va_list     ap )
+{
+    lg_fmt_buf_t args;
+    size_t       i;
+    va_list      cap;
+    sl_t         body;
+    int          ok;
+
+    args = lg_host_args( host );
+    args->len = 0;
+    va_copy( cap, ap );
+    ok = lg_fmt_encode( args, format, cap );
+    va_end( cap );
+
+    /* Arguments that can't be captured are recorded as formatted
+     * message. */
+    if ( !ok ) {
+        body = sl_new( 128 );
+        sl_va_format( &body, format, ap );
+        lg_grp_encode( args, "%s", body );
+        sl_del( &body );
+        format = "%s";
+    }
+
+    for ( i = 0; i < plan->bin_cnt; i++ )
+        lg_log_write_bin(
+            host, plan->logs[ plan->cnt + i ], grp, format, newline, msg, pre, post, args );
+
+    lg_host_uring_submit( host );
+}
+
+
+/**
+ * Write repeat summary of Group to text Files. Coalescing lock must
+ * be held.
+ */
+static void lg_grp_dup_emit( lg_host_t host, lg_grp_t grp, lg_plan_t plan )
+{
+    lg_dup_t    dup = grp->dup;
+    const char* format = "last message repeated %lu times";
+    uint64_t    seq;
+
+    if ( dup->cnt == 0 )
+        return;
+
+    if ( plan->cnt ) {
+        seq = lg_grp_write_prefix( host, grp, plan, format, &dup->buf );
+        sl_format_quick( &dup->buf, format, (unsigned long)dup->cnt );
+        lg_grp_write_postfix( host, grp, plan, seq, 1, format, &dup->buf );
+        if ( host->async )
+            lg_async_put( host, plan, LG_MSG_TEXT, dup->buf, sl_length( dup->buf ) );
+        else
+            lg_grp_write_msg( host, plan, dup->buf );
+    }
+
+    __atomic_store_n( &dup->cnt, 0, __ATOMIC_RELAXED );
+}
+
+
+/**
+ * Compare message with the previous one. When message is not a
+ * repeat, the pending summary is written and the coalescing lock is
+ * kept, so that the message follows the summary without other
+ * messages in between. Caller writes the message and releases the
+ * lock with lg_grp_dup_done().
+ *
+ * @return 1 if message is a repeat and should not be written.
+ */
+static int lg_grp_dup_check( lg_host_t host, lg_grp_t grp, lg_plan_t plan, const char* msg, size_t len )
+{
+    lg_dup_t dup = grp->dup;
+    uint64_t hash;
+    size_t   i;
+    int      repeat;
+
+    /* FNV-1a */
+    hash = 0xcbf29ce484222325ULL;
+    for ( i = 0; i < len; i++ )
+        hash = ( hash ^ (uint8_t)msg[ i ] ) * 0x100000001b3ULL;
+
+    pthread_mutex_lock( &dup->lock );
+
+    repeat = ( hash == dup->hash && len == sl_length( dup->last ) && !memcmp( msg, dup->last, len ) );
+
+    if ( repeat ) {
+        if ( dup->cnt == 0 )
+            dup->start = lg_time_ns( CLOCK_MONOTONIC );
+        __atomic_store_n( &dup->cnt, dup->cnt + 1, __ATOMIC_RELAXED );
+        if ( dup->timeout && lg_time_ns( CLOCK_MONOTONIC ) - dup->start >= dup->timeout )
+            lg_grp_dup_emit( host, grp, plan );
+        pthread_mutex_unlock( &dup->lock );
+    } else {
+        lg_grp_dup_emit( host, grp, plan );
+        dup->hash = hash;
+        sl_clear( dup->last );
+        sl_format_quick( &dup->last, "%.*s", (int)len, msg );
+    }
+
+    return repeat;
+}
+
+
+/**
+ * Release coalescing lock after message is written.
+ */
+static void lg_grp_dup_done( lg_grp_t grp )
+{
+    pthread_mutex_unlock( &grp->dup->lock );
+}
+
+
+/**
+ * Write pending repeat summary of Group.
+ */
+static void lg_grp_dup_flush( lg_host_t host, lg_grp_t grp )
+{
+    lg_dup_t  dup = grp->dup;
+    lg_plan_t plan;
+    int       parity;
+
+    if ( !grp->coalesce || __atomic_load_n( &dup->cnt, __ATOMIC_RELAXED ) == 0 )
+        return;
+
+    parity = lg_host_enter( host );
+    plan = lg_grp_plan( host, grp );
+    pthread_mutex_lock( &dup->lock );
+    lg_grp_dup_emit( host, grp, plan );
+    pthread_mutex_unlock( &dup->lock );
+    lg_host_exit( host, parity );
+}
+
+
+/**
+ * Write pending repeat summary of Group if its timeout has passed
+ * since the first repeat (Host background thread).
+ */
+static void lg_grp_dup_expire( lg_host_t host, lg_grp_t grp )
+{
+    lg_dup_t  dup = grp->dup;
+    lg_plan_t plan;
+    int       parity;
+
+    if ( !grp->coalesce || __atomic_load_n( &dup->cnt, __ATOMIC_RELAXED ) == 0 )
+        return;
+
+    parity = lg_host_enter( host );
+    plan = lg_grp_plan( host, grp );
+    pthread_mutex_lock( &dup->lock );
+    if ( dup->cnt && dup->timeout
+         && lg_time_ns( CLOCK_MONOTONIC ) - dup->start >= dup->timeout )
+        lg_grp_dup_emit( host, grp, plan );
+    pthread_mutex_unlock( &dup->lock );
+    lg_host_exit( host, parity );
+}
+
+
+/**
+ * Format message to buffer (appended).
+ */
+static void lg_grp_format( lg_host_t host, sl_p buf, const char* format, va_list ap )
+{
+    if ( !host->fastfmt || !lg_fast_format( host->fast, buf, format, ap ) )
+        sl_va_format( buf, format, ap );
+}
+
+
+static void lg_grp_output( lg_host_t   host,
+                           lg_grp_t    grp,
+                           int         newline,
+                           const char* format,
+                           va_list     ap )
+{
+    lg_plan_t plan;
+    sl_p      buf;
+    va_list   bin_ap;
+    size_t    pre;
+    size_t    post;
+    uint64_t  seq;
+    int       locked = 0;
+    int       repeat = 0;
+
+    plan = lg_grp_plan( host, grp );
+
+    /* Message is formatted directly if its arguments can't be
+     * captured. */
+    if ( host->async && grp->deferred && plan->bin_cnt == 0
+         && lg_grp_defer( host, grp, plan, newline, format, ap ) )
+        return;
+
+    buf = lg_host_buf( host );
+
+    seq = lg_grp_write_prefix( host, grp, plan, format, buf );
+    pre = sl_length( *buf );
+
+    if ( plan->bin_cnt ) {
+        va_copy( bin_ap, ap );
+        if ( plan->cnt )
+            lg_grp_format( host, buf, format, ap );
+        post = sl_length( *buf );
+        /* Repeats are coalesced only in text Files, binary Files get
+         * every record. */
+        if ( grp->coalesce && plan->cnt ) {
+            repeat = lg_grp_dup_check( host, grp, plan, *buf + pre, post - pre );
+            locked = !repeat;
+        }
+        lg_grp_write_postfix( host, grp, plan, seq, newline, format, buf );
+        lg_grp_write_bin( host, grp, plan, newline, format, *buf, pre, post, bin_ap );
+        va_end( bin_ap );
+        if ( repeat )
+            return;
+    } else {
+        lg_grp_format( host, buf, format, ap );
+        post = sl_length( *buf );
+        if ( grp->coalesce ) {
+            if ( lg_grp_dup_check( host, grp, plan, *buf + pre, post - pre ) )
+                return;
+            locked = 1;
+        }
+        lg_grp_write_postfix( host, grp, plan, seq, newline, format, buf );
+    }
+
+    if ( plan->cnt ) {
+        if ( host->async )
+            lg_async_put( host, plan, LG_MSG_TEXT, *buf, sl_length( *buf ) );
+        else
+            lg_grp_write_msg( host, plan, *buf );
+    }
+
+    if ( locked )
+        lg_grp_dup_done( grp );
+}
+
+
+static void lg_grp_output_fmt( lg_host_t host, lg_grp_t grp, const char* format, ... )
+{
+    va_list ap;
+
+    va_start( ap, format );
+    lg_grp_output( host, grp, 1, format, ap );
+    va_end( ap );
+}
+
+
+/**
+ * Check sampling and rate limit (GCRA, i.e. token bucket with
+ * one atomic state).
+ *
+ * @return 1 if message is accepted.
+ */
+static int lg_grp_admit( lg_grp_t grp )
+{
+    uint64_t now;
+    uint64_t tat;
+    uint64_t next;
+    uint32_t sample;
+
+    sample = __atomic_load_n( &grp->sample, __ATOMIC_RELAXED );
+    if ( sample > 1 && __atomic_fetch_add( &grp->sample_cnt, 1, __ATOMIC_RELAXED ) % sample ) {
+        __atomic_add_fetch( &grp->rejected, 1, __ATOMIC_RELAXED );
+        return 0;
+    }
+
+    if ( __atomic_load_n( &grp->limit_ns, __ATOMIC_RELAXED ) == 0 )
+        return 1;
+
+    now = lg_time_ns( CLOCK_MONOTONIC );
+    tat = __atomic_load_n( &grp->limit_tat, __ATOMIC_RELAXED );
+
+    do {
+        if ( tat > now + grp->limit_tau ) {
+            __atomic_add_fetch( &grp->suppressed, 1, __ATOMIC_RELAXED );
+            __atomic_add_fetch( &grp->rejected, 1, __ATOMIC_RELAXED );
+            return 0;
+        }
+        next = ( tat > now ? tat : now ) + grp->limit_ns;
+    } while ( !__atomic_compare_exchange_n(
+        &grp->limit_tat, &tat, next, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+
+    return 1;
+}
+
+
+/**
+ * Check admission of message and write pending suppression notice.
+ *
+ * @return 1 if message is accepted.
+ */
+static int lg_grp_accept( lg_host_t host, lg_grp_t grp )
+{
+    uint64_t cnt;
+
+    if ( __atomic_load_n( &grp->throttled, __ATOMIC_ACQUIRE ) ) {
+
+        if ( !lg_grp_admit( grp ) )
+            return 0;
+
+        if ( __atomic_load_n( &grp->suppressed, __ATOMIC_RELAXED ) ) {
+            cnt = __atomic_exchange_n( &grp->suppressed, 0, __ATOMIC_RELAXED );
+            if ( cnt )
+                lg_grp_output_fmt( host, grp, "%lu messages suppressed", (unsigned long)cnt );
+        }
+    }
+
+    if ( host->stats )
+        lg_stat_add( &grp->stat_msgs, 1 );
+
+    return 1;
+}
+
+
+static void lg_grp_write( lg_host_t   host,
+                          lg_grp_t    grp,
+                          int         newline,
+                          const char* format,
+                          va_list     ap )
+{
+    int parity;
+
+    parity = lg_host_enter( host );
+    if ( lg_grp_accept( host, grp ) )
+        lg_grp_output( host, grp, newline, format, ap );
+    lg_host_exit( host, parity );
+}
+
+
+/**
+ * Write key-value message to text Files of Group. Message is
+ * encoded once per encoding used by the Files.
+ */
+static void lg_grp_kv_output( lg_host_t host, lg_grp_t grp, const char* msg, const lg_kv_s* kv, size_t cnt )
+{
+    lg_plan_t    plan;
+    sl_p         buf;
+    lg_fmt_buf_t out;
+    lg_kv_msg_s  kvh;
+    size_t       pre;
+    size_t       post;
+    size_t       i;
+    uint64_t     seq;
+    int          used;
+    int          enc;
+
+    plan = lg_grp_plan( host, grp );
+
+    if ( plan->cnt == 0 )
+        return;
+
+    used = 0;
+    for ( i = 0; i < plan->cnt; i++ )
+        used |= 1 << __atomic_load_n( &plan->logs[ i ]->enc, __ATOMIC_RELAXED );
+
+    buf = lg_host_buf( host );
+    seq = lg_grp_write_prefix( host, grp, plan, msg, buf );
+    pre = sl_length( *buf );
+    lg_grp_write_postfix( host, grp, plan, seq, 0, msg, buf );
+    post = sl_length( *buf ) - pre;
+
+    out = lg_host_args( host );
+    out->len = 0;
+    lg_fmt_buf_append( out, &kvh, sizeof( kvh ) );
+
+    for ( enc = 0; enc < LG_ENC_CNT; enc++ ) {
+        kvh.off[ enc ] = out->len;
+        if ( used & ( 1 << enc ) )
+            lg_kv_encode( out, enc, grp->name, *buf, pre, *buf + pre, post, msg, kv, cnt, 1 );
+        kvh.len[ enc ] = out->len - kvh.off[ enc ];
+    }
+
+    memcpy( out->data, &kvh, sizeof( kvh ) );
+
+    if ( host->async ) {
+        lg_async_put( host, plan, LG_MSG_KV, out->data, out->len );
+    } else {
+        for ( i = 0; i < plan->cnt; i++ ) {
+            enc = __atomic_load_n( &plan->logs[ i ]->enc, __ATOMIC_RELAXED );
+            lg_log_write( host, plan->logs[ i ], out->data + kvh.off[ enc ], kvh.len[ enc ] );
+        }
+        lg_host_uring_submit( host );
+    }
+}
+
+
+static void lg_grp_set_fix( lg_host_t   host,
+                            lg_grp_t    grp,
+                            lg_grp_fn_p fn,
+                            const char* str,
+                            const char* pat,
+                            int         is_prefix )
+{
+    lg_grp_fn_p* fn_ref = is_prefix ? &grp->prefix : &grp->postfix;
+    char**       str_ref = is_prefix ? &grp->prefix_str : &grp->postfix_str;
+    char**       pat_ref = is_prefix ? &grp->prefix_pat : &grp->postfix_pat;
+    char*        old = *str_ref;
+
+    /* Pattern is used only in plan building, under Host lock. */
+    if ( *pat_ref )
+        po_free( *pat_ref );
+
+    *fn_ref = fn;
+    *str_ref = str ? strdup( str ) : st_nil;
+    *pat_ref = pat ? strdup( pat ) : st_nil;
+
+    /* Old string is reachable through current plans until touch. */
+    lg_host_touch( host );
+    if ( old )
+        lg_host_retire( host, old );
+}
+
+
+static void lg_grp_join_grp_obj( lg_host_t host, lg_grp_t grp, lg_grp_t joinee )
+{
+    if ( grp && joinee ) {
+        lg_log_t log;
+        log = lg_log_new( LG_LOG_TYPE_GRPREF, NULL );
+        log->grp = joinee;
+        po_add( grp->logs, log );
+        lg_host_touch( host );
+    }
+}
+
+
+static void lg_grp_attach_sub( lg_host_t host, lg_grp_t top, lg_grp_t sub )
+{
+    po_add( top->subs, sub );
+    sub->top = top;
+    lg_host_touch( host );
+}
+
+
+static void lg_grp_detach_sub( lg_host_t host, lg_grp_t top, lg_grp_t sub )
+{
+    po_pos_t idx;
+
+    idx = po_find( top->subs, sub );
+    if ( idx != PO_NOT_INDEX ) {
+        po_delete_at( top->subs, idx );
+        sub->top = st_nil;
+        lg_host_touch( host );
+    }
+}
+
+
+
+
+/* ------------------------------------------------------------
+ * Callback functions:
+ */
+
+static void lg_host_grp_del_fn( po_d key, po_d value, void* arg )
+{
+    (void)key;
+
+    lg_grp_t grp = (lg_grp_t)value;
+    lg_grp_del( (lg_host_t)arg, grp );
+}
+
+
+static void lg_host_grp_dup_fn( po_d key, po_d value, void* arg )
+{
+    (void)key;
+
+    lg_grp_dup_flush( (lg_host_t)arg, (lg_grp_t)value );
+}
+
+
+static void lg_host_log_flush_fn( po_d key, po_d value, void* arg )
+{
+    (void)key;
+
+    lg_log_flush( (lg_host_t)arg, (lg_log_t)value );
+}
+
+
+static void lg_host_log_ring_fn( po_d key, po_d value, void* arg )
+{
+    lg_host_t host = (lg_host_t)arg;
+    lg_log_t  log = (lg_log_t)value;
+
+    (void)key;
+
+    if ( log->type != LG_LOG_TYPE_FILE && log->type != LG_LOG_TYPE_BIN )
+        return;
+
+    lg_log_flush( host, log );
+    lg_log_uring_free( log );
+
+    /* Ring writes use explicit offsets, plain writes the file position. */
+    if ( log->fd >= 0 ) {
+        if ( host->ring )
+            log->off = lseek( log->fd, 0, SEEK_CUR );
+        else
+            lseek( log->fd, log->off, SEEK_SET );
+    }
+
+    log->ring = host->ring;
+}
+
+
+/* ------------------------------------------------------------
+ * Exit flush:
+ */
+
+static lg_host_t       lg_exit_hosts = st_nil;
+static pthread_mutex_t lg_exit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  lg_exit_once = PTHREAD_ONCE_INIT;
+
+
+/**
+ * Flush existing Hosts at exit, so buffered tails are not lost.
+ */
+static void lg_exit_flush( void )
+{
+    lg_host_t host;
+
+    pthread_mutex_lock( &lg_exit_lock );
+    for ( host = lg_exit_hosts; host; host = host->exit_next )
+        lg_host_flush( host );
+    pthread_mutex_unlock( &lg_exit_lock );
+}
+
+
+static void lg_exit_init( void )
+{
+    atexit( lg_exit_flush );
+}
+
+
+static void lg_exit_register( lg_host_t host )
+{
+    pthread_once( &lg_exit_once, lg_exit_init );
+
+    pthread_mutex_lock( &lg_exit_lock );
+    host->exit_next = lg_exit_hosts;
+    lg_exit_hosts = host;
+    pthread_mutex_unlock( &lg_exit_lock );
+}
+
+
+static void lg_exit_unregister( lg_host_t host )
+{
+    lg_host_t* pos;
+
+    pthread_mutex_lock( &lg_exit_lock );
+    for ( pos = &lg_exit_hosts; *pos; pos = &( *pos )->exit_next ) {
+        if ( *pos == host ) {
+            *pos = host->exit_next;
+            break;
+        }
+    }
+    pthread_mutex_unlock( &lg_exit_lock );
+}
+
+
+
+/* ------------------------------------------------------------
+ * Crash flush:
+ */
+
+static lg_host_t        lg_crash_hosts[ LG_CRASH_HOSTS ];
+static int              lg_crash_active = 0;
+static const int        lg_crash_sigs[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+static struct sigaction lg_crash_prev[ sizeof( lg_crash_sigs ) / sizeof( int ) ];
+static pthread_mutex_t  lg_crash_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * Write "len" bytes with async-signal-safe calls.
+ */
+static void lg_crash_write( int fd, const char* data, size_t len, int seek, uint64_t off )
+{
+    ssize_t ret;
+
+    while ( len > 0 ) {
+        if ( seek )
+            ret = pwrite( fd, data, len, off );
+        else
+            ret = write( fd, data, len );
+        if ( ret < 0 ) {
+            if ( errno == EINTR )
+                continue;
+            return;
+        }
+        data += ret;
+        len -= ret;
+        off += ret;
+    }
+}
+
+
+/**
+ * Write pending buffers of Host. No locks are taken, since the
+ * crashing thread may hold them.
+ */
+static void lg_crash_flush_log( lg_log_t log )
+{
+    size_t   len;
+    uint32_t i;
+
+    for ( i = 0; i < log->shard_cnt; i++ )
+        lg_crash_flush_log( log->shards[ i ] );
+
+    if ( log->fd < 0 )
+        return;
+
+    /* Rewrite of buffers in flight is harmless. */
+    for ( i = 0; log->ring && i < LG_URING_BUFS; i++ )
+        if ( log->ubufs[ i ].busy )
+            lg_crash_write( log->fd, log->ubufs[ i ].data, log->ubufs[ i ].len, 1, log->ubufs[ i ].off );
+
+    len = log->olen;
+    if ( len > 0 && log->obuf ) {
+        log->olen = 0;
+        lg_crash_write( log->fd, log->obuf, len, log->ring != st_nil, log->off );
+        log->off += len;
+    }
+}
+
+
+/**
+ * Write message directly to Log. Files that are not open yet are
+ * opened. Sharded and binary Logs would need locks or formatting,
+ * and they are skipped.
+ */
+static void lg_crash_append( lg_log_t log, const char* data, size_t len )
+{
+    if ( log->fd < 0 && log->type == LG_LOG_TYPE_FILE )
+        log->fd = open( log->name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+
+    if ( log->fd < 0 )
+        return;
+
+    switch ( log->type ) {
+
+        case LG_LOG_TYPE_MMAP:
+            if ( log->map && log->mlen + len <= log->msize ) {
+                memcpy( log->map + log->mlen, data, len );
+                log->mlen += len;
+            }
+            break;
+
+        case LG_LOG_TYPE_RING: lg_log_ring_append( log, data, len ); break;
+
+        case LG_LOG_TYPE_FILE:
+        case LG_LOG_TYPE_STDOUT:
+            lg_crash_write( log->fd, data, len, log->ring != st_nil, log->off );
+            log->off += len;
+            break;
+
+        default: break;
+    }
+}
+
+
+/**
+ * Write messages still in async Queue. Slots are not released, since
+ * release may free memory.
+ */
+static void lg_crash_drain( lg_async_t async )
+{
+    lg_queue_slot_t slot;
+    lg_plan_t       plan;
+    lg_kv_msg_s     kvh;
+    lg_enc_t        enc;
+    const char*     msg;
+    size_t          len;
+    size_t          j;
+
+    while ( ( slot = lg_queue_take( async->queue ) ) ) {
+
+        if ( slot->kind == LG_MSG_DEFERRED )
+            continue;
+
+        plan = (lg_plan_t)slot->ref;
+        msg = lg_queue_data( slot );
+        len = slot->len;
+        if ( slot->kind == LG_MSG_KV )
+            memcpy( &kvh, msg, sizeof( kvh ) );
+
+        for ( j = 0; j < plan->cnt; j++ ) {
+            if ( slot->kind == LG_MSG_KV ) {
+                enc = plan->logs[ j ]->enc;
+                lg_crash_append( plan->logs[ j ], lg_queue_data( slot ) + kvh.off[ enc ], kvh.len[ enc ] );
+            } else {
+                lg_crash_append( plan->logs[ j ], msg, len );
+            }
+        }
+    }
+}
+
+
+static void lg_crash_flush( lg_host_t host )
+{
+    lg_log_t log;
+
+    po_each( host->files, log, lg_log_t )
+    {
+        lg_crash_flush_log( log );
+    }
+
+    if ( host->async )
+        lg_crash_drain( host->async );
+}
+
+
+static void lg_crash_handler( int sig )
+{
+    lg_host_t host;
+    size_t    i;
+    int       saved = errno;
+
+    /* First crashing thread flushes. */
+    if ( __atomic_exchange_n( &lg_crash_active, 2, __ATOMIC_ACQ_REL ) == 1 ) {
+        for ( i = 0; i < LG_CRASH_HOSTS; i++ ) {
+            host = __atomic_load_n( &lg_crash_hosts[ i ], __ATOMIC_ACQUIRE );
+            if ( host )
+                lg_crash_flush( host );
+        }
+    }
+
+    /* Restore previous handlers, and the signal is delivered to them
+     * after return. Handlers are installed again by next enable. */
+    for ( i = 0; i < sizeof( lg_crash_sigs ) / sizeof( int ); i++ )
+        sigaction( lg_crash_sigs[ i ], &lg_crash_prev[ i ], NULL );
+    __atomic_store_n( &lg_crash_active, 0, __ATOMIC_RELEASE );
+
+    raise( sig );
+
+    errno = saved;
+}
+
+
+/**
+ * Give calling thread an alternate signal stack, so that the handler
+ * can run on stack overflow. Existing stack is kept.
+ */
+static void lg_crash_altstack( void )
+{
+    stack_t ss;
+
+    if ( lg_tls_altstack || sigaltstack( NULL, &ss ) != 0 || !( ss.ss_flags & SS_DISABLE ) )
+        return;
+
+    ss.ss_sp = po_malloc( LG_CRASH_STACK );
+    ss.ss_size = LG_CRASH_STACK;
+    ss.ss_flags = 0;
+    if ( sigaltstack( &ss, NULL ) != 0 ) {
+        po_free( ss.ss_sp );
+        return;
+    }
+
+    lg_tls_altstack = ss.ss_sp;
+
+    /* Stack is released by thread destructor. */
+    pthread_once( &lg_tls_once, lg_tls_init );
+    pthread_setspecific( lg_tls_key, &lg_tls_buf );
+}
+
+
+/**
+ * Set up logging thread for crash handler, if enabled.
+ */
+static void lg_crash_thread( void )
+{
+    if ( __atomic_load_n( &lg_crash_active, __ATOMIC_ACQUIRE ) )
+        lg_crash_altstack();
+}
+
+
+static void lg_crash_register( lg_host_t host )
+{
+    struct sigaction sa;
+    size_t           i;
+
+    pthread_mutex_lock( &lg_crash_lock );
+
+    for ( i = 0; i < LG_CRASH_HOSTS; i++ )
+        if ( lg_crash_hosts[ i ] == host )
+            goto done;
+
+    for ( i = 0; i < LG_CRASH_HOSTS; i++ ) {
+        if ( lg_crash_hosts[ i ] == st_nil ) {
+            __atomic_store_n( &lg_crash_hosts[ i ], host, __ATOMIC_RELEASE );
+            break;
+        }
+    }
+
+    lg_crash_altstack();
+
+    if ( lg_crash_active == 0 ) {
+        memset( &sa, 0, sizeof( sa ) );
+        sa.sa_handler = lg_crash_handler;
+        sa.sa_flags = SA_ONSTACK;
+        sigemptyset( &sa.sa_mask );
+        for ( i = 0; i < sizeof( lg_crash_sigs ) / sizeof( int ); i++ )
+            sigaction( lg_crash_sigs[ i ], &sa, &lg_crash_prev[ i ] );
+        __atomic_store_n( &lg_crash_active, 1, __ATOMIC_RELEASE );
+    }
+
+done:
+    pthread_mutex_unlock( &lg_crash_lock );
+}
+
+
+static void lg_crash_unregister( lg_host_t host )
+{
+    size_t i;
+
+    pthread_mutex_lock( &lg_crash_lock );
+
+    for ( i = 0; i < LG_CRASH_HOSTS; i++ )
+        if ( lg_crash_hosts[ i ] == host )
+            __atomic_store_n( &lg_crash_hosts[ i ], st_nil, __ATOMIC_RELEASE );
+
+    pthread_mutex_unlock( &lg_crash_lock );
+}
+
+
+static void lg_host_log_del_fn( po_d key, po_d value, void* arg )
+{
+    (void)key;
+    (void)arg;
+
+    lg_log_t log = (lg_log_t)value;
+    lg_log_del( log );
+}
+
+
+
+
+/* ------------------------------------------------------------
+ * Group state rules:
+ */
+
+
+static void lg_host_grp_update_fn( po_d key, po_d value, void* arg )
+{
+    (void)key;
+
+    lg_grp_update( (lg_host_t)arg, (lg_grp_t)value );
+}
+
+
+static void lg_rule_del( lg_rule_t rule )
+{
+    po_free( rule->pattern );
+    po_free( rule );
+}
+
+
+/**
+ * Remove all rules of list.
+ */
+static void lg_host_rules_clear( po_t rules )
+{
+    lg_rule_t rule;
+
+    po_each( rules, rule, lg_rule_t )
+    {
+        lg_rule_del( rule );
+    }
+    po_reset( rules );
+}
+
+
+/**
+ * Add rule to list, replacing earlier rule with the same pattern. The
+ * earlier rule has no effect, since the later one overrides it.
+ */
+static void lg_host_rules_add( po_t rules, lg_rule_t rule )
+{
+    lg_rule_t old;
+
+    po_each( rules, old, lg_rule_t )
+    {
+        if ( !strcmp( old->pattern, rule->pattern ) ) {
+            po_delete_at( rules, po_find( rules, old ) );
+            lg_rule_del( old );
+            break;
+        }
+    }
+
+    po_add( rules, rule );
+}
+
+
+/**
+ * Parse rules, store them to list and apply to existing Groups. Host
+ * is locked by caller.
+ *
+ * @return Number of valid rules.
+ */
+static int lg_host_rules_apply( lg_host_t host, const char* rules, po_t list )
+{
+    const char* p;
+    const char* end;
+    const char* eq;
+    lg_rule_t   rule;
+    lg_grp_t    grp;
+    po_s        desc;
+    po_t        grps;
+    st_bool_t   value;
+    int         cnt;
+
+    cnt = 0;
+    p = rules;
+    grps = po_new_descriptor( &desc );
+
+    while ( *p ) {
+
+        if ( *p == '#' ) {
+            while ( *p && *p != '\n' )
+                p++;
+            continue;
+        }
+
+        if ( strchr( " \t\r\n,;", *p ) ) {
+            p++;
+            continue;
+        }
+
+        end = p;
+        while ( *end && !strchr( " \t\r\n,;#", *end ) )
+            end++;
+
+        eq = memchr( p, '=', end - p );
+        if ( eq && eq > p && end - eq == 2 && ( eq[ 1 ] == 'y' || eq[ 1 ] == 'n' ) ) {
+
+            value = ( eq[ 1 ] == 'y' );
+
+            rule = po_malloc( sizeof( lg_rule_s ) );
+            rule->pattern = po_malloc( eq - p + 1 );
+            memcpy( rule->pattern, p, eq - p );
+            rule->pattern[ eq - p ] = 0;
+            rule->value = value;
+            rule->glob = lg_trie_is_glob( rule->pattern );
+            lg_host_rules_add( list, rule );
+
+            po_reset( grps );
+            lg_trie_glob( host->names, rule->pattern, grps );
+            po_each( grps, grp, lg_grp_t )
+            {
+                lg_grp_set_active( host, grp, value );
+            }
+
+            cnt++;
+        }
+
+        p = end;
+    }
+
+    po_destroy_storage( grps );
+
+    return cnt;
+}
+
+
+/**
+ * Reload watched rules file.
+ */
+static void lg_watch_load( lg_host_t host, const char* path )
+{
+    sl_t text;
+
+    text = sl_read_file( path );
+
+    lg_host_lock( host );
+    lg_host_rules_clear( host->file_rules );
+    if ( text )
+        lg_host_rules_apply( host, text, host->file_rules );
+    lg_host_unlock( host );
+
+    if ( text )
+        sl_del( &text );
+}
+
+
+static void* lg_watch_worker( void* arg )
+{
+    lg_host_t                   host = (lg_host_t)arg;
+    lg_watch_t                  watch = host->watch;
+    struct pollfd               fds[ 2 ];
+    const struct inotify_event* ev;
+    char*                       p;
+    ssize_t                     len;
+    int                         reload;
+    char buf[ 4096 ] __attribute__( ( aligned( __alignof__( struct inotify_event ) ) ) );
+
+    fds[ 0 ].fd = watch->ifd;
+    fds[ 0 ].events = POLLIN;
+    fds[ 1 ].fd = watch->stop[ 0 ];
+    fds[ 1 ].events = POLLIN;
+
+    for ( ;; ) {
+
+        if ( poll( fds, 2, -1 ) < 0 ) {
+            if ( errno == EINTR )
+                continue;
+            break; // GCOV_EXCL_LINE
+        }
+
+        if ( fds[ 1 ].revents )
+            break;
+
+        len = read( watch->ifd, buf, sizeof( buf ) );
+        if ( len <= 0 )
+            continue;
+
+        reload = 0;
+        for ( p = buf; p < buf + len; p += sizeof( struct inotify_event ) + ev->len ) {
+            ev = (const struct inotify_event*)p;
+            if ( ev->len && !strcmp( ev->name, watch->base ) )
+                reload = 1;
+        }
+
+        if ( reload )
+            lg_watch_load( host, watch->path );
+    }
+
+    return NULL;
+}
+
+
+static void lg_watch_del( lg_watch_t watch )
+{
+    ssize_t ret;
+
+    ret = write( watch->stop[ 1 ], "", 1 );
+    (void)ret;
+    pthread_join( watch->thread, NULL );
+    close( watch->stop[ 0 ] );
+    close( watch->stop[ 1 ] );
+    close( watch->ifd );
+    po_free( watch->path );
+    po_free( watch );
+}
+
+
+
+
+/* ------------------------------------------------------------
+ * User API:
+ */
+
+
+lg_host_t lg_host_new( st_t data )
+{
+    lg_host_t host;
+
+    host = po_malloc( sizeof( lg_host_s ) );
+    host->data = data;
+    host->grps = mp_new_full( NULL, mp_key_hash_cstr, mp_key_comp_cstr, 16, 50 );
+    host->logs = mp_new_full( NULL, mp_key_hash_cstr, mp_key_comp_cstr, 16, 50 );
+    host->names = lg_trie_new();
+    host->lookup = st_nil;
+    host->buf = sl_new( PATH_MAX + 16 );
+
+    host->disabled = st_false;
+    host->gen = 0;
+    host->threaded = st_false;
+    host->async = st_nil;
+    host->ring = st_nil;
+    host->rotor = st_nil;
+    host->rules = po_new_descriptor( &host->rules_desc );
+    host->file_rules = po_new_descriptor( &host->file_rules_desc );
+    host->watch = st_nil;
+    host->fast = lg_fast_new();
+    host->fastfmt = st_true;
+    host->stats = st_false;
+    lg_fmt_buf_init( &host->args );
+    pthread_mutex_init( &host->lock, NULL );
+    host->retired[ 0 ] = po_new_descriptor( &host->retired_desc[ 0 ] );
+    host->retired[ 1 ] = po_new_descriptor( &host->retired_desc[ 1 ] );
+    host->epoch = 0;
+    host->retire_mark = 0;
+    memset( host->readers, 0, sizeof( host->readers ) );
+    host->files = po_new_descriptor( &host->files_desc );
+
+    host->conf_active = st_true;
+
+    lg_exit_register( host );
+
+    return host;
+}
+
+
+void lg_host_del( lg_host_t host )
+{
+    void* mem;
+    int   i;
+
+    lg_crash_unregister( host );
+    lg_exit_unregister( host );
+
+    if ( host->watch )
+        lg_watch_del( host->watch );
+
+    if ( host->rotor )
+        lg_rotor_untime( host->rotor );
+
+    mp_each_key( host->grps, lg_host_grp_dup_fn, host );
+
+    if ( host->async )
+        lg_async_del( host->async );
+
+    /* Rotations complete before Logs are deleted. */
+    if ( host->rotor ) {
+        lg_rotor_del( host->rotor );
+        host->rotor = st_nil;
+    }
+
+    mp_each_key( host->grps, lg_host_grp_del_fn, host );
+    mp_each_key( host->logs, lg_host_log_del_fn, st_nil );
+    mp_destroy( host->grps );
+    mp_destroy( host->logs );
+    if ( host->lookup )
+        po_free( host->lookup );
+    lg_trie_del( host->names );
+    if ( host->ring )
+        lg_uring_del( host->ring );
+    lg_fast_del( host->fast );
+    lg_host_rules_clear( host->rules );
+    lg_host_rules_clear( host->file_rules );
+    po_destroy_storage( host->rules );
+    po_destroy_storage( host->file_rules );
+    sl_del( &host->buf );
+    lg_fmt_buf_free( &host->args );
+
+    for ( i = 0; i < 2; i++ ) {
+        po_each( host->retired[ i ], mem, void* )
+        {
+            po_free( mem );
+        }
+        po_destroy_storage( host->retired[ i ] );
+    }
+    po_destroy_storage( host->files );
+    pthread_mutex_destroy( &host->lock );
+
+    po_free( host );
+}
+
+
+void lg_host_async( lg_host_t host, size_t capacity, lg_async_policy_t policy )
+{
+    lg_async_t async;
+    int        i;
+
+    if ( host->async )
+        return;
+
+    async = po_malloc( sizeof( lg_async_s ) );
+    async->queue = lg_queue_new( capacity );
+    async->policy = policy;
+    async->touched = po_new_descriptor( &async->touched_desc );
+    async->host = host;
+    for ( i = 0; i < LG_ASYNC_BATCH; i++ )
+        async->render[ i ] = sl_new( 256 );
+    lg_fmt_buf_init( &async->args );
+    pthread_mutex_init( &async->lock, NULL );
+    pthread_cond_init( &async->wake, NULL );
+    pthread_cond_init( &async->done, NULL );
+    async->sleeping = 0;
+    async->stop = 0;
+    async->consumed = 0;
+    async->dropped = 0;
+
+    host->async = async;
+
+    pthread_create( &async->writer, NULL, lg_async_writer, async );
+}
+
+
+void lg_host_flush( lg_host_t host )
+{
+    mp_each_key( host->grps, lg_host_grp_dup_fn, host );
+
+    if ( host->async )
+        lg_async_drain( host->async );
+
+    mp_each_key( host->logs, lg_host_log_flush_fn, host );
+
+    if ( host->rotor )
+        lg_rotor_sync( host->rotor );
+}
+
+
+/**
+ * Add counters and histogram of shard to Log snapshot.
+ */
+static void lg_log_stats_add_shard( lg_log_stats_t ls, lg_log_t shard )
+{
+    size_t i;
+
+    ls->msgs += __atomic_load_n( &shard->stat_msgs, __ATOMIC_RELAXED );
+    ls->bytes += __atomic_load_n( &shard->stat_bytes, __ATOMIC_RELAXED );
+    ls->writes += __atomic_load_n( &shard->stat_writes, __ATOMIC_RELAXED );
+    ls->errors += __atomic_load_n( &shard->stat_errors, __ATOMIC_RELAXED );
+    for ( i = 0; i < LG_HIST_SIZE; i++ )
+        ls->hist[ i ] += __atomic_load_n( &shard->hist[ i ], __ATOMIC_RELAXED );
+}
+
+
+lg_stats_t lg_host_stats( lg_host_t host )
+{
+    lg_stats_t     stats;
+    lg_grp_stats_t gs;
+    lg_log_stats_t ls;
+    lg_grp_t       grp;
+    lg_log_t       log;
+    po_s           desc;
+    po_t           grps;
+    size_t         i;
+
+    grps = po_new_descriptor( &desc );
+
+    lg_host_lock( host );
+
+    lg_trie_prefix( host->names, "", grps );
+
+    stats = po_malloc( sizeof( lg_stats_s ) );
+    stats->grp_cnt = 0;
+    stats->log_cnt = 0;
+    po_each( grps, grp, lg_grp_t )
+    {
+        stats->grp_cnt++;
+    }
+    po_each( host->files, log, lg_log_t )
+    {
+        stats->log_cnt++;
+    }
+
+    stats->grps = po_malloc( sizeof( lg_grp_stats_s ) * ( stats->grp_cnt + 1 ) );
+    stats->logs = po_malloc( sizeof( lg_log_stats_s ) * ( stats->log_cnt + 1 ) );
+
+    gs = stats->grps;
+    po_each( grps, grp, lg_grp_t )
+    {
+        gs->name = strdup( grp->name );
+        gs->msgs = __atomic_load_n( &grp->stat_msgs, __ATOMIC_RELAXED );
+        gs->inactive = __atomic_load_n( &grp->stat_inactive, __ATOMIC_RELAXED );
+        gs->rejected = __atomic_load_n( &grp->rejected, __ATOMIC_RELAXED );
+        gs++;
+    }
+
+    ls = stats->logs;
+    po_each( host->files, log, lg_log_t )
+    {
+        ls->name = strdup( log->name );
+        ls->msgs = __atomic_load_n( &log->stat_msgs, __ATOMIC_RELAXED );
+        ls->bytes = __atomic_load_n( &log->stat_bytes, __ATOMIC_RELAXED );
+        ls->writes = __atomic_load_n( &log->stat_writes, __ATOMIC_RELAXED );
+        ls->errors = __atomic_load_n( &log->stat_errors, __ATOMIC_RELAXED );
+        for ( i = 0; i < LG_HIST_SIZE; i++ )
+            ls->hist[ i ] = __atomic_load_n( &log->hist[ i ], __ATOMIC_RELAXED );
+        for ( i = 0; i < log->shard_cnt; i++ )
+            lg_log_stats_add_shard( ls, log->shards[ i ] );
+        ls++;
+    }
+
+    lg_host_unlock( host );
+
+    po_destroy_storage( grps );
+
+    return stats;
+}
+
+
+void lg_stats_del( lg_stats_t stats )
+{
+    size_t i;
+
+    for ( i = 0; i < stats->grp_cnt; i++ )
+        po_free( stats->grps[ i ].name );
+    for ( i = 0; i < stats->log_cnt; i++ )
+        po_free( stats->logs[ i ].name );
+
+    po_free( stats->grps );
+    po_free( stats->logs );
+    po_free( stats );
 }
 
 
-static void lg_grp_write_msg( lg_host_t host, lg_grp_t grp, const sl_t msg )
+void lg_host_stats_dump( lg_host_t host, const char* name )
 {
-    (void)host;
+    lg_stats_t     stats;
+    lg_grp_stats_t gs;
+    lg_log_stats_t ls;
+    size_t         i;
+
+    stats = lg_host_stats( host );
+
+    for ( i = 0; i < stats->grp_cnt; i++ ) {
+        gs = &stats->grps[ i ];
+        lg( host,
+            name,
+            "grp %s msgs=%llu inactive=%llu rejected=%llu",
+            gs->name,
+            (unsigned long long)gs->msgs,
+            (unsigned long long)gs->inactive,
+            (unsigned long long)gs->rejected );
+    }
 
-    if ( grp->logs ) {
-        lg_log_t log;
-        po_each( grp->logs, log, lg_log_t )
-        {
-            lg_log_write( log, msg );
-        }
+    for ( i = 0; i < stats->log_cnt; i++ ) {
+        ls = &stats->logs[ i ];
+        lg( host,
+            name,
+            "log %s msgs=%llu bytes=%llu writes=%llu errors=%llu p50=%llu p99=%llu p999=%llu",
+            ls->name,
+            (unsigned long long)ls->msgs,
+            (unsigned long long)ls->bytes,
+            (unsigned long long)ls->writes,
+            (unsigned long long)ls->errors,
+            (unsigned long long)lg_hist_percentile( ls->hist, 50.0 ),
+            (unsigned long long)lg_hist_percentile( ls->hist, 99.0 ),
+            (unsigned long long)lg_hist_percentile( ls->hist, 99.9 ) );
     }
+
+    lg_stats_del( stats );
 }
 
 
-static void lg_grp_write( lg_host_t   host,
-                          lg_grp_t    grp,
-                          int         newline,
-                          const char* format,
-                          va_list     ap )
+int lg_log_buffer( lg_host_t host, const char* filename, lg_buf_policy_t policy, size_t param )
 {
-    lg_grp_fn_p prefix = lg_grp_get_prefix( grp );
-    lg_grp_fn_p postfix = lg_grp_get_postfix( grp );
+    lg_log_t   log;
+    lg_rotor_t rotor;
+    int        locked;
+
+    lg_host_lock( host );
+
+    log = lg_host_find_file( host, filename );
+    if ( log == st_nil ) {
+        log = lg_host_file( host, filename, LG_LOG_TYPE_FILE );
+    } else if ( log->type == LG_LOG_TYPE_MMAP || log->type == LG_LOG_TYPE_RING
+                || log->type == LG_LOG_TYPE_SHARD ) {
+        lg_host_unlock( host );
+        return -1;
+    }
 
-    sl_clear( host->buf );
+    if ( policy == LG_BUF_TIME && param > 0 )
+        __atomic_store_n( &log->shared, 1, __ATOMIC_RELEASE );
 
-    if ( prefix )
-        prefix( host, grp, format, &host->buf );
+    locked = lg_log_lock( host, log );
 
-    sl_va_format( &host->buf, format, ap );
+    if ( log->fd >= 0 )
+        lg_log_drain( log );
 
-    if ( postfix )
-        postfix( host, grp, format, &host->buf );
+    if ( log->obuf ) {
+        po_free( log->obuf );
+        log->obuf = st_nil;
+    }
 
-    if ( newline )
-        sl_append_char( &host->buf, '\n' );
+    /* Next File gets a buffer of the new size. */
+    if ( log->spare_buf ) {
+        po_free( log->spare_buf );
+        log->spare_buf = st_nil;
+    }
 
-    lg_grp_write_msg( host, grp, host->buf );
-}
+    if ( log->ring ) {
+        pthread_mutex_lock( &log->ring->lock );
+        lg_log_uring_wait( log );
+        pthread_mutex_unlock( &log->ring->lock );
+        lg_log_uring_free( log );
+    }
 
+    log->policy = policy;
+    log->osize = LG_BUF_DEFAULT;
 
-static void lg_grp_join_grp_obj( lg_host_t host, lg_grp_t grp, lg_grp_t joinee )
-{
-    (void)host;
+    if ( policy == LG_BUF_SIZE && param > 0 )
+        log->osize = param;
+    else if ( policy == LG_BUF_TIME )
+        log->interval = (uint64_t)param * 1000000;
 
-    if ( grp && joinee ) {
-        lg_log_t log;
-        log = lg_log_new( LG_LOG_TYPE_GRPREF, NULL );
-        log->grp = joinee;
-        po_add( grp->logs, log );
+    if ( log->fd >= 0 && policy != LG_BUF_NONE )
+        log->obuf = po_malloc( log->osize );
+
+    lg_log_unlock( log, locked );
+
+    rotor = st_nil;
+    if ( policy == LG_BUF_TIME && param > 0 ) {
+        if ( host->rotor == st_nil )
+            host->rotor = lg_rotor_new( host );
+        rotor = host->rotor;
     }
-}
 
+    lg_host_unlock( host );
 
-static void lg_grp_attach_sub( lg_host_t host, lg_grp_t top, lg_grp_t sub )
-{
-    (void)host;
+    if ( rotor )
+        lg_rotor_time( rotor, rotor->timed, log, (uint64_t)param * 1000000 );
 
-    po_add( top->subs, sub );
-    sub->top = top;
+    return 0;
 }
 
 
-static void lg_grp_detach_sub( lg_host_t host, lg_grp_t top, lg_grp_t sub )
+void lg_log_encoding( lg_host_t host, const char* filename, lg_enc_t enc )
 {
-    po_pos_t idx;
+    lg_log_t log;
 
-    (void)host;
+    lg_host_lock( host );
 
-    idx = po_find( top->subs, sub );
-    if ( idx != PO_NOT_INDEX ) {
-        po_delete_at( top->subs, idx );
-        sub->top = st_nil;
-    }
-}
+    log = lg_host_find_file( host, filename );
+    if ( log == st_nil )
+        log = lg_host_file( host, filename, LG_LOG_TYPE_FILE );
+    __atomic_store_n( &log->enc, enc, __ATOMIC_RELAXED );
 
+    lg_host_unlock( host );
+}
 
 
+void lg_log_ring( lg_host_t host, const char* filename, size_t size )
+{
+    lg_log_t log;
 
-/* ------------------------------------------------------------
- * Callback functions:
- */
+    lg_host_lock( host );
 
-static void lg_host_grp_del_fn( po_d key, po_d value, void* arg )
-{
-    (void)key;
-    (void)arg;
+    log = lg_host_file( host, filename, LG_LOG_TYPE_RING );
+    if ( log->fd < 0 && size > 0 )
+        log->msize = size;
 
-    lg_grp_t grp = (lg_grp_t)value;
-    lg_grp_del( grp );
+    lg_host_unlock( host );
 }
 
 
-static void lg_host_log_del_fn( po_d key, po_d value, void* arg )
+void lg_log_shard( lg_host_t host, const char* filename, uint32_t cnt )
 {
-    (void)key;
-    (void)arg;
+    lg_log_t log;
 
-    lg_log_t log = (lg_log_t)value;
-    lg_log_del( log );
+    lg_host_lock( host );
+
+    log = lg_host_file( host, filename, LG_LOG_TYPE_SHARD );
+    if ( __atomic_load_n( &log->seq, __ATOMIC_RELAXED ) == 0 )
+        lg_log_shard_init( log, cnt );
+
+    lg_host_unlock( host );
 }
 
 
+int lg_log_rotate( lg_host_t   host,
+                   const char* filename,
+                   size_t      size,
+                   uint32_t    interval,
+                   uint32_t    keep,
+                   st_bool_t   compress )
+{
+    lg_log_t log;
+    int      locked;
 
+    lg_host_lock( host );
 
-/* ------------------------------------------------------------
- * User API:
- */
+    log = lg_host_find_file( host, filename );
+    if ( log == st_nil ) {
+        log = lg_host_file( host, filename, LG_LOG_TYPE_FILE );
+    } else if ( log->type != LG_LOG_TYPE_FILE && log->type != LG_LOG_TYPE_MMAP ) {
+        lg_host_unlock( host );
+        return -1;
+    }
 
+    if ( host->rotor == st_nil )
+        host->rotor = lg_rotor_new( host );
 
-lg_host_t lg_host_new( st_t data )
-{
-    lg_host_t host;
+    /* Worker swaps Files under Log lock. */
+    __atomic_store_n( &log->shared, 1, __ATOMIC_RELEASE );
 
-    host = po_malloc( sizeof( lg_host_s ) );
-    host->data = data;
-    host->grps = mp_new_full( NULL, mp_key_hash_cstr, mp_key_comp_cstr, 16, 50 );
-    host->logs = mp_new_full( NULL, mp_key_hash_cstr, mp_key_comp_cstr, 16, 50 );
-    host->buf = sl_new( PATH_MAX + 16 );
+    locked = lg_log_lock( host, log );
 
-    host->disabled = st_false;
+    if ( log->rotor == st_nil ) {
+        log->rot_seq = lg_log_segment_last( log );
+        lg_rotor_put( host->rotor, lg_rotor_job_new( log ) );
+    }
 
-    host->conf_active = st_true;
+    log->rot_size = size;
+    log->rot_interval = (uint64_t)interval * 1000000000;
+    log->rot_keep = keep;
+    log->rot_compress = compress;
+    log->rotor = host->rotor;
 
-    return host;
+    lg_log_unlock( log, locked );
+
+    lg_host_unlock( host );
+
+    return 0;
 }
 
 
-void lg_host_del( lg_host_t host )
+uint64_t lg_host_dropped( lg_host_t host )
 {
-    mp_each_key( host->grps, lg_host_grp_del_fn, st_nil );
-    mp_each_key( host->logs, lg_host_log_del_fn, st_nil );
-    mp_destroy( host->grps );
-    mp_destroy( host->logs );
-    sl_del( &host->buf );
-    po_free( host );
+    if ( host->async )
+        return __atomic_load_n( &host->async->dropped, __ATOMIC_RELAXED );
+    else
+        return 0;
 }
 
 
@@ -406,13 +4356,93 @@ st_t lg_host_data( lg_host_t host )
 
 void lg_host_y( lg_host_t host )
 {
-    host->disabled = st_false;
+    lg_host_lock( host );
+    __atomic_store_n( &host->disabled, st_false, __ATOMIC_RELAXED );
+    mp_each_key( host->grps, lg_host_grp_update_fn, host );
+    lg_host_unlock( host );
 }
 
 
 void lg_host_n( lg_host_t host )
 {
-    host->disabled = st_true;
+    lg_host_lock( host );
+    __atomic_store_n( &host->disabled, st_true, __ATOMIC_RELAXED );
+    mp_each_key( host->grps, lg_host_grp_update_fn, host );
+    lg_host_unlock( host );
+}
+
+
+int lg_host_rules( lg_host_t host, const char* rules )
+{
+    int cnt;
+
+    lg_host_lock( host );
+    cnt = lg_host_rules_apply( host, rules, host->rules );
+    lg_host_unlock( host );
+
+    return cnt;
+}
+
+
+int lg_host_rules_env( lg_host_t host, const char* var )
+{
+    const char* rules;
+
+    rules = getenv( var );
+    if ( rules == NULL )
+        return 0;
+
+    return lg_host_rules( host, rules );
+}
+
+
+int lg_host_watch( lg_host_t host, const char* path )
+{
+    lg_watch_t  watch;
+    char*       dir;
+    const char* base;
+
+    lg_assert( host->watch == st_nil ); // GCOV_EXCL_LINE
+    lg_assert( host->threaded );        // GCOV_EXCL_LINE
+
+    watch = po_malloc( sizeof( lg_watch_s ) );
+    watch->path = strdup( path );
+    base = strrchr( watch->path, '/' );
+    if ( base ) {
+        dir = strndup( watch->path, base - watch->path + 1 );
+        watch->base = (char*)base + 1;
+    } else {
+        dir = strdup( "." );
+        watch->base = watch->path;
+    }
+
+    watch->ifd = inotify_init1( IN_CLOEXEC );
+    if ( watch->ifd < 0 || inotify_add_watch( watch->ifd, dir, IN_CLOSE_WRITE | IN_MOVED_TO ) < 0
+         || pipe( watch->stop ) < 0 ) {
+        if ( watch->ifd >= 0 )
+            close( watch->ifd );
+        po_free( dir );
+        po_free( watch->path );
+        po_free( watch );
+        return -1;
+    }
+    po_free( dir );
+
+    host->watch = watch;
+
+    lg_watch_load( host, path );
+
+    if ( pthread_create( &watch->thread, NULL, lg_watch_worker, host ) != 0 ) {
+        host->watch = st_nil;
+        close( watch->ifd );
+        close( watch->stop[ 0 ] );
+        close( watch->stop[ 1 ] );
+        po_free( watch->path );
+        po_free( watch );
+        return -1;
+    }
+
+    return 0;
 }
 
 
@@ -421,6 +4451,34 @@ void lg_host_config( lg_host_t host, const char* config, st_bool_t value )
     if ( 0 ) {
     } else if ( !strcmp( config, "active" ) ) {
         host->conf_active = value;
+    } else if ( !strcmp( config, "threaded" ) ) {
+        host->threaded = value;
+    } else if ( !strcmp( config, "crashflush" ) ) {
+        if ( value )
+            lg_crash_register( host );
+        else
+            lg_crash_unregister( host );
+    } else if ( !strcmp( config, "fastfmt" ) ) {
+        host->fastfmt = value;
+    } else if ( !strcmp( config, "stats" ) ) {
+        host->stats = value;
+    } else if ( !strcmp( config, "uring" ) ) {
+        lg_uring_t ring;
+        /* Rotations in progress use the current Ring. */
+        if ( host->rotor )
+            lg_rotor_sync( host->rotor );
+        lg_host_lock( host );
+        ring = host->ring;
+        if ( value && ring == st_nil ) {
+            host->ring = lg_uring_new( LG_URING_ENTRIES );
+            if ( host->ring )
+                mp_each_key( host->logs, lg_host_log_ring_fn, host );
+        } else if ( !value && ring ) {
+            host->ring = st_nil;
+            mp_each_key( host->logs, lg_host_log_ring_fn, host );
+            lg_uring_del( ring );
+        }
+        lg_host_unlock( host );
     } else {
     }
 }
@@ -434,13 +4492,17 @@ lg_grp_t lg_grp_top( lg_host_t   host,
 {
     lg_grp_t grp;
 
+    lg_host_lock( host );
+
     grp = lg_grp_new( host, LG_GRP_TYPE_TOP, name );
 
     if ( filename )
-        po_add( grp->logs, lg_log_new_file( host, filename ) );
+        lg_grp_add_file( host, grp, filename, LG_LOG_TYPE_FILE );
 
-    grp->prefix = prefix;
-    grp->postfix = postfix;
+    lg_grp_set_fix( host, grp, prefix, st_nil, st_nil, 1 );
+    lg_grp_set_fix( host, grp, postfix, st_nil, st_nil, 0 );
+
+    lg_host_unlock( host );
 
     return grp;
 }
@@ -451,6 +4513,8 @@ lg_grp_t lg_grp_sub( lg_host_t host, const char* topname, const char* name )
     lg_grp_t grp;
     lg_grp_t top;
 
+    lg_host_lock( host );
+
     top = lg_host_get_grp( host, topname );
 
     sl_clear( host->buf );
@@ -460,6 +4524,8 @@ lg_grp_t lg_grp_sub( lg_host_t host, const char* topname, const char* name )
     lg_grp_attach_sub( host, top, grp );
     lg_grp_join_grp_obj( host, grp, top );
 
+    lg_host_unlock( host );
+
     return grp;
 }
 
@@ -468,10 +4534,14 @@ lg_grp_t lg_grp_log( lg_host_t host, const char* name, const char* filename )
 {
     lg_grp_t grp;
 
+    lg_host_lock( host );
+
     grp = lg_grp_new( host, LG_GRP_TYPE_GRP, name );
 
     if ( filename )
-        po_add( grp->logs, lg_log_new_file( host, filename ) );
+        lg_grp_add_file( host, grp, filename, LG_LOG_TYPE_FILE );
+
+    lg_host_unlock( host );
 
     return grp;
 }
@@ -479,31 +4549,224 @@ lg_grp_t lg_grp_log( lg_host_t host, const char* name, const char* filename )
 
 void lg_grp_prefix( lg_host_t host, const char* name, lg_grp_fn_p prefix )
 {
-    lg_host_get_grp( host, name )->prefix = prefix;
+    lg_host_lock( host );
+    lg_grp_set_fix( host, lg_host_get_grp( host, name ), prefix, st_nil, st_nil, 1 );
+    lg_host_unlock( host );
 }
 
 
 void lg_grp_postfix( lg_host_t host, const char* name, lg_grp_fn_p postfix )
 {
-    lg_host_get_grp( host, name )->postfix = postfix;
+    lg_host_lock( host );
+    lg_grp_set_fix( host, lg_host_get_grp( host, name ), postfix, st_nil, st_nil, 0 );
+    lg_host_unlock( host );
+}
+
+
+void lg_grp_prefix_str( lg_host_t host, const char* name, const char* prefix )
+{
+    lg_host_lock( host );
+    lg_grp_set_fix( host, lg_host_get_grp( host, name ), st_nil, prefix, st_nil, 1 );
+    lg_host_unlock( host );
+}
+
+
+void lg_grp_postfix_str( lg_host_t host, const char* name, const char* postfix )
+{
+    lg_host_lock( host );
+    lg_grp_set_fix( host, lg_host_get_grp( host, name ), st_nil, postfix, st_nil, 0 );
+    lg_host_unlock( host );
+}
+
+
+void lg_grp_prefix_pat( lg_host_t host, const char* name, const char* pattern )
+{
+    lg_host_lock( host );
+    lg_grp_set_fix( host, lg_host_get_grp( host, name ), st_nil, st_nil, pattern, 1 );
+    lg_host_unlock( host );
+}
+
+
+void lg_grp_postfix_pat( lg_host_t host, const char* name, const char* pattern )
+{
+    lg_host_lock( host );
+    lg_grp_set_fix( host, lg_host_get_grp( host, name ), st_nil, st_nil, pattern, 0 );
+    lg_host_unlock( host );
+}
+
+
+void lg_grp_deferred( lg_host_t host, const char* name, st_bool_t deferred )
+{
+    lg_host_lock( host );
+    lg_host_get_grp( host, name )->deferred = deferred;
+    lg_host_unlock( host );
+}
+
+
+void lg_grp_coalesce( lg_host_t   host,
+                      const char* name,
+                      st_bool_t   coalesce,
+                      uint32_t    timeout_ms )
+{
+    lg_grp_t   grp;
+    lg_rotor_t rotor;
+
+    grp = lg_host_find_grp( host, name );
+    lg_grp_dup_flush( host, grp );
+
+    lg_host_lock( host );
+
+    /* State is kept when disabled, since writers may still use it. */
+    if ( grp->dup == st_nil )
+        grp->dup = lg_dup_new( 0 );
+
+    pthread_mutex_lock( &grp->dup->lock );
+    grp->dup->timeout = (uint64_t)timeout_ms * 1000000;
+    grp->dup->hash = 0;
+    __atomic_store_n( &grp->dup->cnt, 0, __ATOMIC_RELAXED );
+    sl_clear( grp->dup->last );
+    pthread_mutex_unlock( &grp->dup->lock );
+
+    grp->coalesce = coalesce;
+
+    /* Summaries are timer driven only in threaded Host, since the
+     * background thread writes them to Files. */
+    rotor = st_nil;
+    if ( coalesce && timeout_ms > 0 && host->threaded ) {
+        if ( host->rotor == st_nil )
+            host->rotor = lg_rotor_new( host );
+        rotor = host->rotor;
+    }
+
+    lg_host_unlock( host );
+
+    if ( rotor )
+        lg_rotor_time( rotor, rotor->dups, grp, (uint64_t)timeout_ms * 1000000 );
+}
+
+
+void lg_grp_limit( lg_host_t host, const char* name, uint32_t rate, uint32_t burst )
+{
+    lg_grp_t grp;
+    uint64_t ns;
+
+    lg_host_lock( host );
+
+    grp = lg_host_get_grp( host, name );
+
+    if ( rate ) {
+        if ( burst == 0 )
+            burst = 1;
+        /* Zero would mean unlimited. */
+        ns = 1000000000 / rate;
+        if ( ns == 0 )
+            ns = 1;
+        grp->limit_tat = 0;
+        grp->limit_tau = ( burst - 1 ) * ns;
+        __atomic_store_n( &grp->limit_ns, ns, __ATOMIC_RELAXED );
+    } else {
+        __atomic_store_n( &grp->limit_ns, 0, __ATOMIC_RELAXED );
+    }
+
+    __atomic_store_n( &grp->throttled, ( grp->limit_ns || grp->sample > 1 ), __ATOMIC_RELEASE );
+
+    lg_host_unlock( host );
+}
+
+
+void lg_grp_sample( lg_host_t host, const char* name, uint32_t n )
+{
+    lg_grp_t grp;
+
+    lg_host_lock( host );
+
+    grp = lg_host_get_grp( host, name );
+    __atomic_store_n( &grp->sample, n, __ATOMIC_RELAXED );
+    __atomic_store_n( &grp->throttled, ( grp->limit_ns || grp->sample > 1 ), __ATOMIC_RELEASE );
+
+    lg_host_unlock( host );
+}
+
+
+uint64_t lg_grp_rejected( lg_host_t host, const char* name )
+{
+    return __atomic_load_n( &lg_host_get_grp( host, name )->rejected, __ATOMIC_RELAXED );
 }
 
 
 void lg_grp_y( lg_host_t host, const char* name )
 {
-    lg_grp_enable( lg_host_get_grp( host, name ) );
+    lg_host_lock( host );
+    lg_grp_enable( host, lg_host_get_grp( host, name ) );
+    lg_host_unlock( host );
 }
 
 
 void lg_grp_n( lg_host_t host, const char* name )
 {
-    lg_grp_disable( lg_host_get_grp( host, name ) );
+    lg_host_lock( host );
+    lg_grp_disable( host, lg_host_get_grp( host, name ) );
+    lg_host_unlock( host );
+}
+
+
+void lg_grp_y_glob( lg_host_t host, const char* pattern )
+{
+    lg_host_lock( host );
+    lg_host_set_grps( host, pattern, lg_grp_enable );
+    lg_host_unlock( host );
+}
+
+
+void lg_grp_n_glob( lg_host_t host, const char* pattern )
+{
+    lg_host_lock( host );
+    lg_host_set_grps( host, pattern, lg_grp_disable );
+    lg_host_unlock( host );
+}
+
+
+size_t lg_grp_each( lg_host_t host, const char* pattern, lg_grp_each_fn_p fn, void* arg )
+{
+    po_s   desc;
+    po_t   grps;
+    size_t cnt;
+
+    grps = po_new_descriptor( &desc );
+
+    lg_host_lock( host );
+    cnt = lg_trie_glob( host->names, pattern, grps );
+    lg_host_unlock( host );
+
+    lg_host_each_grp( host, grps, fn, arg );
+
+    return cnt;
+}
+
+
+size_t lg_grp_each_prefix( lg_host_t host, const char* prefix, lg_grp_each_fn_p fn, void* arg )
+{
+    po_s   desc;
+    po_t   grps;
+    size_t cnt;
+
+    grps = po_new_descriptor( &desc );
+
+    lg_host_lock( host );
+    cnt = lg_trie_prefix( host->names, prefix, grps );
+    lg_host_unlock( host );
+
+    lg_host_each_grp( host, grps, fn, arg );
+
+    return cnt;
 }
 
 
 void lg_grp_join_grp( lg_host_t host, const char* name, const char* joinee )
 {
+    lg_host_lock( host );
     lg_grp_join_grp_obj( host, lg_host_get_grp( host, name ), lg_host_get_grp( host, joinee ) );
+    lg_host_unlock( host );
 }
 
 
@@ -511,10 +4774,32 @@ void lg_grp_join_file( lg_host_t host, const char* name, const char* joinee )
 {
     lg_grp_t grp;
 
+    lg_host_lock( host );
+
+    grp = lg_host_get_grp( host, name );
+    if ( joinee ) {
+        lg_grp_add_file( host, grp, joinee, LG_LOG_TYPE_FILE );
+    }
+
+    lg_host_unlock( host );
+}
+
+
+void lg_grp_join_file_type( lg_host_t     host,
+                            const char*   name,
+                            const char*   joinee,
+                            lg_log_type_t type )
+{
+    lg_grp_t grp;
+
+    lg_host_lock( host );
+
     grp = lg_host_get_grp( host, name );
     if ( joinee ) {
-        po_add( grp->logs, lg_log_new_file( host, joinee ) );
+        lg_grp_add_file( host, grp, joinee, type );
     }
+
+    lg_host_unlock( host );
 }
 
 
@@ -523,14 +4808,18 @@ void lg_grp_merge_grp( lg_host_t host, const char* name, const char* joinee )
     lg_grp_t grp;
     lg_grp_t join_to;
 
+    lg_host_lock( host );
+
     grp = lg_host_get_grp( host, name );
     join_to = lg_host_get_grp( host, joinee );
 
     if ( grp == join_to )
         lg_assert( 0 ); // GCOV_EXCL_LINE
 
-    lg_grp_del_logs( grp );
+    lg_grp_del_logs( host, grp );
     lg_grp_join_grp_obj( host, grp, join_to );
+
+    lg_host_unlock( host );
 }
 
 
@@ -538,55 +4827,149 @@ void lg_grp_merge_file( lg_host_t host, const char* name, const char* joinee )
 {
     lg_grp_t grp;
 
+    lg_host_lock( host );
+
     grp = lg_host_get_grp( host, name );
 
-    lg_grp_del_logs( grp );
+    lg_grp_del_logs( host, grp );
 
     if ( joinee ) {
-        po_add( grp->logs, lg_log_new_file( host, joinee ) );
+        lg_grp_add_file( host, grp, joinee, LG_LOG_TYPE_FILE );
     }
+
+    lg_host_unlock( host );
 }
 
 
 void lg_grp_attach( lg_host_t host, const char* top, const char* name )
 {
+    lg_host_lock( host );
     lg_grp_attach_sub( host, lg_host_get_grp( host, top ), lg_host_get_grp( host, name ) );
+    lg_host_unlock( host );
 }
 
 
 void lg_grp_detach( lg_host_t host, const char* top, const char* name )
 {
+    lg_host_lock( host );
     lg_grp_detach_sub( host, lg_host_get_grp( host, top ), lg_host_get_grp( host, name ) );
+    lg_host_unlock( host );
 }
 
 
-void lg( lg_host_t host, const char* name, const char* format, ... )
+void lg_grp_flush( lg_host_t host, const char* name )
 {
-    va_list ap;
+    lg_grp_t  grp;
+    lg_plan_t plan;
+    size_t    i;
+    int       parity;
+
+    grp = lg_host_find_grp( host, name );
+    lg_grp_dup_flush( host, grp );
+
+    if ( host->async )
+        lg_async_drain( host->async );
+
+    parity = lg_host_enter( host );
+    plan = lg_grp_plan( host, grp );
+    for ( i = 0; i < plan->cnt + plan->bin_cnt; i++ )
+        lg_log_flush( host, plan->logs[ i ] );
+    lg_host_exit( host, parity );
+}
+
+
+lg_grp_t lg_grp_get( lg_host_t host, const char* name )
+{
+    return lg_host_find_grp( host, name );
+}
 
+
+void lg( lg_host_t host, const char* name, const char* format, ... )
+{
+    va_list  ap;
     lg_grp_t grp;
-    grp = lg_host_get_grp( host, name );
 
-    if ( !host->disabled && grp->active ) {
+    if ( !lg_host_on( host ) )
+        return;
+
+    grp = lg_host_find_grp( host, name );
+
+    if ( lg_grp_on( host, grp ) ) {
         va_start( ap, format );
         lg_grp_write( host, grp, 1, format, ap );
         va_end( ap );
+    } else if ( host->stats ) {
+        lg_stat_add( &grp->stat_inactive, 1 );
     }
 }
 
 
 void lgw( lg_host_t host, const char* name, const char* format, ... )
 {
-    va_list ap;
-
+    va_list  ap;
     lg_grp_t grp;
-    grp = lg_host_get_grp( host, name );
 
-    if ( !host->disabled && grp->active ) {
+    if ( !lg_host_on( host ) )
+        return;
+
+    grp = lg_host_find_grp( host, name );
+
+    if ( lg_grp_on( host, grp ) ) {
         va_start( ap, format );
         lg_grp_write( host, grp, 0, format, ap );
         va_end( ap );
+    } else if ( host->stats ) {
+        lg_stat_add( &grp->stat_inactive, 1 );
+    }
+}
+
+
+void lg_h( lg_host_t host, lg_grp_t grp, const char* format, ... )
+{
+    va_list ap;
+
+    if ( !lg_grp_on( host, grp ) ) {
+        if ( host->stats )
+            lg_stat_add( &grp->stat_inactive, 1 );
+        return;
     }
+
+    va_start( ap, format );
+    lg_grp_write( host, grp, 1, format, ap );
+    va_end( ap );
+}
+
+
+void lgw_h( lg_host_t host, lg_grp_t grp, const char* format, ... )
+{
+    va_list ap;
+
+    if ( !lg_grp_on( host, grp ) ) {
+        if ( host->stats )
+            lg_stat_add( &grp->stat_inactive, 1 );
+        return;
+    }
+
+    va_start( ap, format );
+    lg_grp_write( host, grp, 0, format, ap );
+    va_end( ap );
+}
+
+
+void lg_kv_h( lg_host_t host, lg_grp_t grp, const char* msg, const lg_kv_s* kv, size_t cnt )
+{
+    int parity;
+
+    if ( !lg_grp_on( host, grp ) ) {
+        if ( host->stats )
+            lg_stat_add( &grp->stat_inactive, 1 );
+        return;
+    }
+
+    parity = lg_host_enter( host );
+    if ( lg_grp_accept( host, grp ) )
+        lg_grp_kv_output( host, grp, msg, kv, cnt );
+    lg_host_exit( host, parity );
 }
 
 
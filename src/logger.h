@@ -12,12 +12,24 @@
 
 
 
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
 #include <sixten.h>
 // #include <gromer.h>
 #include <postor.h>
 #include <mapper.h>
 #include <slinky.h>
 
+#include "lg_queue.h"
+#include "lg_fmt.h"
+#include "lg_uring.h"
+#include "lg_pat.h"
+#include "lg_fast.h"
+#include "lg_trie.h"
+#include "lg_hist.h"
+#include "lg_kv.h"
+
 
 #ifndef LOGGER_NO_ASSERT
 #include <assert.h>
@@ -29,25 +41,213 @@
 #endif
 
 
+/** Async overload policy. */
+st_enum( lg_async_policy ){ LG_ASYNC_BLOCK = 0, LG_ASYNC_DROP_NEWEST, LG_ASYNC_DROP_OLDEST };
+
+/** Number of messages written by async writer at once. */
+#define LG_ASYNC_BATCH 64
+
+st_struct_type( lg_host );
+
+st_struct( lg_async )
+{
+    lg_queue_t        queue;        /**< Message queue. */
+    lg_async_policy_t policy;       /**< Overload policy. */
+    pthread_t         writer;       /**< Writer thread. */
+    pthread_mutex_t   lock;         /**< Lock for conditions. */
+    pthread_cond_t    wake;         /**< Writer wakeup. */
+    pthread_cond_t    done;         /**< Batch written. */
+    int               sleeping;     /**< Writer is waiting. */
+    int               stop;         /**< Writer stop request. */
+    uint64_t          consumed;     /**< Messages taken from queue. */
+    uint64_t          dropped;      /**< Messages dropped on overload. */
+    po_s              touched_desc; /**< Postor descriptor for touched. */
+    po_t              touched;      /**< Logs written in batch. */
+    lg_host_t         host;         /**< Host of writer. */
+    sl_t              render[ LG_ASYNC_BATCH ]; /**< Deferred message buffers. */
+    lg_fmt_buf_s      args;         /**< Deferred render buffer. */
+};
+
+
+st_struct_type( lg_log );
+st_struct_type( lg_rotor_job );
+
+/** Rotation job for background thread. */
+st_struct( lg_rotor_job )
+{
+    char*          path;     /**< Rotated segment (or NULL). */
+    int            compress; /**< Compress segment. */
+    char*          expired;  /**< Segment to remove (or NULL). */
+    lg_log_t       log;      /**< Log to prepare next File for (or NULL). */
+    uint32_t       seq;      /**< Segment number of rotated File. */
+    uint32_t       keep;     /**< Segments to keep (0 for all). */
+    int            old_fd;   /**< Rotated File (-1 if none). */
+    char*          old_map;  /**< Mapping of rotated File (or NULL). */
+    size_t         old_mlen; /**< Mapping used. */
+    size_t         old_msize; /**< Mapping size. */
+    char*          obuf;     /**< Buffered data of rotated File (or NULL). */
+    size_t         olen;     /**< Buffered data length. */
+    lg_rotor_job_t next;     /**< Next job. */
+};
+
+
+/** Background thread for rotated segments, timed flushes and repeat summaries. */
+st_struct( lg_rotor )
+{
+    pthread_t       thread; /**< Worker thread. */
+    pthread_mutex_t lock;   /**< Lock for jobs. */
+    pthread_cond_t  wake;   /**< Worker wakeup. */
+    int             stop;   /**< Worker stop request. */
+    lg_rotor_job_t  head;   /**< First job. */
+    lg_rotor_job_t  tail;   /**< Last job. */
+    int             busy;   /**< Job is being run. */
+    pthread_cond_t  idle;   /**< Jobs completed. */
+    pthread_mutex_t tick_lock; /**< Lock for timed Logs (held while flushing). */
+    po_s            timed_desc; /**< Postor descriptor for timed. */
+    po_t            timed;  /**< Logs with LG_BUF_TIME policy. */
+    uint64_t        tick;   /**< Flush check interval in ns (0 for none). */
+    uint64_t        due;    /**< Time of next flush check in ns. */
+    po_s            dups_desc; /**< Postor descriptor for dups. */
+    po_t            dups;   /**< Coalescing Groups with timeout. */
+    lg_host_t       host;   /**< Host. */
+};
+
+
+/** Group state rule ("pattern=y/n"). */
+st_struct( lg_rule )
+{
+    char*     pattern; /**< Group name pattern. */
+    st_bool_t value;   /**< Enable or disable. */
+    st_bool_t glob;    /**< Pattern has glob characters. */
+};
+
+
+/** Watcher thread for rules file. */
+st_struct( lg_watch )
+{
+    pthread_t thread; /**< Watcher thread. */
+    int       ifd;    /**< inotify descriptor. */
+    int       stop[ 2 ]; /**< Stop pipe. */
+    char*     path;   /**< Rules file. */
+    char*     base;   /**< Rules file name without directory. */
+};
+
+
+/** Reader slots for reclamation of retired memory. */
+#define LG_READERS 64
+
+/** Reader counts of threads mapped to slot (one cache line). */
+st_struct( lg_reader )
+{
+    uint64_t cnt[ 2 ];  /**< Active readers per epoch parity. */
+    char     pad[ 48 ]; /**< Padding to cache line. */
+};
+
+
+st_struct_type( lg_grp );
+
+
+/** Group name table entry. */
+st_struct( lg_name )
+{
+    uint64_t hash; /**< Name hash. */
+    lg_grp_t grp;  /**< Group (or NULL for free entry). */
+};
+
+
+/**
+ * Group name table for lookups without Host lock. Entries are only
+ * added to free slots, and full table is replaced with a larger copy
+ * and retired.
+ */
+st_struct( lg_names )
+{
+    size_t    mask;    /**< Entry count - 1. */
+    size_t    cnt;     /**< Used entries. */
+    lg_name_s ents[];  /**< Entries. */
+};
+
+
 st_struct( lg_host )
 {
     st_t      data;        /**< User data. */
     mp_t      grps;        /**< Logger Groups. */
+    lg_names_t lookup;     /**< Group name table (read without lock). */
+    lg_trie_t names;       /**< Group name index. */
     mp_t      logs;        /**< Logger Logs. */
     st_bool_t disabled;    /**< Silence Host. */
     sl_t      buf;         /**< String building buffer. */
     st_bool_t conf_active; /**< Config: active. */
+    uint64_t  gen;         /**< Configuration generation. */
+    st_bool_t threaded;    /**< Config: threaded. */
+    pthread_mutex_t lock;  /**< Configuration lock (threaded). */
+    po_s      retired_desc[ 2 ]; /**< Postor descriptors for retired. */
+    po_t      retired[ 2 ]; /**< Replaced plans and strings per epoch parity. */
+    uint64_t  epoch;       /**< Reclamation epoch. */
+    uint64_t  retire_mark; /**< Async messages claimed at last epoch change. */
+    lg_reader_s readers[ LG_READERS ]; /**< Reader counts (threaded). */
+    po_s      files_desc;  /**< Postor descriptor for files. */
+    po_t      files;       /**< Terminal Logs (for crash flush). */
+    lg_async_t async;      /**< Async writer (or NULL). */
+    lg_uring_t ring;       /**< io_uring for File writes (or NULL). */
+    lg_rotor_t rotor;      /**< Rotation worker (or NULL). */
+    po_s      rules_desc;  /**< Postor descriptor for rules. */
+    po_t      rules;       /**< Group state rules (from lg_host_rules()). */
+    po_s      file_rules_desc; /**< Postor descriptor for file rules. */
+    po_t      file_rules;  /**< Group state rules from watched file. */
+    lg_watch_t watch;      /**< Rules file watcher (or NULL). */
+    lg_fast_t fast;        /**< Fast formatter cache. */
+    st_bool_t fastfmt;     /**< Config: fastfmt. */
+    st_bool_t stats;       /**< Config: stats. */
+    lg_fmt_buf_s args;     /**< Argument capture buffer. */
+    lg_host_t exit_next;   /**< Next Host flushed at exit. */
 };
 
 
-st_struct_type( lg_grp );
-st_struct_type( lg_log );
-
 st_enum( lg_log_type ){ LG_LOG_TYPE_NONE = 0,
                         LG_LOG_TYPE_FILE,
                         LG_LOG_TYPE_STDOUT,
                         LG_LOG_TYPE_GRPREF,
-                        LG_LOG_TYPE_LOGREF };
+                        LG_LOG_TYPE_LOGREF,
+                        LG_LOG_TYPE_BIN,
+                        LG_LOG_TYPE_MMAP,
+                        LG_LOG_TYPE_RING,
+                        LG_LOG_TYPE_SHARD };
+
+/** Log buffering policy. */
+st_enum( lg_buf_policy ){ LG_BUF_NONE = 0, LG_BUF_LINE, LG_BUF_SIZE, LG_BUF_TIME };
+
+/** Default Log buffer size. */
+#define LG_BUF_DEFAULT 65536
+
+/** Preallocation chunk for LG_LOG_TYPE_MMAP. */
+#define LG_MMAP_CHUNK ( 4 * 1024 * 1024 )
+
+/** Maximum number of Hosts with "crashflush". */
+#define LG_CRASH_HOSTS 16
+
+/** Alternate signal stack size for "crashflush". */
+#define LG_CRASH_STACK 65536
+
+/** Format id cache slots (LG_LOG_TYPE_BIN). */
+#define LG_BIN_CACHE 64
+
+/** Default data size for LG_LOG_TYPE_RING. */
+#define LG_RING_SIZE ( 16 * 1024 * 1024 )
+
+/** Buffers in flight per Log (Ring). */
+#define LG_URING_BUFS 4
+
+/** Buffer in flight (Ring). */
+st_struct( lg_ubuf )
+{
+    lg_log_t log;  /**< Owner Log. */
+    char*    data; /**< Data (or NULL). */
+    size_t   len;  /**< Data length. */
+    uint64_t off;  /**< File offset. */
+    int      busy; /**< Write in flight. */
+    int      fd;   /**< File descriptor of write. */
+};
 
 st_struct( lg_log )
 {
@@ -55,13 +255,91 @@ st_struct( lg_log )
     char*         name; /**< Log file name ("<stdout>" for STDOUT). */
     union
     {
-        FILE*    fh;  /**< File handle (LG_LOG_TYPE_FILE/LG_LOG_TYPE_STDOUT). */
         lg_grp_t grp; /**< Grp reference (LG_LOG_TYPE_GRPREF). */
         lg_log_t log; /**< Grp reference (LG_LOG_TYPE_LOGREF). */
     };
+    int             fd;       /**< File descriptor (-1 if not open). */
+    lg_buf_policy_t policy;   /**< Buffering policy. */
+    char*           obuf;     /**< Output buffer. */
+    size_t          olen;     /**< Output buffer used. */
+    size_t          osize;    /**< Output buffer size. */
+    uint64_t        interval; /**< Flush interval in ns (LG_BUF_TIME). */
+    uint64_t        flushed;  /**< Time of last flush in ns. */
+    int             shared;   /**< Used by Rotor, locked on each write. */
+    char*           map;      /**< File mapping (LG_LOG_TYPE_MMAP/RING). */
+    size_t          mlen;     /**< Mapping used (LG_LOG_TYPE_MMAP). */
+    size_t          msize;    /**< Mapping size (MMAP), data size (RING). */
+    lg_uring_t      ring;     /**< Host Ring (or NULL). */
+    uint64_t        off;      /**< File offset (Ring). */
+    lg_ubuf_s       ubufs[ LG_URING_BUFS ]; /**< Buffers (Ring). */
+    int             ubusy;    /**< Buffers in flight (Ring). */
+    uint64_t        size;     /**< Bytes logged to current File. */
+    uint64_t        rot_size; /**< Rotation size (or 0). */
+    uint64_t        rot_interval; /**< Rotation interval in ns (or 0). */
+    uint64_t        rot_start; /**< Current File start time in ns. */
+    uint32_t        rot_keep; /**< Rotated segments to keep (0 for all). */
+    uint32_t        rot_seq;  /**< Last rotated segment number. */
+    int             rot_compress; /**< Compress rotated segments. */
+    lg_rotor_t      rotor;    /**< Rotation worker (or NULL). */
+    int             spare_fd; /**< Next File from Rotor (-1 if not ready). */
+    char*           spare_map; /**< Mapping of next File (or NULL). */
+    char*           spare_buf; /**< Output buffer for next File (or NULL). */
+    pthread_cond_t  spare_ready; /**< Next File is ready. */
+    pthread_mutex_t lock; /**< Write lock (threaded). */
+    struct iovec*   iov;  /**< Async write vector. */
+    int             iovcnt; /**< Async write vector count. */
+    uint64_t        seq;  /**< Message sequence (LG_LOG_TYPE_BIN/SHARD). */
+    mp_t            strs; /**< String ids (LG_LOG_TYPE_BIN). */
+    mp_t            grps; /**< Group ids (LG_LOG_TYPE_BIN). */
+    uint32_t        str_cnt; /**< String count (LG_LOG_TYPE_BIN). */
+    uint32_t        grp_cnt; /**< Group count (LG_LOG_TYPE_BIN). */
+    const char*     fmt_ptr[ LG_BIN_CACHE ]; /**< Cached formats (LG_LOG_TYPE_BIN). */
+    uint32_t        fmt_id[ LG_BIN_CACHE ];  /**< Cached format ids (LG_LOG_TYPE_BIN). */
+    lg_fmt_buf_s    rec;  /**< Record buffer (LG_LOG_TYPE_BIN). */
+    lg_enc_t        enc;  /**< Key-value message encoding. */
+    lg_log_t*       shards;    /**< Shard Files (LG_LOG_TYPE_SHARD). */
+    uint32_t        shard_cnt; /**< Shard count (LG_LOG_TYPE_SHARD). */
+    uint64_t        shard_run; /**< Shard run id (LG_LOG_TYPE_SHARD). */
+    uint64_t        stat_msgs;   /**< Stats: messages. */
+    uint64_t        stat_bytes;  /**< Stats: bytes logged. */
+    uint64_t        stat_writes; /**< Stats: write calls. */
+    uint64_t        stat_errors; /**< Stats: write errors. */
+    uint64_t*       hist; /**< Stats: write time histogram (terminal Logs). */
+};
+
+
+
+/** Group statistics. */
+st_struct( lg_grp_stats )
+{
+    char*    name;     /**< Group name. */
+    uint64_t msgs;     /**< Emitted messages. */
+    uint64_t inactive; /**< Messages to inactive Group (function calls). */
+    uint64_t rejected; /**< Messages rejected by rate limit or sampling. */
+};
+
+
+/** File statistics. */
+st_struct( lg_log_stats )
+{
+    char*    name;                 /**< File name. */
+    uint64_t msgs;                 /**< Messages. */
+    uint64_t bytes;                /**< Bytes logged. */
+    uint64_t writes;               /**< Write calls. */
+    uint64_t errors;               /**< Write errors. */
+    uint64_t hist[ LG_HIST_SIZE ]; /**< Write time histogram (ns). */
 };
 
 
+/** Host statistics snapshot. */
+st_struct( lg_stats )
+{
+    size_t           grp_cnt; /**< Group count. */
+    lg_grp_stats_t   grps;    /**< Groups. */
+    size_t           log_cnt; /**< File count. */
+    lg_log_stats_t   logs;    /**< Files. */
+};
+
 
 /**
  * Log Group callback (prefix/postfix).
@@ -75,22 +353,110 @@ typedef void ( *lg_grp_fn_p )( const lg_host_t host,
                                sl_p            outbuf );
 
 
+/**
+ * Group enumeration callback.
+ */
+typedef void ( *lg_grp_each_fn_p )( lg_host_t host, lg_grp_t grp, void* arg );
+
+
+/**
+ * Wall clock timestamp Prefix: "YYYY-MM-DD HH:MM:SS.uuuuuu ".
+ *
+ * Date and time are formatted once per second per thread.
+ */
+void lg_prefix_wall( const lg_host_t host, const lg_grp_t grp, const char* msg, sl_p outbuf );
+
+
+/**
+ * Monotonic clock timestamp Prefix: "[sssss.uuuuuu] ".
+ */
+void lg_prefix_mono( const lg_host_t host, const lg_grp_t grp, const char* msg, sl_p outbuf );
+
+
+/**
+ * TSC timestamp Prefix: "[sssss.uuuuuu] " of monotonic clock.
+ *
+ * TSC is calibrated against monotonic clock without waiting: clock
+ * is read directly for the first 100 ms, and calibration is refined
+ * at 10 times longer periods. On other than x86, monotonic clock is
+ * used.
+ */
+void lg_prefix_tsc( const lg_host_t host, const lg_grp_t grp, const char* msg, sl_p outbuf );
+
+
+/**
+ * Group output plan.
+ *
+ * Plan is a flat and de-duplicated list of terminal Logs reachable
+ * from a Group, and the effective Prefix and Postfix of the
+ * Group. Text Logs (FILE and STDOUT) are first, and then Binary Logs.
+ * Plan is rebuilt when Host configuration generation changes.
+ */
+st_struct( lg_plan )
+{
+    uint64_t    gen;         /**< Host generation of plan. */
+    lg_grp_fn_p prefix;      /**< Effective prefix function. */
+    const char* prefix_str;  /**< Effective prefix string. */
+    lg_grp_fn_p postfix;     /**< Effective postfix function. */
+    const char* postfix_str; /**< Effective postfix string. */
+    const uint8_t* prefix_pat;  /**< Effective prefix program. */
+    const uint8_t* postfix_pat; /**< Effective postfix program. */
+    int         seq;         /**< Programs use sequence number. */
+    size_t      cnt;         /**< Number of text Logs. */
+    size_t      bin_cnt;     /**< Number of binary Logs. */
+    lg_log_t    logs[];      /**< Terminal Logs. */
+};
+
+
 st_enum( lg_grp_type ){ LG_GRP_TYPE_NONE = 0, LG_GRP_TYPE_TOP, LG_GRP_TYPE_GRP };
 
+/** Repeated message coalescing state of Group. */
+st_struct( lg_dup )
+{
+    pthread_mutex_t lock;    /**< State lock. */
+    uint64_t        timeout; /**< Summary interval in ns (or 0). */
+    uint64_t        hash;    /**< Hash of last message. */
+    sl_t            last;    /**< Last message (without Prefix and Postfix). */
+    uint64_t        cnt;     /**< Repeats since last written. */
+    uint64_t        start;   /**< Time of first repeat in ns. */
+    sl_t            buf;     /**< Summary buffer. */
+};
+
+
 st_struct( lg_grp )
 {
     lg_grp_type_t type;    /**< Type. */
     char*         name;    /**< Name. */
     lg_grp_fn_p   prefix;  /**< Prefix function. */
     lg_grp_fn_p   postfix; /**< Postfix function. */
+    char*         prefix_str;  /**< Prefix string (instead of function). */
+    char*         postfix_str; /**< Postfix string (instead of function). */
+    char*         prefix_pat;  /**< Prefix pattern (instead of function). */
+    char*         postfix_pat; /**< Postfix pattern (instead of function). */
+    uint64_t      seq;         /**< Message sequence (pattern "%n"). */
                            //     gr_t          logs;    /**< List of Logs. */
     po_s      logs_desc;   /**< Postor descriptor for logs. */
     po_t      logs;        /**< List of Logs. */
     st_bool_t active;      /**< Grp is active? */
+    st_bool_t on;          /**< Effective state (Host and Grp active). */
+    st_bool_t throttled;   /**< Rate limit or sampling is set. */
+    uint64_t  limit_ns;    /**< Rate limit: ns per message (or 0). */
+    uint64_t  limit_tau;   /**< Rate limit: burst tolerance in ns. */
+    uint64_t  limit_tat;   /**< Rate limit: theoretical arrival time. */
+    uint32_t  sample;      /**< Sampling: 1-in-N (or 0). */
+    uint64_t  sample_cnt;  /**< Sampling: message counter. */
+    uint64_t  suppressed;  /**< Rate limited messages since last summary. */
+    uint64_t  rejected;    /**< Rejected messages in total. */
+    uint64_t  stat_msgs;   /**< Stats: emitted messages. */
+    uint64_t  stat_inactive; /**< Stats: messages to inactive Grp. */
+    st_bool_t coalesce;    /**< Coalesce repeated messages. */
+    lg_dup_t  dup;         /**< Coalescing state (or NULL). */
     lg_grp_t  top;         /**< Grp top (if any). */
                            //     gr_t          subs;    /**< List of Subs (if any). */
     po_s subs_desc;        /**< Postor descriptor for subs. */
     po_t subs;             /**< List of Subs (if any). */
+    lg_plan_t plan;        /**< Output plan (cached). */
+    st_bool_t deferred;    /**< Format in async writer. */
 };
 
 
@@ -112,6 +478,204 @@ lg_host_t lg_host_new( st_t data );
 void lg_host_del( lg_host_t host );
 
 
+/**
+ * Enable asynchronous writing for Host.
+ *
+ * Messages are formatted by the caller and passed through a
+ * lock-free queue to a writer thread, which writes them in batches.
+ * Policy defines what happens when the queue is full: block the
+ * caller, drop the new message, or drop the oldest queued message.
+ *
+ * Async mode should be enabled before logging. Enable also
+ * "threaded" config, if multiple threads log through Host.
+ *
+ * @param host     Host.
+ * @param capacity Queue capacity (messages).
+ * @param policy   Overload policy.
+ */
+void lg_host_async( lg_host_t host, size_t capacity, lg_async_policy_t policy );
+
+
+/**
+ * Flush Host output.
+ *
+ * All messages logged before the call are written to Files when the
+ * call returns.
+ *
+ * @param host Host.
+ */
+void lg_host_flush( lg_host_t host );
+
+
+/**
+ * Take statistics snapshot.
+ *
+ * Message counters are collected only with "stats" config. Counters
+ * are read atomically, but the snapshot is not consistent between
+ * counters while other threads are logging. Sharded Logs are reported
+ * as sum of shards.
+ * Inactive messages are counted only by function calls, since the
+ * macros do not call Logger for inactive Groups.
+ *
+ * @param host Host.
+ *
+ * @return Snapshot (delete with lg_stats_del()).
+ */
+lg_stats_t lg_host_stats( lg_host_t host );
+
+
+/**
+ * Delete statistics snapshot.
+ *
+ * @param stats Snapshot.
+ */
+void lg_stats_del( lg_stats_t stats );
+
+
+/**
+ * Write statistics to Group, one line per Group and File.
+ *
+ * Group lines: "grp <name> msgs=<n> inactive=<n> rejected=<n>".
+ *
+ * File lines: "log <name> msgs=<n> bytes=<n> writes=<n> errors=<n>
+ * p50=<ns> p99=<ns> p999=<ns>".
+ *
+ * @param host Host.
+ * @param name Group name.
+ */
+void lg_host_stats_dump( lg_host_t host, const char* name );
+
+
+/**
+ * Set buffering policy for Log File.
+ *
+ * Policies:
+ *   LG_BUF_NONE: Write each message.
+ *   LG_BUF_LINE: Write when message contains newline.
+ *   LG_BUF_SIZE: Write when buffer of "param" bytes is full.
+ *   LG_BUF_TIME: Write when "param" ms has passed since last write.
+ *
+ * LG_BUF_TIME is checked when a message is written to the File, and
+ * by the Host background thread (started on first use) at about half
+ * the interval, so the tail of a burst is written within 1.5 times
+ * the interval without further messages. The File is then locked on
+ * each write, also in a Host that is not threaded. Buffers are also
+ * written when full, by lg_host_flush() and lg_grp_flush(), by
+ * lg_host_del(), and at exit() for Hosts that still exist.
+ *
+ * Default policy is LG_BUF_SIZE with LG_BUF_DEFAULT bytes for files,
+ * and LG_BUF_LINE for "<stdout>". Mapped, ring and sharded Files have
+ * no buffer.
+ *
+ * @param host     Host.
+ * @param filename Log File name.
+ * @param policy   Buffering policy.
+ * @param param    Buffer size or time interval (0 for default).
+ *
+ * @return 0 on success, -1 if File has no buffer.
+ */
+int lg_log_buffer( lg_host_t host, const char* filename, lg_buf_policy_t policy, size_t param );
+
+
+/**
+ * Set key-value message encoding for Log File.
+ *
+ * Encoding is used for messages from lg_kv_h() and LG_KV(). Other
+ * messages are written as is. Default encoding is LG_ENC_TEXT. Log
+ * File of any type is looked up by name, and a regular File is
+ * created if missing.
+ *
+ * @param host     Host.
+ * @param filename Log File name.
+ * @param enc      Encoding.
+ */
+void lg_log_encoding( lg_host_t host, const char* filename, lg_enc_t enc );
+
+
+/**
+ * Create flight recorder File of given data size.
+ *
+ * Groups are joined to the recorder with lg_grp_join_file_type()
+ * using LG_LOG_TYPE_RING. Without this call, the size is
+ * LG_RING_SIZE.
+ *
+ * @param host     Host.
+ * @param filename Ring File name.
+ * @param size     Data size in bytes.
+ */
+void lg_log_ring( lg_host_t host, const char* filename, size_t size );
+
+
+/**
+ * Create sharded File with given shard count.
+ *
+ * Groups are joined to the sharded File with
+ * lg_grp_join_file_type() using LG_LOG_TYPE_SHARD. Without this call,
+ * the shard count is the number of online CPUs. Count is limited to
+ * LG_SHARD_MAX, and it can't be changed after the first message.
+ * Shard Files of earlier runs are deleted when shards are created.
+ *
+ * @param host     Host.
+ * @param filename Sharded File name.
+ * @param cnt      Shard count (0 for default).
+ */
+void lg_log_shard( lg_host_t host, const char* filename, uint32_t cnt );
+
+
+/**
+ * Set rotation for Log File.
+ *
+ * File is rotated when it would grow beyond "size" bytes, or when
+ * "interval" seconds has passed since it was opened. Current File is
+ * renamed to "<file>.<n>", where "n" is increasing segment number,
+ * and a new File takes its place. Numbering continues from the
+ * segments that exist when rotation is set. Only the "keep" latest
+ * segments are kept.
+ *
+ * The next File is opened in advance as "<file>.next" by a
+ * background thread, and rotation only switches the logging thread
+ * to it. The background thread then writes the buffered tail of the
+ * rotated File, renames both Files and closes the rotated one. If
+ * the rename fails, the data written after the switch is moved back
+ * to the current File, logging continues to it and a write error is
+ * counted. The logging thread waits only if the next File is not
+ * ready yet. lg_host_flush() waits until pending renames are done.
+ *
+ * Segments are compressed to "<file>.<n>.gz", and old segments
+ * removed, by the same thread. Logging is not blocked by
+ * compression.
+ *
+ * Text and mapped Files can be rotated. Mapped File is truncated to
+ * its written length after the switch. Rotated File is locked on each
+ * write, also in a Host that is not threaded.
+ *
+ * @param host     Host.
+ * @param filename Log File name.
+ * @param size     Maximum File size (0 for none).
+ * @param interval Rotation interval in seconds (0 for none).
+ * @param keep     Number of segments to keep (0 for all).
+ * @param compress Compress segments.
+ *
+ * @return 0 on success, -1 if File type cannot be rotated.
+ */
+int lg_log_rotate( lg_host_t   host,
+                   const char* filename,
+                   size_t      size,
+                   uint32_t    interval,
+                   uint32_t    keep,
+                   st_bool_t   compress );
+
+
+/**
+ * Return number of messages dropped by async overload policy.
+ *
+ * @param host Host.
+ *
+ * @return Dropped count.
+ */
+uint64_t lg_host_dropped( lg_host_t host );
+
+
 /**
  * Return user data.
  *
@@ -138,10 +702,93 @@ void lg_host_y( lg_host_t host );
 void lg_host_n( lg_host_t host );
 
 
+/**
+ * Apply Group state rules.
+ *
+ * Rules are "pattern=y" or "pattern=n", separated by white space,
+ * "," or ";". Text after "#" is a comment until end of line. Pattern
+ * is a Group name or glob pattern (see lg_grp_each()). Rules are
+ * applied in order to existing Groups, and they are also applied to
+ * Groups created later. Rule replaces an earlier rule with the same
+ * pattern. Invalid rules are ignored.
+ *
+ * @param host  Host.
+ * @param rules Rules text.
+ *
+ * @return Number of valid rules.
+ */
+int lg_host_rules( lg_host_t host, const char* rules );
+
+
+/**
+ * Apply Group state rules from environment variable (if set).
+ *
+ * @param host Host.
+ * @param var  Variable name, e.g. "LG_GROUPS".
+ *
+ * @return Number of valid rules.
+ */
+int lg_host_rules_env( lg_host_t host, const char* var );
+
+
+/**
+ * Watch rules file and apply rules when file is changed.
+ *
+ * File is read immediately (if it exists), and again whenever it is
+ * written or replaced. Rules from the previous file content are
+ * replaced, but Group states are not reverted. Rules from
+ * lg_host_rules() remain, and file rules are applied after them.
+ *
+ * Watcher is a thread, hence Host must be configured as "threaded"
+ * before it is used. Logging is not stopped while rules are applied.
+ *
+ * @param host Host.
+ * @param path Rules file.
+ *
+ * @return 0 on success, -1 if file cannot be watched.
+ */
+int lg_host_watch( lg_host_t host, const char* path );
+
+
 /**
  * Configure Host defaults.
  *
- * Configs: "active".
+ * Configs: "active", "threaded", "uring", "crashflush", "fastfmt",
+ * "stats".
+ *
+ * "active": Groups are created active.
+ *
+ * "threaded": Host can be used from multiple threads. Messages are
+ * formatted in thread local buffers, and only writes to the same Log
+ * are serialized. Group name lookup is not locked, and Groups can be
+ * created while other threads are logging.
+ *
+ * "uring": Full File buffers are written with io_uring. Writes from
+ * all Files are submitted as one batch after each message, and
+ * completions are reaped without blocking. Logging blocks only when
+ * File buffer is full while all its LG_URING_BUFS buffers are still
+ * in flight.
+ * If io_uring is not available, plain writes are used.
+ *
+ * "crashflush": File buffers are written when process receives a
+ * fatal signal (SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT), followed
+ * by messages still in async queue (except deferred ones, which
+ * would need formatting). Only async-signal-safe calls are used, and
+ * the previous signal handlers are restored and run afterwards. The
+ * handler runs on an alternate stack, so that also stack overflow is
+ * handled. The stack is given to the configuring thread, and to
+ * threads of threaded Host when they first log, hence enable before
+ * starting logging threads.
+ *
+ * "fastfmt": Message formats with only integer, character, string
+ * and pointer conversions are formatted with a cached program
+ * instead of printf. Output is identical. Programs are cached by
+ * format pointer, and a format buffer reused for other content is
+ * formatted with printf. Enabled by default.
+ *
+ * "stats": Message counters of Groups and Files are collected, and
+ * time spent in each File write to the File histogram. Write call
+ * and write error counters are collected always.
  *
  * @param host   Host.
  * @param config Config name.
@@ -218,6 +865,148 @@ void lg_grp_prefix( lg_host_t host, const char* name, lg_grp_fn_p prefix );
 void lg_grp_postfix( lg_host_t host, const char* name, lg_grp_fn_p postfix );
 
 
+/**
+ * Assign constant Prefix string to Group.
+ *
+ * String is copied to message as is, without callback. Replaces
+ * Prefix Function.
+ *
+ * @param host   Host.
+ * @param name   Group name.
+ * @param prefix Prefix string (or NULL).
+ */
+void lg_grp_prefix_str( lg_host_t host, const char* name, const char* prefix );
+
+
+/**
+ * Assign constant Postfix string to Group.
+ *
+ * String is copied to message as is, without callback. Replaces
+ * Postfix Function.
+ *
+ * @param host    Host.
+ * @param name    Group name.
+ * @param postfix Postfix string (or NULL).
+ */
+void lg_grp_postfix_str( lg_host_t host, const char* name, const char* postfix );
+
+
+/**
+ * Assign Prefix pattern to Group.
+ *
+ * Pattern conversions are listed in lg_pat.h, e.g. "%T [%g] %t: ".
+ * Host data is rendered by "%d" as pointer value ("0x..."), since
+ * Logger does not know what it points to.
+ * Pattern is compiled for each Group that uses it, and the static
+ * parts, such as Group name, are rendered beforehand. Replaces
+ * Prefix Function and string.
+ *
+ * @param host    Host.
+ * @param name    Group name.
+ * @param pattern Prefix pattern (or NULL).
+ */
+void lg_grp_prefix_pat( lg_host_t host, const char* name, const char* pattern );
+
+
+/**
+ * Assign Postfix pattern to Group.
+ *
+ * @param host    Host.
+ * @param name    Group name.
+ * @param pattern Postfix pattern (or NULL).
+ */
+void lg_grp_postfix_pat( lg_host_t host, const char* name, const char* pattern );
+
+
+/**
+ * Set rate limit for Group.
+ *
+ * Group accepts on average "rate" messages per second, and bursts of
+ * "burst" messages. Rejected messages are dropped before formatting.
+ * When Group accepts messages again, a "<n> messages suppressed" line
+ * is written before the next message.
+ *
+ * @param host  Host.
+ * @param name  Group name.
+ * @param rate  Messages per second (0 for no limit, at most 1e9 is effective).
+ * @param burst Burst size.
+ */
+void lg_grp_limit( lg_host_t host, const char* name, uint32_t rate, uint32_t burst );
+
+
+/**
+ * Set sampling for Group.
+ *
+ * Only every "n"th message is written. Sampled out messages are
+ * counted, but not summarized.
+ *
+ * @param host Host.
+ * @param name Group name.
+ * @param n    Sample interval (0 or 1 for all).
+ */
+void lg_grp_sample( lg_host_t host, const char* name, uint32_t n );
+
+
+/**
+ * Return number of messages rejected by rate limit or sampling.
+ *
+ * @param host Host.
+ * @param name Group name.
+ *
+ * @return Count.
+ */
+uint64_t lg_grp_rejected( lg_host_t host, const char* name );
+
+
+/**
+ * Set repeated message coalescing for Group.
+ *
+ * Message identical to the previous one is not written, but counted.
+ * When a different message is logged, or a repeat is logged after
+ * "timeout" has passed since the first repeat, "last message repeated
+ * <n> times" line is written to text Files. In threaded Host the
+ * timeout is also checked by the Host background thread (started on
+ * first use), so the summary is written within 1.5 times the timeout
+ * without further messages. In other Hosts there is no timer, hence
+ * a pending count is written otherwise only by lg_grp_flush() and
+ * lg_host_flush(). The summary and the following message are written
+ * together, so other threads can't log in between.
+ *
+ * Messages are compared without Prefix and Postfix. Coalescing does
+ * not apply to deferred Groups. Binary Files get every message, since
+ * their records are compact and carry the arguments.
+ *
+ * @param host       Host.
+ * @param name       Group name.
+ * @param coalesce   Enable coalescing.
+ * @param timeout_ms Maximum delay of summary in ms (0 for none).
+ */
+void lg_grp_coalesce( lg_host_t   host,
+                      const char* name,
+                      st_bool_t   coalesce,
+                      uint32_t    timeout_ms );
+
+
+/**
+ * Set deferred formatting for Group.
+ *
+ * With async Host, the caller only captures the format arguments, and
+ * the message is formatted (including Prefix and Postfix) by the
+ * writer thread. Strings are copied and other arguments are captured
+ * by value. The format string must remain valid until the message is
+ * written, i.e. it should be a literal. Messages with wide characters
+ * or strings ("%lc", "%ls"), unknown conversions, or conversion specs
+ * longer than 48 characters are formatted directly by the caller.
+ *
+ * Without async Host, the setting has no effect.
+ *
+ * @param host     Host.
+ * @param name     Group name.
+ * @param deferred Deferred formatting.
+ */
+void lg_grp_deferred( lg_host_t host, const char* name, st_bool_t deferred );
+
+
 /**
  * Enable Group logging (Yes).
  *
@@ -236,6 +1025,62 @@ void lg_grp_y( lg_host_t host, const char* name );
 void lg_grp_n( lg_host_t host, const char* name );
 
 
+/**
+ * Enable all Groups matching glob pattern (see lg_grp_each()).
+ *
+ * @param host    Host.
+ * @param pattern Glob pattern.
+ */
+void lg_grp_y_glob( lg_host_t host, const char* pattern );
+
+
+/**
+ * Disable all Groups matching glob pattern (see lg_grp_each()).
+ *
+ * @param host    Host.
+ * @param pattern Glob pattern.
+ */
+void lg_grp_n_glob( lg_host_t host, const char* pattern );
+
+
+/**
+ * Call "fn" for each Group matching glob pattern.
+ *
+ * Pattern is matched by "/" separated segments. Segment can have "*",
+ * "?" and "[...]", which match within one segment only, and "\\"
+ * escapes the next character (e.g. "\\*" for "*" in a name). Segment
+ * "**" matches any number of segments. Only the matching subtrees of
+ * the Group name index are visited.
+ *
+ * Groups are collected before callbacks, hence "fn" can use Host
+ * functions.
+ *
+ * @param host    Host.
+ * @param pattern Glob pattern.
+ * @param fn      Callback.
+ * @param arg     Callback argument.
+ *
+ * @return Number of matching Groups.
+ */
+size_t lg_grp_each( lg_host_t host, const char* pattern, lg_grp_each_fn_p fn, void* arg );
+
+
+/**
+ * Call "fn" for Group "prefix" and all Groups below it.
+ *
+ * Prefix is matched by whole segments, i.e. "net" covers "net" and
+ * "net/tcp", but not "network". Empty prefix covers all Groups.
+ *
+ * @param host   Host.
+ * @param prefix Group name prefix.
+ * @param fn     Callback.
+ * @param arg    Callback argument.
+ *
+ * @return Number of Groups.
+ */
+size_t lg_grp_each_prefix( lg_host_t host, const char* prefix, lg_grp_each_fn_p fn, void* arg );
+
+
 /**
  * Join Group to logging of another Group.
  *
@@ -256,6 +1101,41 @@ void lg_grp_join_grp( lg_host_t host, const char* name, const char* joinee );
 void lg_grp_join_file( lg_host_t host, const char* name, const char* joinee );
 
 
+/**
+ * Join Group to logging File of given type.
+ *
+ * Type is LG_LOG_TYPE_FILE, LG_LOG_TYPE_BIN, LG_LOG_TYPE_MMAP,
+ * LG_LOG_TYPE_RING, or LG_LOG_TYPE_SHARD.
+ * Binary File contains compact records, which can be converted to
+ * text with "lgdecode" tool. Binary records are written by the
+ * caller, also for async Host.
+ *
+ * Memory mapped File is preallocated in LG_MMAP_CHUNK steps, and
+ * messages are copied to the mapping without system calls. The File
+ * is truncated to the written length when Host is deleted.
+ *
+ * LG_LOG_TYPE_RING is a memory mapped flight recorder of fixed size
+ * (see lg_log_ring()). Ring File keeps the latest messages, also
+ * after a crash, and "lgring" tool extracts them in order. Existing
+ * ring File with the same size is continued.
+ *
+ * LG_LOG_TYPE_SHARD spreads writes over shard Files (see
+ * lg_log_shard()), and each thread writes to its own shard with its
+ * own lock. Messages get a sequence number, global for the sharded
+ * File, and a timestamp. "lgmerge" tool merges the shards back to one
+ * text File by sequence number.
+ *
+ * @param host   Host.
+ * @param name   Group name of joiner.
+ * @param joinee File name of joinee.
+ * @param type   File type.
+ */
+void lg_grp_join_file_type( lg_host_t     host,
+                            const char*   name,
+                            const char*   joinee,
+                            lg_log_type_t type );
+
+
 /**
  * Merge Group to another Group.
  *
@@ -296,6 +1176,29 @@ void lg_grp_attach( lg_host_t host, const char* top, const char* name );
 void lg_grp_detach( lg_host_t host, const char* top, const char* name );
 
 
+/**
+ * Flush Files of Group.
+ *
+ * @param host Host.
+ * @param name Group name.
+ */
+void lg_grp_flush( lg_host_t host, const char* name );
+
+
+/**
+ * Get Group handle by name.
+ *
+ * Handle is stable for the lifetime of Host and can be used with
+ * lg_h() and lgw_h() to skip the name lookup.
+ *
+ * @param host Host.
+ * @param name Group name.
+ *
+ * @return Group.
+ */
+lg_grp_t lg_grp_get( lg_host_t host, const char* name );
+
+
 /**
  * Log message with newline.
  *
@@ -316,6 +1219,158 @@ void lg( lg_host_t host, const char* name, const char* format, ... );
 void lgw( lg_host_t host, const char* name, const char* format, ... );
 
 
+/**
+ * Log message with newline using Group handle.
+ *
+ * @param host   Host.
+ * @param grp    Group.
+ * @param format Message formatter.
+ */
+void lg_h( lg_host_t host, lg_grp_t grp, const char* format, ... );
+
+
+/**
+ * Log message without newline using Group handle.
+ *
+ * @param host   Host.
+ * @param grp    Group.
+ * @param format Message formatter.
+ */
+void lgw_h( lg_host_t host, lg_grp_t grp, const char* format, ... );
+
+
+/**
+ * Log key-value message with newline using Group handle.
+ *
+ * Message is encoded for each File with the File encoding (see
+ * lg_log_encoding()). Key-value messages are not coalesced, and
+ * they are not written to binary Files.
+ *
+ * @param host Host.
+ * @param grp  Group.
+ * @param msg  Message.
+ * @param kv   Fields.
+ * @param cnt  Field count.
+ */
+void lg_kv_h( lg_host_t host, lg_grp_t grp, const char* msg, const lg_kv_s* kv, size_t cnt );
+
+
+/*
+ * Guard macros.
+ *
+ * Macros check Host and Group state before the arguments are
+ * evaluated. If logging is inactive, the arguments are not evaluated
+ * at all.
+ *
+ * Message level can be used to remove whole categories of calls at
+ * compile time. Calls with level below LG_MIN_LEVEL are removed. If
+ * LG_COMPILE_OUT is defined, all macro calls are removed.
+ */
+
+/** Level: trace. */
+#define LG_LEVEL_TRACE 0
+/** Level: debug. */
+#define LG_LEVEL_DEBUG 1
+/** Level: info. */
+#define LG_LEVEL_INFO 2
+/** Level: warning. */
+#define LG_LEVEL_WARN 3
+/** Level: error. */
+#define LG_LEVEL_ERROR 4
+
+#ifndef LG_MIN_LEVEL
+/** Minimum level of compiled calls. */
+#define LG_MIN_LEVEL LG_LEVEL_TRACE
+#endif
+
+/** Host is active. */
+#define lg_host_on( host ) ( !__atomic_load_n( &( host )->disabled, __ATOMIC_RELAXED ) )
+
+/** Host and Group are active (effective state of Group). */
+#define lg_grp_on( host, grp ) ( (void)( host ), __atomic_load_n( &( grp )->on, __ATOMIC_RELAXED ) )
+
+#ifndef LG_COMPILE_OUT
+
+/** Log with newline using name, if active. */
+#define LG( host, name, ... )                                       \
+    do {                                                            \
+        lg_host_t lg_host__ = ( host );                             \
+        if ( lg_host_on( lg_host__ ) ) {                            \
+            lg_grp_t lg_grp__ = lg_grp_get( lg_host__, ( name ) );  \
+            if ( lg_grp_on( lg_host__, lg_grp__ ) )                 \
+                lg_h( lg_host__, lg_grp__, __VA_ARGS__ );           \
+        }                                                           \
+    } while ( 0 )
+
+/** Log with newline using handle, if active. */
+#define LG_H( host, grp, ... )                                      \
+    do {                                                            \
+        lg_host_t lg_host__ = ( host );                             \
+        lg_grp_t  lg_grp__ = ( grp );                               \
+        if ( lg_grp_on( lg_host__, lg_grp__ ) )                     \
+            lg_h( lg_host__, lg_grp__, __VA_ARGS__ );               \
+    } while ( 0 )
+
+/** Log without newline using handle, if active. */
+#define LGW_H( host, grp, ... )                                     \
+    do {                                                            \
+        lg_host_t lg_host__ = ( host );                             \
+        lg_grp_t  lg_grp__ = ( grp );                               \
+        if ( lg_grp_on( lg_host__, lg_grp__ ) )                     \
+            lgw_h( lg_host__, lg_grp__, __VA_ARGS__ );              \
+    } while ( 0 )
+
+/** Log key-value message using handle, if active. */
+#define LG_KV( host, grp, msg, ... )                                \
+    do {                                                            \
+        lg_host_t lg_host__ = ( host );                             \
+        lg_grp_t  lg_grp__ = ( grp );                               \
+        if ( lg_grp_on( lg_host__, lg_grp__ ) ) {                   \
+            const lg_kv_s lg_kv__[] = { __VA_ARGS__ };              \
+            lg_kv_h( lg_host__,                                     \
+                     lg_grp__,                                      \
+                     ( msg ),                                       \
+                     lg_kv__,                                       \
+                     sizeof( lg_kv__ ) / sizeof( lg_kv__[ 0 ] ) );  \
+        }                                                           \
+    } while ( 0 )
+
+#else
+
+/* Statements like the active macros; arguments are type checked only. */
+#define LG( host, name, ... )                                       \
+    do {                                                            \
+        (void)sizeof( lg( host, name, __VA_ARGS__ ), 0 );           \
+    } while ( 0 )
+#define LG_H( host, grp, ... )                                      \
+    do {                                                            \
+        (void)sizeof( lg_h( host, grp, __VA_ARGS__ ), 0 );          \
+    } while ( 0 )
+#define LGW_H( host, grp, ... )                                     \
+    do {                                                            \
+        (void)sizeof( lgw_h( host, grp, __VA_ARGS__ ), 0 );         \
+    } while ( 0 )
+#define LG_KV( host, grp, msg, ... )                                \
+    do {                                                            \
+        (void)sizeof( lg_kv_h( host,                                \
+                               grp,                                 \
+                               msg,                                 \
+                               (const lg_kv_s[]){ __VA_ARGS__ },    \
+                               0 ),                                 \
+                      0 );                                          \
+    } while ( 0 )
+
+#endif
+
+/** Log with newline using handle, if level is compiled and active. */
+#define LG_L( level, host, grp, ... )                               \
+    do {                                                            \
+        if ( ( level ) >= LG_MIN_LEVEL )                            \
+            LG_H( host, grp, __VA_ARGS__ );                         \
+    } while ( 0 )
+
+
+
 /**
  * Inactive assertion.
  *
@@ -1,9 +1,35 @@
 #include "unity.h"
 #include "logger.h"
+#include "lg_queue.h"
+#include "lg_fmt.h"
+#include "lg_uring.h"
+#include "lg_stamp.h"
+#include "lg_pat.h"
+#include "lg_fast.h"
+#include "lg_trie.h"
+#include "lg_hist.h"
+#include "lg_kv.h"
+#include "lg_shard.h"
 
+#include <zlib.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <errno.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <wchar.h>
 
 
 
@@ -38,6 +64,22 @@ void postfix( const lg_host_t host, const lg_grp_t grp, const char* msg, sl_p ou
 }
 
 
+void check_gz_content( const char* file, const char* content )
+{
+    char   buf[ 4096 ];
+    gzFile gz;
+    int    len;
+
+    gz = gzopen( file, "rb" );
+    TEST_ASSERT_TRUE( gz != NULL );
+    len = gzread( gz, buf, sizeof( buf ) - 1 );
+    gzclose( gz );
+    TEST_ASSERT_TRUE( len >= 0 );
+    buf[ len ] = 0;
+    TEST_ASSERT_TRUE( !strcmp( buf, content ) );
+}
+
+
 void check_file_content( const char* file, const char* content )
 {
     sl_t ss;
@@ -194,3 +236,1910 @@ void test_files( void )
 
     clean_testout();
 }
+
+
+void test_handle( void )
+{
+    lg_host_t host;
+    lg_grp_t  grp;
+    lg_grp_t  sub;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+
+    grp = lg_grp_top( host, "top", "test/out/handle.log", prefix, st_nil );
+    sub = lg_grp_sub( host, "top", "sub" );
+    TEST_ASSERT_TRUE( lg_grp_get( host, "top" ) == grp );
+    TEST_ASSERT_TRUE( lg_grp_get( host, "top/sub" ) == sub );
+
+    lg_h( host, grp, "top %d", 1 );
+    lgw_h( host, sub, "sub %d", 2 );
+    lg_grp_n( host, "top/sub" );
+    lgw_h( host, sub, "sub %d", 3 );
+    lg_host_n( host );
+    lg_h( host, grp, "top %d", 4 );
+    lg_host_y( host );
+    lg_h( host, grp, "top %d", 5 );
+
+    lg_host_del( host );
+
+    check_file_content( "test/out/handle.log", "prefix: top 1\nprefix: sub 2prefix: top 5\n" );
+
+    clean_testout();
+}
+
+
+static int eval_count = 0;
+
+static int eval_arg( int value )
+{
+    eval_count++;
+    return value;
+}
+
+
+void test_macros( void )
+{
+    lg_host_t host;
+    lg_grp_t  grp;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    grp = lg_grp_log( host, "macro", "test/out/macro.log" );
+
+    LG( host, "macro", "%d", eval_arg( 1 ) );
+    LG_H( host, grp, "%d", eval_arg( 2 ) );
+    LGW_H( host, grp, "%d", eval_arg( 3 ) );
+    LG_L( LG_LEVEL_DEBUG, host, grp, "%d", eval_arg( 4 ) );
+    TEST_ASSERT_TRUE( eval_count == 4 );
+
+    lg_grp_n( host, "macro" );
+    LG( host, "macro", "%d", eval_arg( 5 ) );
+    LG_H( host, grp, "%d", eval_arg( 6 ) );
+    lg_grp_y( host, "macro" );
+    lg_host_n( host );
+    LG( host, "macro", "%d", eval_arg( 7 ) );
+    LG_L( LG_LEVEL_ERROR, host, grp, "%d", eval_arg( 8 ) );
+    TEST_ASSERT_TRUE( eval_count == 4 );
+
+    lg_host_del( host );
+
+    check_file_content( "test/out/macro.log", "1\n2\n34\n" );
+
+    clean_testout();
+}
+
+
+void test_plan( void )
+{
+    lg_host_t host;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+
+    lg_grp_top( host, "top", "test/out/plan.log", st_nil, st_nil );
+    lg_grp_sub( host, "top", "sub" );
+    lg_grp_sub( host, "top/sub", "deep" );
+    lg_grp_log( host, "other", "test/out/plan.log" );
+    lg_grp_join_grp( host, "top/sub/deep", "other" );
+    lg_grp_join_grp( host, "other", "top/sub/deep" );
+
+    lgw( host, "top/sub/deep", "1" );
+    lgw( host, "other", "2" );
+
+    lg_grp_merge_file( host, "other", "test/out/plan2.log" );
+    lgw( host, "top/sub/deep", "3" );
+    lgw( host, "other", "4" );
+
+    lg_host_del( host );
+
+    check_file_content( "test/out/plan.log", "123" );
+    check_file_content( "test/out/plan2.log", "34" );
+
+    clean_testout();
+}
+
+
+void test_fix_str( void )
+{
+    lg_host_t host;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+
+    lg_grp_top( host, "top", "test/out/fix.log", st_nil, st_nil );
+    lg_grp_sub( host, "top", "sub" );
+    lg_grp_log( host, "other", "test/out/fix.log" );
+
+    lg_grp_prefix_str( host, "top", "[top] " );
+    lg_grp_postfix_str( host, "top", " ." );
+    lg( host, "top/sub", "1" );
+    lg_grp_prefix( host, "top", prefix );
+    lg( host, "top/sub", "2" );
+    lg_grp_attach( host, "other", "top/sub" );
+    lg_grp_prefix_str( host, "other", "[other] " );
+    lg( host, "top/sub", "3" );
+    lg_grp_detach( host, "other", "top/sub" );
+    lg_grp_postfix_str( host, "top", st_nil );
+    lg( host, "top/sub", "4" );
+    lg_grp_attach( host, "top", "top/sub" );
+    lg( host, "top/sub", "5" );
+
+    lg_host_del( host );
+
+    check_file_content( "test/out/fix.log", "[top] 1 .\nprefix: 2 .\n[other] 3\n4\nprefix: 5\n" );
+
+    clean_testout();
+}
+
+
+#define THREAD_CNT 4
+#define THREAD_MSG 2000
+
+typedef struct
+{
+    lg_host_t host;
+    lg_grp_t  grp;
+    int       id;
+} thread_arg_t;
+
+
+static void* thread_logger( void* arg )
+{
+    thread_arg_t* ta = (thread_arg_t*)arg;
+    int           i;
+
+    for ( i = 0; i < THREAD_MSG; i++ )
+        lg_h( ta->host, ta->grp, "thread %d message %04d", ta->id, i );
+
+    return NULL;
+}
+
+
+void test_threaded( void )
+{
+    lg_host_t    host;
+    pthread_t    threads[ THREAD_CNT ];
+    thread_arg_t args[ THREAD_CNT ];
+    int          counts[ THREAD_CNT ] = { 0 };
+    int          i;
+    sl_t         ss;
+    char*        line;
+    char*        save;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_host_config( host, "threaded", st_true );
+    lg_grp_top( host, "top", "test/out/threaded.log", st_nil, st_nil );
+    lg_grp_prefix_str( host, "top", "> " );
+    lg_grp_sub( host, "top", "sub" );
+
+    for ( i = 0; i < THREAD_CNT; i++ ) {
+        args[ i ].host = host;
+        args[ i ].grp = lg_grp_get( host, ( i % 2 ) ? "top" : "top/sub" );
+        args[ i ].id = i;
+        pthread_create( &threads[ i ], NULL, thread_logger, &args[ i ] );
+    }
+
+    /* Reconfiguration while logging. */
+    lg_grp_prefix_str( host, "top", "# " );
+
+    for ( i = 0; i < THREAD_CNT; i++ )
+        pthread_join( threads[ i ], NULL );
+
+    lg_host_del( host );
+
+    ss = sl_read_file( "test/out/threaded.log" );
+    for ( line = strtok_r( ss, "\n", &save ); line; line = strtok_r( NULL, "\n", &save ) ) {
+        int id, num;
+        TEST_ASSERT_TRUE( strlen( line ) == strlen( "> thread 0 message 0000" ) );
+        TEST_ASSERT_TRUE( sscanf( line + 2, "thread %d message %d", &id, &num ) == 2 );
+        TEST_ASSERT_TRUE( id >= 0 && id < THREAD_CNT );
+        TEST_ASSERT_TRUE( num == counts[ id ] );
+        counts[ id ]++;
+    }
+    sl_del( &ss );
+
+    for ( i = 0; i < THREAD_CNT; i++ )
+        TEST_ASSERT_TRUE( counts[ i ] == THREAD_MSG );
+
+    clean_testout();
+}
+
+
+static int reconfig_stop;
+
+
+/**
+ * Replace Group strings, and hence plans, until loggers are done.
+ */
+static void* thread_reconfig( void* arg )
+{
+    lg_host_t host = (lg_host_t)arg;
+    int       i;
+
+    for ( i = 0; i < 200 || !__atomic_load_n( &reconfig_stop, __ATOMIC_ACQUIRE ); i++ ) {
+        lg_grp_prefix_str( host, "top", ( i % 2 ) ? "> " : "# " );
+        lg_grp_postfix_str( host, "top", ( i % 3 ) ? " <" : " #" );
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Log to Group by name until stopped.
+ */
+static void* thread_by_name( void* arg )
+{
+    lg_host_t host = (lg_host_t)arg;
+    int       cnt = 0;
+
+    while ( !__atomic_load_n( &reconfig_stop, __ATOMIC_ACQUIRE ) || cnt < 100 ) {
+        lg( host, "named", "by name %d", cnt );
+        cnt++;
+    }
+
+    return (void*)(intptr_t)cnt;
+}
+
+
+void test_reclaim( void )
+{
+    lg_host_t    host;
+    pthread_t    threads[ THREAD_CNT + 1 ];
+    thread_arg_t args[ THREAD_CNT ];
+    sl_t         ss;
+    char*        line;
+    char         name[ 16 ];
+    void*        ret;
+    size_t       len;
+    int          lines;
+    int          id;
+    int          idx;
+    int          i;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_host_config( host, "threaded", st_true );
+    lg_grp_top( host, "top", "test/out/reclaim.log", st_nil, st_nil );
+    lg_grp_sub( host, "top", "sub" );
+    lg_grp_prefix_str( host, "top", "# " );
+    lg_grp_postfix_str( host, "top", " #" );
+
+    for ( i = 0; i < THREAD_CNT; i++ ) {
+        args[ i ].host = host;
+        args[ i ].grp = lg_grp_get( host, "top/sub" );
+        args[ i ].id = i;
+        pthread_create( &threads[ i ], NULL, thread_logger, &args[ i ] );
+    }
+    reconfig_stop = 0;
+    pthread_create( &threads[ THREAD_CNT ], NULL, thread_reconfig, host );
+
+    for ( i = 0; i < THREAD_CNT; i++ )
+        pthread_join( threads[ i ], NULL );
+    __atomic_store_n( &reconfig_stop, 1, __ATOMIC_RELEASE );
+    pthread_join( threads[ THREAD_CNT ], NULL );
+
+    /* Retired plans and strings have been reclaimed while logging. */
+    lg_grp_prefix_str( host, "top", "" );
+    lg_grp_postfix_str( host, "top", "" );
+    lg_h( host, lg_grp_get( host, "top/sub" ), "done" );
+    TEST_ASSERT_TRUE( host->epoch > 0 );
+
+    lg_host_del( host );
+
+    /* Each line has one of the published prefixes and postfixes. */
+    ss = sl_read_file( "test/out/reclaim.log" );
+    lines = 0;
+    for ( line = strtok( ss, "\n" ); line; line = strtok( NULL, "\n" ) ) {
+        if ( !strcmp( line, "done" ) )
+            continue;
+        len = strlen( line );
+        TEST_ASSERT_TRUE( len > 4 );
+        TEST_ASSERT_TRUE( !strncmp( line, "> ", 2 ) || !strncmp( line, "# ", 2 ) );
+        TEST_ASSERT_TRUE( !strcmp( line + len - 2, " <" ) || !strcmp( line + len - 2, " #" ) );
+        TEST_ASSERT_TRUE( sscanf( line + 2, "thread %d message %d", &id, &idx ) == 2 );
+        lines++;
+    }
+    sl_del( &ss );
+    TEST_ASSERT_TRUE( lines == THREAD_CNT * THREAD_MSG );
+
+    /* Groups are created, and the name table is replaced, while
+       another thread looks up Group by name. */
+    host = lg_host_new( st_nil );
+    lg_host_config( host, "threaded", st_true );
+    lg_grp_log( host, "named", "test/out/named.log" );
+
+    reconfig_stop = 0;
+    pthread_create( &threads[ 0 ], NULL, thread_by_name, host );
+    for ( i = 0; i < 1000; i++ ) {
+        sprintf( name, "grp%d", i );
+        lg_grp_log( host, name, "test/out/many.log" );
+        lg( host, name, "%d", i );
+    }
+    __atomic_store_n( &reconfig_stop, 1, __ATOMIC_RELEASE );
+    pthread_join( threads[ 0 ], &ret );
+
+    lg_host_del( host );
+
+    ss = sl_read_file( "test/out/many.log" );
+    lines = 0;
+    for ( line = strtok( ss, "\n" ); line; line = strtok( NULL, "\n" ) )
+        TEST_ASSERT_TRUE( atoi( line ) == lines++ );
+    sl_del( &ss );
+    TEST_ASSERT_TRUE( lines == 1000 );
+
+    ss = sl_read_file( "test/out/named.log" );
+    lines = 0;
+    for ( line = strtok( ss, "\n" ); line; line = strtok( NULL, "\n" ) )
+        lines++;
+    sl_del( &ss );
+    TEST_ASSERT_TRUE( lines == (int)(intptr_t)ret );
+
+    clean_testout();
+}
+
+
+void test_async( void )
+{
+    lg_host_t host;
+    lg_grp_t  grp;
+    sl_t      ss;
+    char*     c;
+    int       i;
+    int       lines;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_host_async( host, 16, LG_ASYNC_BLOCK );
+    lg_grp_top( host, "top", "test/out/async.log", prefix, st_nil );
+    lg_grp_sub( host, "top", "sub" );
+    lg_grp_join_file( host, "top/sub", "test/out/async_sub.log" );
+
+    lg( host, "top", "1" );
+    lg( host, "top/sub", "2" );
+    lg_host_flush( host );
+    check_file_content( "test/out/async.log", "prefix: 1\nprefix: 2\n" );
+    check_file_content( "test/out/async_sub.log", "prefix: 2\n" );
+
+    for ( i = 0; i < 1000; i++ )
+        lgw( host, "top/sub", "%d", i % 10 );
+    lg_host_del( host );
+
+    ss = sl_read_file( "test/out/async_sub.log" );
+    TEST_ASSERT_TRUE( sl_length( ss ) == 1000 + strlen( "prefix: 2\n" ) + 1000 * strlen( "prefix: " ) );
+    sl_del( &ss );
+
+    /* Dropped and written messages must add up. */
+    host = lg_host_new( st_nil );
+    lg_host_async( host, 2, LG_ASYNC_DROP_OLDEST );
+    grp = lg_grp_log( host, "drop", "test/out/drop.log" );
+    for ( i = 0; i < 1000; i++ )
+        lg_h( host, grp, "%d", i );
+    lg_host_flush( host );
+
+    ss = sl_read_file( "test/out/drop.log" );
+    lines = 0;
+    for ( c = ss; *c; c++ )
+        if ( *c == '\n' )
+            lines++;
+    TEST_ASSERT_TRUE( lines + lg_host_dropped( host ) == 1000 );
+    sl_del( &ss );
+
+    lg_host_del( host );
+
+    clean_testout();
+}
+
+
+static void log_formats( lg_host_t host, const char* name )
+{
+    const char* str = "text";
+    const char  raw[ 4 ] = { 'a', 'b', 'c', 'd' };
+
+    lg( host, name, "int: %d %i %5d %-5d| %05d %+d %u %x %X %o %#x %c", -12, 34, 56, 78, 9, 10, 11u, 255, 255, 8, 16, 'z' );
+    lg( host, name, "long: %ld %lld %lu %zu %hhd %hd %jd", -1L, -2LL, 3UL, (size_t)4, 5, 6, (intmax_t)7 );
+    lg( host, name, "double: %f %.2f %e %g %10.3f %Lf", 1.5, 2.25, 1e10, 0.0001, 3.14159, (long double)2.5 );
+    lg( host, name, "str: %s %10s %-10s| %.2s %*s %.*s %%", str, str, str, str, 6, str, 3, str );
+    lg( host, name, "none: %s", (char*)NULL );
+    lg( host, name, "raw: %.*s %.3s", 4, raw, raw );
+    /* Not captured, formatted directly. */
+    lg( host, name, "wide: %ls %5ls|", L"wide", L"ab" );
+    lg( host, name, "wide: %lc|", (wint_t)'w' );
+    lg( host, name, "spec: %.00000000000000000000000000000000000000000000000004d|", 42 );
+    lg( host, name, "nul: %c after", 0 );
+}
+
+
+void test_deferred( void )
+{
+    lg_host_t host;
+    sl_t      direct;
+    sl_t      deferred;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_grp_top( host, "direct", "test/out/direct.log", prefix, postfix );
+    log_formats( host, "direct" );
+    lg_host_del( host );
+
+    host = lg_host_new( st_nil );
+    lg_host_async( host, 4, LG_ASYNC_BLOCK );
+    lg_grp_top( host, "deferred", "test/out/deferred.log", prefix, postfix );
+    lg_grp_deferred( host, "deferred", st_true );
+    log_formats( host, "deferred" );
+    lg_host_del( host );
+
+    direct = sl_read_file( "test/out/direct.log" );
+    deferred = sl_read_file( "test/out/deferred.log" );
+    TEST_ASSERT_TRUE( sl_length( direct ) > 0 );
+    TEST_ASSERT_TRUE( sl_length( direct ) == sl_length( deferred ) );
+    TEST_ASSERT_TRUE( !memcmp( direct, deferred, sl_length( direct ) ) );
+    TEST_ASSERT_TRUE( strstr( deferred, "wide: wide    ab|" ) != st_nil );
+    TEST_ASSERT_TRUE( strstr( deferred, "wide: w|" ) != st_nil );
+    TEST_ASSERT_TRUE( strstr( deferred, "spec: 0042|" ) != st_nil );
+    /* Last message has NUL from "%c". */
+    TEST_ASSERT_TRUE( sl_length( direct ) > 14 );
+    TEST_ASSERT_TRUE( !memcmp( direct + sl_length( direct ) - 14, "nul: \0 after\n\n", 14 ) );
+    sl_del( &direct );
+    sl_del( &deferred );
+
+    clean_testout();
+}
+
+
+void test_bin( void )
+{
+    lg_host_t host;
+    sl_t      ss;
+    sl_t      text;
+    sl_t      sub;
+    sl_t      bin;
+    sl_t      all;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_grp_top( host, "top", "test/out/text.log", prefix, st_nil );
+    lg_grp_sub( host, "top", "sub" );
+    lg_grp_log( host, "bin", st_nil );
+    lg_grp_join_file_type( host, "bin", "test/out/bin.lgb", LG_LOG_TYPE_BIN );
+    lg_grp_join_file_type( host, "top/sub", "test/out/bin.lgb", LG_LOG_TYPE_BIN );
+
+    log_formats( host, "top/sub" );
+    log_formats( host, "bin" );
+    lgw( host, "top", "top only" );
+
+    lg_host_del( host );
+
+    TEST_ASSERT_TRUE( check_file_exists( "test/out/text.log" ) );
+    ss = sl_read_file( "test/out/bin.lgb" );
+    TEST_ASSERT_TRUE( !memcmp( ss, "LGB\x01", 4 ) );
+    sl_del( &ss );
+
+    /* Decoded text matches the text Log. */
+    TEST_ASSERT_TRUE( system( "make -s -C tools lgdecode > /dev/null" ) == 0 );
+    TEST_ASSERT_TRUE( system( "tools/lgdecode -g top/sub test/out/bin.lgb > test/out/sub.txt" ) == 0 );
+    TEST_ASSERT_TRUE( system( "tools/lgdecode -g bin test/out/bin.lgb > test/out/bin.txt" ) == 0 );
+    TEST_ASSERT_TRUE( system( "tools/lgdecode test/out/bin.lgb > test/out/all.txt" ) == 0 );
+    text = sl_read_file( "test/out/text.log" );
+    sub = sl_read_file( "test/out/sub.txt" );
+    bin = sl_read_file( "test/out/bin.txt" );
+    all = sl_read_file( "test/out/all.txt" );
+    TEST_ASSERT_TRUE( sl_length( sub ) > 0 );
+    TEST_ASSERT_TRUE( sl_length( text ) == sl_length( sub ) + strlen( "prefix: top only" ) );
+    TEST_ASSERT_TRUE( !memcmp( text, sub, sl_length( sub ) ) );
+    TEST_ASSERT_TRUE( sl_length( bin ) > 0 );
+    TEST_ASSERT_TRUE( strstr( bin, "prefix: " ) == st_nil );
+    TEST_ASSERT_TRUE( sl_length( all ) == sl_length( sub ) + sl_length( bin ) );
+    sl_del( &text );
+    sl_del( &sub );
+    sl_del( &bin );
+    sl_del( &all );
+
+    clean_testout();
+}
+
+
+void test_buffer( void )
+{
+    lg_host_t host;
+    sl_t      ss;
+    pid_t     pid;
+    int       status;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_log_buffer( host, "test/out/none.log", LG_BUF_NONE, 0 );
+    lg_grp_top( host, "none", "test/out/none.log", st_nil, st_nil );
+    lg_grp_top( host, "size", "test/out/size.log", st_nil, st_nil );
+    lg_log_buffer( host, "test/out/line.log", LG_BUF_LINE, 0 );
+    lg_grp_top( host, "line", "test/out/line.log", st_nil, st_nil );
+
+    lg( host, "none", "none" );
+    lg( host, "size", "size" );
+    lgw( host, "line", "line" );
+
+    ss = sl_read_file( "test/out/none.log" );
+    TEST_ASSERT_TRUE( !strcmp( ss, "none\n" ) );
+    sl_del( &ss );
+
+    ss = sl_read_file( "test/out/size.log" );
+    TEST_ASSERT_TRUE( sl_length( ss ) == 0 );
+    sl_del( &ss );
+
+    ss = sl_read_file( "test/out/line.log" );
+    TEST_ASSERT_TRUE( sl_length( ss ) == 0 );
+    sl_del( &ss );
+
+    lg( host, "line", "" );
+    ss = sl_read_file( "test/out/line.log" );
+    TEST_ASSERT_TRUE( !strcmp( ss, "line\n" ) );
+    sl_del( &ss );
+
+    lg_grp_flush( host, "size" );
+    ss = sl_read_file( "test/out/size.log" );
+    TEST_ASSERT_TRUE( !strcmp( ss, "size\n" ) );
+    sl_del( &ss );
+
+    /* Small buffer is written when full. */
+    lg_log_buffer( host, "test/out/size.log", LG_BUF_SIZE, 8 );
+    lg( host, "size", "abcd" );
+    lg( host, "size", "efgh" );
+    ss = sl_read_file( "test/out/size.log" );
+    TEST_ASSERT_TRUE( !strcmp( ss, "size\nabcd\n" ) );
+    sl_del( &ss );
+
+    /* Timed buffer is written without further messages. */
+    lg_log_buffer( host, "test/out/time.log", LG_BUF_TIME, 20 );
+    lg_grp_top( host, "time", "test/out/time.log", st_nil, st_nil );
+    lg( host, "time", "first" );
+    lg( host, "time", "tail" );
+    ss = sl_read_file( "test/out/time.log" );
+    TEST_ASSERT_TRUE( sl_length( ss ) < strlen( "first\ntail\n" ) );
+    sl_del( &ss );
+    usleep( 100000 );
+    ss = sl_read_file( "test/out/time.log" );
+    TEST_ASSERT_TRUE( !strcmp( ss, "first\ntail\n" ) );
+    sl_del( &ss );
+
+    lg_host_del( host );
+
+    ss = sl_read_file( "test/out/size.log" );
+    TEST_ASSERT_TRUE( !strcmp( ss, "size\nabcd\nefgh\n" ) );
+    sl_del( &ss );
+
+    /* Buffered tail is written at exit without lg_host_del(). */
+    pid = fork();
+    if ( pid == 0 ) {
+        host = lg_host_new( st_nil );
+        lg_grp_top( host, "exit", "test/out/exit.log", st_nil, st_nil );
+        lg( host, "exit", "tail" );
+        exit( 0 );
+    }
+    waitpid( pid, &status, 0 );
+    ss = sl_read_file( "test/out/exit.log" );
+    TEST_ASSERT_TRUE( !strcmp( ss, "tail\n" ) );
+    sl_del( &ss );
+
+    /* Files without buffer are rejected. */
+    host = lg_host_new( st_nil );
+    lg_grp_log( host, "map", st_nil );
+    lg_grp_join_file_type( host, "map", "test/out/map.log", LG_LOG_TYPE_MMAP );
+    TEST_ASSERT_TRUE( lg_log_buffer( host, "test/out/map.log", LG_BUF_NONE, 0 ) == -1 );
+    TEST_ASSERT_TRUE( lg_log_buffer( host, "<stdout>", LG_BUF_NONE, 0 ) == 0 );
+    lg_host_del( host );
+
+    clean_testout();
+}
+
+
+void test_mmap( void )
+{
+    lg_host_t host;
+    sl_t      ss;
+    int       i;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_grp_log( host, "map", st_nil );
+    lg_grp_join_file_type( host, "map", "test/out/map.log", LG_LOG_TYPE_MMAP );
+    lg_grp_log( host, "unused", st_nil );
+    lg_grp_join_file_type( host, "unused", "test/out/unused.log", LG_LOG_TYPE_MMAP );
+
+    for ( i = 0; i < 3; i++ )
+        lg( host, "map", "line %d", i );
+
+    lg_host_del( host );
+
+    ss = sl_read_file( "test/out/map.log" );
+    TEST_ASSERT_TRUE( !strcmp( ss, "line 0\nline 1\nline 2\n" ) );
+    sl_del( &ss );
+    TEST_ASSERT_TRUE( !check_file_exists( "test/out/unused.log" ) );
+
+    clean_testout();
+}
+
+
+/**
+ * Make io_uring system calls fail with ENOSYS, as on kernels without
+ * io_uring.
+ */
+static int block_uring( void )
+{
+    struct sock_filter filter[] = {
+        BPF_STMT( BPF_LD | BPF_W | BPF_ABS, offsetof( struct seccomp_data, nr ) ),
+        BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K, __NR_io_uring_setup, 2, 0 ),
+        BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K, __NR_io_uring_enter, 1, 0 ),
+        BPF_STMT( BPF_RET | BPF_K, SECCOMP_RET_ALLOW ),
+        BPF_STMT( BPF_RET | BPF_K, SECCOMP_RET_ERRNO | ENOSYS ),
+    };
+    struct sock_fprog prog = { sizeof( filter ) / sizeof( filter[ 0 ] ), filter };
+
+    if ( prctl( PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0 ) )
+        return -1;
+
+    return prctl( PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog );
+}
+
+
+/**
+ * Log through a Ring that fails after creation, and through Host
+ * where io_uring is not available.
+ */
+static int uring_fallback( void )
+{
+    lg_host_t ring_host;
+    lg_host_t host;
+    sl_t      ss;
+    sl_t      ref;
+    int       ok;
+    int       i;
+
+    ring_host = lg_host_new( st_nil );
+    lg_host_config( ring_host, "uring", st_true );
+    lg_grp_top( ring_host, "r", "test/out/uring_r.log", st_nil, st_nil );
+    lg_log_buffer( ring_host, "test/out/uring_r.log", LG_BUF_SIZE, 64 );
+
+    if ( block_uring() )
+        return 1;
+
+    host = lg_host_new( st_nil );
+    lg_host_config( host, "uring", st_true );
+    if ( host->ring != st_nil )
+        return 1;
+    lg_grp_top( host, "p", "test/out/uring_p.log", st_nil, st_nil );
+    lg_log_buffer( host, "test/out/uring_p.log", LG_BUF_SIZE, 64 );
+
+    ref = sl_new( 0 );
+    for ( i = 0; i < 200; i++ ) {
+        lg( ring_host, "r", "message %d", i );
+        lg( host, "p", "message %d", i );
+        sl_format_quick( &ref, "message %d\n", i );
+    }
+
+    lg_host_del( ring_host );
+    lg_host_del( host );
+
+    ss = sl_read_file( "test/out/uring_r.log" );
+    ok = !strcmp( ss, ref );
+    sl_del( &ss );
+    ss = sl_read_file( "test/out/uring_p.log" );
+    ok = ok && !strcmp( ss, ref );
+    sl_del( &ss );
+    sl_del( &ref );
+
+    return ok ? 0 : 1;
+}
+
+
+void test_uring( void )
+{
+    lg_host_t host;
+    sl_t      ss;
+    sl_t      ref;
+    int       i;
+    pid_t     pid;
+    int       status;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_host_config( host, "uring", st_true );
+    lg_grp_top( host, "a", "test/out/uring_a.log", st_nil, st_nil );
+    lg_grp_top( host, "b", "test/out/uring_b.log", st_nil, st_nil );
+    lg_grp_join_file( host, "b", "test/out/uring_a.log" );
+    lg_log_buffer( host, "test/out/uring_a.log", LG_BUF_SIZE, 64 );
+    lg_log_buffer( host, "test/out/uring_b.log", LG_BUF_SIZE, 100 );
+
+    ref = sl_new( 0 );
+    for ( i = 0; i < 200; i++ ) {
+        lg( host, "b", "message %d", i );
+        sl_format_quick( &ref, "message %d\n", i );
+    }
+
+    lg_host_flush( host );
+    ss = sl_read_file( "test/out/uring_b.log" );
+    TEST_ASSERT_TRUE( !strcmp( ss, ref ) );
+    sl_del( &ss );
+
+    /* Back to plain writes. */
+    lg_host_config( host, "uring", st_false );
+    lg( host, "b", "plain" );
+    sl_format_quick( &ref, "plain\n" );
+
+    lg_host_del( host );
+
+    ss = sl_read_file( "test/out/uring_a.log" );
+    TEST_ASSERT_TRUE( !strcmp( ss, ref ) );
+    sl_del( &ss );
+    ss = sl_read_file( "test/out/uring_b.log" );
+    TEST_ASSERT_TRUE( !strcmp( ss, ref ) );
+    sl_del( &ss );
+    sl_del( &ref );
+
+    /* Fallback to plain writes, in child due to seccomp. */
+    pid = fork();
+    if ( pid == 0 )
+        exit( uring_fallback() );
+    waitpid( pid, &status, 0 );
+    TEST_ASSERT_TRUE( WIFEXITED( status ) && WEXITSTATUS( status ) == 0 );
+
+    clean_testout();
+}
+
+
+void test_rotate( void )
+{
+    lg_host_t    host;
+    lg_stats_t   stats;
+    pthread_t    threads[ THREAD_CNT ];
+    thread_arg_t args[ THREAD_CNT ];
+    int          counts[ THREAD_CNT ] = { 0 };
+    char         path[ 64 ];
+    sl_t         ss;
+    char*        line;
+    char*        save;
+    int          seg;
+    int          id;
+    int          num;
+    int          i;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_grp_top( host, "rot", "test/out/rot.log", st_nil, st_nil );
+    lg_log_rotate( host, "test/out/rot.log", 32, 0, 2, st_true );
+
+    /* 4 lines per segment. */
+    for ( i = 0; i < 20; i++ )
+        lg( host, "rot", "line %02d", i );
+
+    lg_host_del( host );
+
+    check_file_content( "test/out/rot.log", "line 16\nline 17\nline 18\nline 19\n" );
+    TEST_ASSERT_TRUE( !check_file_exists( "test/out/rot.log.1.gz" ) );
+    TEST_ASSERT_TRUE( !check_file_exists( "test/out/rot.log.2.gz" ) );
+    TEST_ASSERT_TRUE( check_file_exists( "test/out/rot.log.3.gz" ) );
+    TEST_ASSERT_TRUE( !check_file_exists( "test/out/rot.log.4" ) );
+    check_gz_content( "test/out/rot.log.4.gz", "line 12\nline 13\nline 14\nline 15\n" );
+
+    /* Numbering continues after restart. */
+    host = lg_host_new( st_nil );
+    lg_grp_top( host, "rot", "test/out/rot.log", st_nil, st_nil );
+    lg_log_rotate( host, "test/out/rot.log", 32, 0, 2, st_true );
+    for ( i = 0; i < 8; i++ )
+        lg( host, "rot", "again %02d", i );
+    lg_host_del( host );
+
+    TEST_ASSERT_TRUE( !check_file_exists( "test/out/rot.log.4.gz" ) );
+    check_gz_content( "test/out/rot.log.5.gz", "again 00\nagain 01\nagain 02\n" );
+    check_gz_content( "test/out/rot.log.6.gz", "again 03\nagain 04\nagain 05\n" );
+
+    /* Failed rename keeps current File. */
+    host = lg_host_new( st_nil );
+    lg_host_config( host, "stats", st_true );
+    lg_grp_top( host, "rot", "test/out/rot.log", st_nil, st_nil );
+    lg_log_rotate( host, "test/out/rot.log", 16, 0, 0, st_false );
+    lg( host, "rot", "first" );
+    mkdir( "test/out/rot.log.7", 0755 );
+    system( "touch test/out/rot.log.7/busy" );
+    lg( host, "rot", "second line" );
+    /* Rename is done by worker. */
+    lg_host_flush( host );
+    stats = lg_host_stats( host );
+    TEST_ASSERT_TRUE( stats->logs[ 0 ].errors == 1 );
+    lg_stats_del( stats );
+    lg_host_del( host );
+
+    check_file_content( "test/out/rot.log", "first\nsecond line\n" );
+
+    /* Mapped File is truncated to written length on rotation. */
+    host = lg_host_new( st_nil );
+    lg_grp_log( host, "map", st_nil );
+    lg_grp_join_file_type( host, "map", "test/out/map.log", LG_LOG_TYPE_MMAP );
+    TEST_ASSERT_TRUE( lg_log_rotate( host, "test/out/map.log", 32, 0, 0, st_false ) == 0 );
+    lg_log_ring( host, "test/out/ring.lgr", 64 );
+    TEST_ASSERT_TRUE( lg_log_rotate( host, "test/out/ring.lgr", 32, 0, 0, st_false ) == -1 );
+
+    for ( i = 0; i < 10; i++ )
+        lg( host, "map", "line %02d", i );
+
+    lg_host_del( host );
+
+    check_file_content( "test/out/map.log.1", "line 00\nline 01\nline 02\nline 03\n" );
+    check_file_content( "test/out/map.log.2", "line 04\nline 05\nline 06\nline 07\n" );
+    check_file_content( "test/out/map.log", "line 08\nline 09\n" );
+
+    /* Segments of threaded logging are complete and in order. */
+    host = lg_host_new( st_nil );
+    lg_host_config( host, "threaded", st_true );
+    lg_grp_top( host, "rot", "test/out/rot_mt.log", st_nil, st_nil );
+    lg_log_rotate( host, "test/out/rot_mt.log", 4096, 0, 0, st_false );
+    for ( i = 0; i < THREAD_CNT; i++ ) {
+        args[ i ].host = host;
+        args[ i ].grp = lg_grp_get( host, "rot" );
+        args[ i ].id = i;
+        pthread_create( &threads[ i ], NULL, thread_logger, &args[ i ] );
+    }
+    for ( i = 0; i < THREAD_CNT; i++ )
+        pthread_join( threads[ i ], NULL );
+    lg_host_del( host );
+
+    TEST_ASSERT_TRUE( !check_file_exists( "test/out/rot_mt.log.next" ) );
+    for ( seg = 1;; seg++ ) {
+        sprintf( path, "test/out/rot_mt.log.%d", seg );
+        if ( !check_file_exists( path ) )
+            strcpy( path, "test/out/rot_mt.log" );
+        ss = sl_read_file( path );
+        TEST_ASSERT_TRUE( sl_length( ss ) <= 4096 );
+        for ( line = strtok_r( ss, "\n", &save ); line; line = strtok_r( NULL, "\n", &save ) ) {
+            TEST_ASSERT_TRUE( sscanf( line, "thread %d message %d", &id, &num ) == 2 );
+            TEST_ASSERT_TRUE( id >= 0 && id < THREAD_CNT && num == counts[ id ] );
+            counts[ id ]++;
+        }
+        sl_del( &ss );
+        if ( !strcmp( path, "test/out/rot_mt.log" ) )
+            break;
+    }
+    TEST_ASSERT_TRUE( seg > 10 );
+    for ( i = 0; i < THREAD_CNT; i++ )
+        TEST_ASSERT_TRUE( counts[ i ] == THREAD_MSG );
+
+    clean_testout();
+}
+
+
+void test_ring( void )
+{
+    lg_host_t host;
+    sl_t      ref;
+    FILE*     fh;
+    char      data[ 64 + 64 ];
+    char      tail[ 64 ];
+    uint64_t  pos;
+    int       i;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_log_ring( host, "test/out/ring.lgr", 64 );
+    lg_grp_log( host, "rec", st_nil );
+    lg_grp_join_file_type( host, "rec", "test/out/ring.lgr", LG_LOG_TYPE_RING );
+
+    ref = sl_new( 0 );
+    for ( i = 0; i < 20; i++ ) {
+        lg( host, "rec", "entry %02d", i );
+        sl_format_quick( &ref, "entry %02d\n", i );
+    }
+
+    lg_host_del( host );
+
+    fh = fopen( "test/out/ring.lgr", "rb" );
+    TEST_ASSERT_TRUE( fread( data, 1, sizeof( data ), fh ) == sizeof( data ) );
+    fclose( fh );
+
+    TEST_ASSERT_TRUE( !memcmp( data, "LGR\x01", 4 ) );
+    memcpy( &pos, data + 16, sizeof( pos ) );
+    TEST_ASSERT_TRUE( pos == sl_length( ref ) );
+
+    /* Ring holds the last 64 bytes, starting at write position. */
+    memcpy( tail, data + 64 + pos % 64, 64 - pos % 64 );
+    memcpy( tail + 64 - pos % 64, data + 64, pos % 64 );
+    TEST_ASSERT_TRUE( !memcmp( tail, ref + sl_length( ref ) - 64, 64 ) );
+
+    /* Restart continues the ring. */
+    host = lg_host_new( st_nil );
+    lg_log_ring( host, "test/out/ring.lgr", 64 );
+    lg_grp_log( host, "rec", st_nil );
+    lg_grp_join_file_type( host, "rec", "test/out/ring.lgr", LG_LOG_TYPE_RING );
+    lg( host, "rec", "again" );
+    lg_host_del( host );
+
+    /* Extracted from the first complete line. */
+    TEST_ASSERT_TRUE( system( "make -s -C tools lgring > /dev/null" ) == 0 );
+    TEST_ASSERT_TRUE( system( "tools/lgring test/out/ring.lgr > test/out/ring.txt" ) == 0 );
+    check_file_content( "test/out/ring.txt",
+                        "entry 14\nentry 15\nentry 16\nentry 17\nentry 18\nentry 19\nagain\n" );
+
+    sl_del( &ref );
+
+    clean_testout();
+}
+
+
+#if !defined( __SANITIZE_ADDRESS__ ) && !defined( __SANITIZE_THREAD__ )
+static volatile int crash_depth = 1 << 30;
+
+static int crash_recurse( int depth )
+{
+    volatile char pad[ 1024 ];
+
+    pad[ 0 ] = (char)depth;
+    if ( depth >= crash_depth )
+        return 0;
+    return crash_recurse( depth + 1 ) + pad[ 0 ];
+}
+#endif
+
+
+void test_crashflush( void )
+{
+    lg_host_t host;
+    pid_t     pid;
+    int       status;
+
+    prepare_testout();
+
+    pid = fork();
+    if ( pid == 0 ) {
+        host = lg_host_new( st_nil );
+        lg_host_config( host, "crashflush", st_true );
+        lg_grp_top( host, "crash", "test/out/crash.log", st_nil, st_nil );
+        lg( host, "crash", "last words" );
+        abort();
+    }
+
+    waitpid( pid, &status, 0 );
+    TEST_ASSERT_TRUE( WIFSIGNALED( status ) && WTERMSIG( status ) == SIGABRT );
+    check_file_content( "test/out/crash.log", "last words\n" );
+
+    /* Queued messages, writer thread is not running in child. */
+    host = lg_host_new( st_nil );
+    lg_host_async( host, 16, LG_ASYNC_BLOCK );
+    lg_grp_top( host, "crash", "test/out/crash_async.log", st_nil, st_nil );
+    pid = fork();
+    if ( pid == 0 ) {
+        lg_host_config( host, "crashflush", st_true );
+        lg( host, "crash", "queued 1" );
+        lg( host, "crash", "queued 2" );
+        abort();
+    }
+
+    waitpid( pid, &status, 0 );
+    TEST_ASSERT_TRUE( WIFSIGNALED( status ) && WTERMSIG( status ) == SIGABRT );
+    check_file_content( "test/out/crash_async.log", "queued 1\nqueued 2\n" );
+    lg_host_del( host );
+
+#if !defined( __SANITIZE_ADDRESS__ ) && !defined( __SANITIZE_THREAD__ )
+    /* Stack overflow needs the alternate stack. Sanitizers handle
+     * overflow by themselves. */
+    pid = fork();
+    if ( pid == 0 ) {
+        host = lg_host_new( st_nil );
+        lg_host_config( host, "crashflush", st_true );
+        lg_grp_top( host, "crash", "test/out/crash_stack.log", st_nil, st_nil );
+        lg( host, "crash", "overflow" );
+        crash_recurse( 0 );
+        exit( 0 );
+    }
+
+    waitpid( pid, &status, 0 );
+    TEST_ASSERT_TRUE( WIFSIGNALED( status ) && WTERMSIG( status ) == SIGSEGV );
+    check_file_content( "test/out/crash_stack.log", "overflow\n" );
+#endif
+
+    clean_testout();
+}
+
+
+void test_limit( void )
+{
+    lg_host_t host;
+    int       i;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_grp_top( host, "sample", "test/out/sample.log", st_nil, st_nil );
+    lg_grp_top( host, "limit", "test/out/limit.log", st_nil, st_nil );
+
+    lg_grp_sample( host, "sample", 3 );
+    for ( i = 0; i < 8; i++ )
+        lg( host, "sample", "sample %d", i );
+    TEST_ASSERT_TRUE( lg_grp_rejected( host, "sample" ) == 5 );
+
+    /* 5 per second with burst of 2. Messages are rejected for 200 ms,
+     * and the wait is 3 times that. */
+    lg_grp_limit( host, "limit", 5, 2 );
+    for ( i = 0; i < 5; i++ )
+        lg( host, "limit", "limit %d", i );
+    TEST_ASSERT_TRUE( lg_grp_rejected( host, "limit" ) == 3 );
+    usleep( 600000 );
+    lg( host, "limit", "recovered" );
+
+    lg_host_del( host );
+
+    check_file_content( "test/out/sample.log", "sample 0\nsample 3\nsample 6\n" );
+    check_file_content( "test/out/limit.log",
+                        "limit 0\nlimit 1\n3 messages suppressed\nrecovered\n" );
+
+    clean_testout();
+}
+
+
+static void* thread_dup( void* arg )
+{
+    thread_arg_t* ta = (thread_arg_t*)arg;
+    int           i;
+
+    for ( i = 0; i < THREAD_MSG; i++ )
+        lg_h( ta->host, ta->grp, "block %d", ( i / 3 + ta->id ) % 2 );
+
+    return NULL;
+}
+
+
+void test_coalesce( void )
+{
+    lg_host_t    host;
+    pthread_t    threads[ THREAD_CNT ];
+    thread_arg_t args[ THREAD_CNT ];
+    int          i;
+    int          total;
+    int          n;
+    sl_t         ss;
+    char*        line;
+    char*        prev;
+    char*        save;
+    int          summary;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_grp_top( host, "dup", "test/out/dup.log", st_nil, st_nil );
+    lg_grp_coalesce( host, "dup", st_true, 0 );
+
+    lg( host, "dup", "first" );
+    for ( i = 0; i < 5; i++ )
+        lg( host, "dup", "retry %d", 1 );
+    lg( host, "dup", "other" );
+    lg( host, "dup", "other" );
+
+    lg_host_del( host );
+
+    check_file_content( "test/out/dup.log",
+                        "first\nretry 1\nlast message repeated 4 times\nother\n"
+                        "last message repeated 1 times\n" );
+
+    /* Binary File gets every repeat. */
+    host = lg_host_new( st_nil );
+    lg_grp_top( host, "dup", "test/out/dup_text.log", st_nil, st_nil );
+    lg_grp_join_file_type( host, "dup", "test/out/dup.lgb", LG_LOG_TYPE_BIN );
+    lg_grp_coalesce( host, "dup", st_true, 0 );
+    for ( i = 0; i < 3; i++ )
+        lg( host, "dup", "retry %d", 1 );
+    lg( host, "dup", "done" );
+    lg_host_del( host );
+
+    check_file_content( "test/out/dup_text.log", "retry 1\nlast message repeated 2 times\ndone\n" );
+    TEST_ASSERT_TRUE( system( "make -s -C tools lgdecode > /dev/null" ) == 0 );
+    TEST_ASSERT_TRUE( system( "tools/lgdecode test/out/dup.lgb > test/out/dup_bin.txt" ) == 0 );
+    ss = sl_read_file( "test/out/dup_bin.txt" );
+    n = 0;
+    for ( line = strstr( ss, "retry 1" ); line; line = strstr( line + 1, "retry 1" ) )
+        n++;
+    TEST_ASSERT_TRUE( n == 3 );
+    TEST_ASSERT_TRUE( strstr( ss, "repeated" ) == st_nil );
+    sl_del( &ss );
+
+    /* Summary is written after timeout without further messages. */
+    host = lg_host_new( st_nil );
+    lg_host_config( host, "threaded", st_true );
+    lg_log_buffer( host, "test/out/dup_time.log", LG_BUF_NONE, 0 );
+    lg_grp_top( host, "dup", "test/out/dup_time.log", st_nil, st_nil );
+    lg_grp_coalesce( host, "dup", st_true, 20 );
+    for ( i = 0; i < 3; i++ )
+        lg( host, "dup", "retry %d", 1 );
+    usleep( 100000 );
+    check_file_content( "test/out/dup_time.log", "retry 1\nlast message repeated 2 times\n" );
+    lg_host_del( host );
+
+    /* Summary is followed by a different message, and all messages
+     * are accounted for. */
+    host = lg_host_new( st_nil );
+    lg_host_config( host, "threaded", st_true );
+    lg_grp_top( host, "dup", "test/out/dup_mt.log", st_nil, st_nil );
+    lg_grp_coalesce( host, "dup", st_true, 0 );
+    for ( i = 0; i < THREAD_CNT; i++ ) {
+        args[ i ].host = host;
+        args[ i ].grp = lg_grp_get( host, "dup" );
+        args[ i ].id = i;
+        pthread_create( &threads[ i ], NULL, thread_dup, &args[ i ] );
+    }
+    for ( i = 0; i < THREAD_CNT; i++ )
+        pthread_join( threads[ i ], NULL );
+    lg_host_del( host );
+
+    ss = sl_read_file( "test/out/dup_mt.log" );
+    total = 0;
+    prev = st_nil;
+    summary = 0;
+    for ( line = strtok_r( ss, "\n", &save ); line; line = strtok_r( NULL, "\n", &save ) ) {
+        if ( sscanf( line, "last message repeated %d times", &n ) == 1 ) {
+            TEST_ASSERT_TRUE( prev && !summary );
+            total += n;
+            summary = 1;
+        } else {
+            TEST_ASSERT_TRUE( !summary || strcmp( line, prev ) );
+            total++;
+            prev = line;
+            summary = 0;
+        }
+    }
+    sl_del( &ss );
+    TEST_ASSERT_TRUE( total == THREAD_CNT * THREAD_MSG );
+
+    clean_testout();
+}
+
+
+void test_stamp( void )
+{
+    lg_host_t host;
+    sl_t      ss;
+    sl_t      ts;
+    char*     line;
+    double    m[ 4 ];
+    double    t[ 3 ];
+    int       i;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_grp_top( host, "wall", "test/out/wall.log", lg_prefix_wall, st_nil );
+    lg_grp_top( host, "mono", "test/out/mono.log", lg_prefix_mono, st_nil );
+    lg_grp_top( host, "tsc", "test/out/tsc.log", lg_prefix_tsc, st_nil );
+    lg( host, "wall", "first" );
+    lg( host, "wall", "second" );
+    lg( host, "mono", "mono" );
+    lg( host, "tsc", "tsc" );
+    lg( host, "mono", "mono" );
+    /* Calibrated TSC. */
+    usleep( 150000 );
+    lg( host, "tsc", "tsc" );
+    lg( host, "mono", "mono" );
+    lg( host, "tsc", "tsc" );
+    lg( host, "mono", "mono" );
+    lg_host_del( host );
+
+    /* "YYYY-MM-DD HH:MM:SS.uuuuuu first" */
+    ss = sl_read_file( "test/out/wall.log" );
+    TEST_ASSERT_TRUE( ss[ 4 ] == '-' && ss[ 10 ] == ' ' && ss[ 13 ] == ':' && ss[ 19 ] == '.' );
+    TEST_ASSERT_TRUE( !strncmp( ss + 27, "first\n", 6 ) );
+    line = strchr( ss, '\n' ) + 1;
+    TEST_ASSERT_TRUE( !strcmp( line + 27, "second\n" ) );
+    sl_del( &ss );
+
+    ss = sl_read_file( "test/out/mono.log" );
+    TEST_ASSERT_TRUE( ss[ 0 ] == '[' && strstr( ss, "] mono\n" ) );
+    ts = sl_read_file( "test/out/tsc.log" );
+    TEST_ASSERT_TRUE( ts[ 0 ] == '[' && strstr( ts, "] tsc\n" ) );
+
+    /* TSC stamps are monotonic time, between the mono stamps. */
+    TEST_ASSERT_TRUE( sscanf( ss, "[%lf] mono\n[%lf] mono\n[%lf] mono\n[%lf]",
+                              &m[ 0 ], &m[ 1 ], &m[ 2 ], &m[ 3 ] ) == 4 );
+    TEST_ASSERT_TRUE( sscanf( ts, "[%lf] tsc\n[%lf] tsc\n[%lf]", &t[ 0 ], &t[ 1 ], &t[ 2 ] ) == 3 );
+    for ( i = 0; i < 3; i++ )
+        TEST_ASSERT_TRUE( t[ i ] >= m[ i ] - 0.001 && t[ i ] <= m[ i + 1 ] + 0.001 );
+    sl_del( &ss );
+    sl_del( &ts );
+
+    clean_testout();
+}
+
+
+void test_pattern( void )
+{
+    lg_host_t   host;
+    sl_t        ss;
+    char        data[ 64 ];
+    const char* expect = "app [top] #0 100%: top <top #0>\n"
+                         "app [top/sub] #0 100%: sub <top/sub #0>\n"
+                         "app [top] #1 100%: again <top #1>\n"
+                         "> str <top #2>\n";
+
+    prepare_testout();
+
+    host = lg_host_new( "app" );
+    lg_grp_top( host, "top", "test/out/pat.log", st_nil, st_nil );
+    lg_grp_sub( host, "top", "sub" );
+    lg_grp_prefix_pat( host, "top", "app [%g] #%n 100%%: " );
+    lg_grp_postfix_pat( host, "top", " <%g #%n>" );
+
+    lg( host, "top", "top" );
+    lg( host, "top/sub", "sub" );
+    lg( host, "top", "again" );
+
+    /* Replaced by constant string. */
+    lg_grp_prefix_str( host, "top", "> " );
+    lg( host, "top", "str" );
+
+    lg_grp_prefix_pat( host, "top", "%t|%q|" );
+    lg( host, "top", "tid" );
+
+    /* Host data is shown as pointer value. */
+    lg_grp_prefix_pat( host, "top", "[%d] " );
+    lg( host, "top", "data" );
+    sprintf( data, "[0x%" PRIxPTR "] data <top #4>\n", (uintptr_t)lg_host_data( host ) );
+
+    lg_host_del( host );
+
+    ss = sl_read_file( "test/out/pat.log" );
+    TEST_ASSERT_TRUE( !strncmp( ss, expect, strlen( expect ) ) );
+    TEST_ASSERT_TRUE( strstr( ss, "|%q|tid <top #3>\n" ) );
+    TEST_ASSERT_TRUE( strstr( ss, data ) );
+    sl_del( &ss );
+
+    clean_testout();
+}
+
+
+static int fast_check( lg_fast_t fast, const char* format, ... )
+{
+    sl_t    buf;
+    sl_t    ref;
+    int     handled;
+    int     same;
+    va_list ap;
+
+    buf = sl_new( 16 );
+    ref = sl_new( 16 );
+
+    va_start( ap, format );
+    handled = lg_fast_format( fast, &buf, format, ap );
+    va_end( ap );
+
+    /* Fast path replaces Slinky formatting. */
+    va_start( ap, format );
+    sl_va_format( &ref, format, ap );
+    va_end( ap );
+
+    same = ( sl_length( buf ) == sl_length( ref ) && !memcmp( buf, ref, sl_length( ref ) ) );
+    sl_del( &buf );
+    sl_del( &ref );
+
+    return handled ? same : -1;
+}
+
+
+void test_fastfmt( void )
+{
+    lg_fast_t fast;
+    lg_host_t host;
+    char      big[ 700 ];
+    char      fmt[ 16 ];
+    int       i;
+
+    fast = lg_fast_new();
+
+    memset( big, 'a', sizeof( big ) - 1 );
+    big[ sizeof( big ) - 1 ] = 0;
+
+    for ( i = 0; i < 2; i++ ) {
+        TEST_ASSERT_TRUE( fast_check( fast, "plain" ) == 1 );
+        TEST_ASSERT_TRUE( fast_check( fast, "%d %i %u", -12, 0, 4000000000u ) == 1 );
+        TEST_ASSERT_TRUE( fast_check( fast, "[%5d|%-5d|%05d]", -42, 42, -42 ) == 1 );
+        TEST_ASSERT_TRUE( fast_check( fast, "%ld %lld %zu", LONG_MIN, LLONG_MIN, (size_t)-1 ) == 1 );
+        TEST_ASSERT_TRUE( fast_check( fast, "%x %X %08lx", 0xbeefu, 0xbeefu, 0x1234ul ) == 1 );
+        TEST_ASSERT_TRUE( fast_check( fast, "%c|%3c|%-3c|", 'a', 'b', 'c' ) == 1 );
+        TEST_ASSERT_TRUE( fast_check( fast, "nul: %c after", 0 ) == 1 );
+        TEST_ASSERT_TRUE( fast_check( fast, "%s|%8s|%-8s|", "str", "str", "str" ) == 1 );
+        TEST_ASSERT_TRUE( fast_check( fast, "%s %s", (char*)NULL, big ) == 1 );
+        TEST_ASSERT_TRUE( fast_check( fast, "%p %p", (void*)fast, (void*)NULL ) == 1 );
+        TEST_ASSERT_TRUE( fast_check( fast, "100%% %d%%", 5 ) == 1 );
+        TEST_ASSERT_TRUE( fast_check( fast, "%f", 1.5 ) == -1 );
+        TEST_ASSERT_TRUE( fast_check( fast, "%.3s", "str" ) == -1 );
+    }
+
+    /* Reused format buffer is not formatted with cached program. */
+    strcpy( fmt, "a=%d" );
+    TEST_ASSERT_TRUE( fast_check( fast, fmt, 1 ) == 1 );
+    strcpy( fmt, "b=%x" );
+    TEST_ASSERT_TRUE( fast_check( fast, fmt, 255 ) == -1 );
+
+    lg_fast_del( fast );
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_grp_log( host, "fast", "test/out/fast.log" );
+    strcpy( fmt, "a=%d" );
+    lg( host, "fast", fmt, 1 );
+    strcpy( fmt, "b=%x" );
+    lg( host, "fast", fmt, 255 );
+    strcpy( fmt, "%s" );
+    lg( host, "fast", fmt, "str" );
+    lg_host_del( host );
+
+    check_file_content( "test/out/fast.log", "a=1\nb=ff\nstr\n" );
+
+    clean_testout();
+}
+
+
+static void glob_count( lg_host_t host, lg_grp_t grp, void* arg )
+{
+    (void)host;
+    (void)grp;
+    ( *(int*)arg )++;
+}
+
+
+void test_glob( void )
+{
+    lg_host_t host;
+    int       cnt;
+    char      name[ 32 ];
+
+    host = lg_host_new( st_nil );
+
+    lg_grp_top( host, "net", st_nil, st_nil, st_nil );
+    lg_grp_sub( host, "net", "tcp" );
+    lg_grp_sub( host, "net", "udp" );
+    lg_grp_top( host, "net/tcp/rx", st_nil, st_nil, st_nil );
+    lg_grp_sub( host, "net/tcp/rx", "debug" );
+    lg_grp_top( host, "network", st_nil, st_nil, st_nil );
+    lg_grp_sub( host, "network", "debug" );
+
+    cnt = 0;
+    TEST_ASSERT_TRUE( lg_grp_each( host, "net/*", glob_count, &cnt ) == 2 );
+    TEST_ASSERT_TRUE( cnt == 2 );
+    TEST_ASSERT_TRUE( lg_grp_each( host, "net*", glob_count, &cnt ) == 2 );
+    TEST_ASSERT_TRUE( lg_grp_each( host, "*/debug", glob_count, &cnt ) == 1 );
+    TEST_ASSERT_TRUE( lg_grp_each( host, "**/debug", glob_count, &cnt ) == 2 );
+    TEST_ASSERT_TRUE( lg_grp_each( host, "**/**/debug", glob_count, &cnt ) == 2 );
+    TEST_ASSERT_TRUE( lg_grp_each( host, "net/[tu]?p", glob_count, &cnt ) == 2 );
+    TEST_ASSERT_TRUE( lg_grp_each( host, "**", glob_count, &cnt ) == 7 );
+    TEST_ASSERT_TRUE( lg_grp_each( host, "missing/*", glob_count, &cnt ) == 0 );
+
+    TEST_ASSERT_TRUE( lg_grp_each_prefix( host, "net", glob_count, &cnt ) == 5 );
+    TEST_ASSERT_TRUE( lg_grp_each_prefix( host, "net/tcp/rx", glob_count, &cnt ) == 2 );
+    TEST_ASSERT_TRUE( lg_grp_each_prefix( host, "", glob_count, &cnt ) == 7 );
+    TEST_ASSERT_TRUE( lg_grp_each_prefix( host, "net/sctp", glob_count, &cnt ) == 0 );
+
+    lg_grp_n_glob( host, "**/debug" );
+    TEST_ASSERT_TRUE( !lg_grp_get( host, "net/tcp/rx/debug" )->active );
+    TEST_ASSERT_TRUE( !lg_grp_get( host, "network/debug" )->active );
+    TEST_ASSERT_TRUE( lg_grp_get( host, "net/tcp/rx" )->active );
+
+    lg_grp_n_glob( host, "net/*" );
+    TEST_ASSERT_TRUE( !lg_grp_get( host, "net/tcp" )->active );
+    TEST_ASSERT_TRUE( !lg_grp_get( host, "net/udp" )->active );
+    TEST_ASSERT_TRUE( lg_grp_get( host, "net" )->active );
+
+    lg_grp_y_glob( host, "n*/**" );
+    TEST_ASSERT_TRUE( lg_grp_get( host, "net/tcp" )->active );
+    TEST_ASSERT_TRUE( lg_grp_get( host, "network/debug" )->active );
+
+    /* Plain names and escapes. */
+    lg_grp_top( host, "star*", st_nil, st_nil, st_nil );
+    lg_grp_top( host, "starx", st_nil, st_nil, st_nil );
+    lg_grp_n( host, "star*" );
+    TEST_ASSERT_TRUE( !lg_grp_get( host, "star*" )->active );
+    TEST_ASSERT_TRUE( lg_grp_get( host, "starx" )->active );
+    lg_grp_y( host, "star*" );
+    lg_grp_n_glob( host, "sta?\\*" );
+    TEST_ASSERT_TRUE( !lg_grp_get( host, "star*" )->active );
+    TEST_ASSERT_TRUE( lg_grp_get( host, "starx" )->active );
+
+    /* Wide level is hashed. */
+    for ( cnt = 0; cnt < 20; cnt++ ) {
+        snprintf( name, sizeof( name ), "wide/k%d", cnt );
+        lg_grp_top( host, name, st_nil, st_nil, st_nil );
+    }
+    TEST_ASSERT_TRUE( lg_grp_each( host, "wide/k1*", glob_count, &cnt ) == 11 );
+    TEST_ASSERT_TRUE( lg_grp_each_prefix( host, "wide/k19", glob_count, &cnt ) == 1 );
+    TEST_ASSERT_TRUE( lg_grp_each_prefix( host, "wide/k20", glob_count, &cnt ) == 0 );
+
+    lg_host_del( host );
+}
+
+
+static void write_rules( const char* file, const char* rules )
+{
+    FILE* fh;
+
+    fh = fopen( "test/out/rules.tmp", "w" );
+    fputs( rules, fh );
+    fclose( fh );
+    rename( "test/out/rules.tmp", file );
+}
+
+
+static int wait_grp_on( lg_host_t host, const char* name, int on )
+{
+    int i;
+
+    for ( i = 0; i < 200; i++ ) {
+        if ( lg_grp_on( host, lg_grp_get( host, name ) ) == on )
+            return 1;
+        usleep( 10000 );
+    }
+
+    return 0;
+}
+
+
+static int rule_count( po_t rules )
+{
+    lg_rule_t rule;
+    int       cnt = 0;
+
+    po_each( rules, rule, lg_rule_t )
+    {
+        (void)rule;
+        cnt++;
+    }
+
+    return cnt;
+}
+
+
+void test_rules( void )
+{
+    lg_host_t host;
+    lg_grp_t  dbg;
+    int       i;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_grp_top( host, "app", st_nil, st_nil, st_nil );
+    dbg = lg_grp_sub( host, "app", "debug" );
+    lg_grp_sub( host, "app", "info" );
+
+    /* Effective state follows Host. */
+    TEST_ASSERT_TRUE( lg_grp_on( host, dbg ) );
+    lg_host_n( host );
+    TEST_ASSERT_TRUE( !lg_grp_on( host, dbg ) );
+    lg_host_y( host );
+    TEST_ASSERT_TRUE( lg_grp_on( host, dbg ) );
+
+    /* Rules apply to existing and new Groups. */
+    TEST_ASSERT_TRUE( lg_host_rules( host, "**/debug=n, bad=x # app=n\n lib/*=n" ) == 2 );
+    TEST_ASSERT_TRUE( !lg_grp_on( host, dbg ) );
+    TEST_ASSERT_TRUE( lg_grp_on( host, lg_grp_get( host, "app" ) ) );
+    lg_grp_top( host, "lib", st_nil, st_nil, st_nil );
+    lg_grp_sub( host, "lib", "debug" );
+    lg_grp_sub( host, "lib", "io" );
+    TEST_ASSERT_TRUE( lg_grp_on( host, lg_grp_get( host, "lib" ) ) );
+    TEST_ASSERT_TRUE( !lg_grp_on( host, lg_grp_get( host, "lib/io" ) ) );
+    TEST_ASSERT_TRUE( !lg_grp_on( host, lg_grp_get( host, "lib/debug" ) ) );
+
+    setenv( "LG_TEST_GROUPS", "lib/io=y", 1 );
+    TEST_ASSERT_TRUE( lg_host_rules_env( host, "LG_TEST_GROUPS" ) == 1 );
+    TEST_ASSERT_TRUE( lg_grp_on( host, lg_grp_get( host, "lib/io" ) ) );
+    TEST_ASSERT_TRUE( lg_host_rules_env( host, "LG_TEST_MISSING" ) == 0 );
+
+    /* Rule replaces earlier rule with same pattern. */
+    for ( i = 0; i < 100; i++ )
+        lg_host_rules( host, ( i % 2 ) ? "lib/io=y" : "lib/io=n" );
+    TEST_ASSERT_TRUE( lg_grp_on( host, lg_grp_get( host, "lib/io" ) ) );
+    TEST_ASSERT_TRUE( rule_count( host->rules ) == 3 );
+
+    /* Watched file. */
+    lg_host_config( host, "threaded", st_true );
+    write_rules( "test/out/rules.conf", "app/info=n\n" );
+    TEST_ASSERT_TRUE( lg_host_watch( host, "test/out/rules.conf" ) == 0 );
+    TEST_ASSERT_TRUE( !lg_grp_on( host, lg_grp_get( host, "app/info" ) ) );
+
+    write_rules( "test/out/rules.conf", "# Incident.\napp/debug=y\n" );
+    TEST_ASSERT_TRUE( wait_grp_on( host, "app/debug", 1 ) );
+
+    write_rules( "test/out/rules.conf", "app/*=n\n" );
+    TEST_ASSERT_TRUE( wait_grp_on( host, "app/info", 0 ) );
+    TEST_ASSERT_TRUE( !lg_grp_on( host, dbg ) );
+
+    lg_host_del( host );
+
+    host = lg_host_new( st_nil );
+    lg_host_config( host, "threaded", st_true );
+    TEST_ASSERT_TRUE( lg_host_watch( host, "test/out/missing/rules.conf" ) == -1 );
+    lg_host_del( host );
+
+    clean_testout();
+}
+
+
+void test_stats( void )
+{
+    lg_host_t      host;
+    lg_grp_t       grp;
+    lg_stats_t     stats;
+    lg_grp_stats_t gs;
+    lg_log_stats_t ls;
+    sl_t           ss;
+    size_t         i;
+    int            j;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_host_config( host, "stats", st_true );
+    grp = lg_grp_log( host, "app", "test/out/stats.log" );
+    lg_grp_log( host, "off", "test/out/stats.log" );
+    lg_grp_n( host, "off" );
+    lg_log_buffer( host, "test/out/stats.log", LG_BUF_NONE, 0 );
+
+    for ( j = 0; j < 10; j++ )
+        lg_h( host, grp, "msg %d", j );
+    lg( host, "off", "dropped" );
+    lg_h( host, lg_grp_get( host, "off" ), "dropped" );
+
+    stats = lg_host_stats( host );
+    TEST_ASSERT_TRUE( stats->grp_cnt == 2 );
+    TEST_ASSERT_TRUE( stats->log_cnt == 1 );
+
+    for ( i = 0; i < stats->grp_cnt; i++ ) {
+        gs = &stats->grps[ i ];
+        if ( !strcmp( gs->name, "app" ) )
+            TEST_ASSERT_TRUE( gs->msgs == 10 && gs->inactive == 0 );
+        else
+            TEST_ASSERT_TRUE( gs->msgs == 0 && gs->inactive == 2 );
+    }
+
+    ls = &stats->logs[ 0 ];
+    TEST_ASSERT_TRUE( strstr( ls->name, "stats.log" ) );
+    TEST_ASSERT_TRUE( ls->msgs == 10 );
+    TEST_ASSERT_TRUE( ls->bytes == 60 );
+    TEST_ASSERT_TRUE( ls->writes == 10 );
+    TEST_ASSERT_TRUE( ls->errors == 0 );
+    TEST_ASSERT_TRUE( lg_hist_count( ls->hist ) == 10 );
+    TEST_ASSERT_TRUE( lg_hist_percentile( ls->hist, 50.0 ) > 0 );
+    TEST_ASSERT_TRUE( lg_hist_percentile( ls->hist, 50.0 ) <= lg_hist_percentile( ls->hist, 100.0 ) );
+    lg_stats_del( stats );
+
+    /* Histogram buckets are within 1/8 of value. */
+    for ( j = 0; j < 60; j++ ) {
+        uint64_t value = ( 1ULL << j ) + 3 * j;
+        TEST_ASSERT_TRUE( lg_hist_value( lg_hist_index( value ) ) <= value );
+        TEST_ASSERT_TRUE( lg_hist_value( lg_hist_index( value ) + 1 ) > value );
+    }
+
+    lg_grp_log( host, "stats", "test/out/dump.log" );
+    lg_host_stats_dump( host, "stats" );
+
+    lg_host_del( host );
+
+    ss = sl_read_file( "test/out/dump.log" );
+    TEST_ASSERT_TRUE( strstr( ss, "grp app msgs=10 inactive=0 rejected=0\n" ) );
+    TEST_ASSERT_TRUE( strstr( ss, "grp off msgs=0 inactive=2 rejected=0\n" ) );
+    TEST_ASSERT_TRUE( strstr( ss, "stats.log msgs=10 bytes=60 writes=10 errors=0 p50=" ) );
+    sl_del( &ss );
+
+    /* Write errors are counted without "stats", messages are not. */
+    if ( check_file_exists( "/dev/full" ) ) {
+        host = lg_host_new( st_nil );
+        grp = lg_grp_log( host, "full", "/dev/full" );
+        lg_grp_n( host, "full" );
+        lg_log_buffer( host, "/dev/full", LG_BUF_NONE, 0 );
+        for ( j = 0; j < 3; j++ )
+            lg_h( host, grp, "msg %d", j );
+        lg_grp_y( host, "full" );
+        for ( j = 0; j < 3; j++ )
+            lg_h( host, grp, "msg %d", j );
+
+        stats = lg_host_stats( host );
+        TEST_ASSERT_TRUE( stats->grps[ 0 ].msgs == 0 && stats->grps[ 0 ].inactive == 0 );
+        ls = &stats->logs[ 0 ];
+        TEST_ASSERT_TRUE( !strcmp( ls->name, "/dev/full" ) );
+        TEST_ASSERT_TRUE( ls->msgs == 0 && ls->bytes == 0 );
+        TEST_ASSERT_TRUE( ls->writes == 3 );
+        TEST_ASSERT_TRUE( ls->errors == 3 );
+        TEST_ASSERT_TRUE( lg_hist_count( ls->hist ) == 0 );
+        lg_stats_del( stats );
+        lg_host_del( host );
+    }
+
+    clean_testout();
+}
+
+
+static int kv_escape( const char* str, int logfmt, const char* expect )
+{
+    lg_fmt_buf_s out;
+    int          ret;
+
+    lg_fmt_buf_init( &out );
+    if ( logfmt )
+        lg_kv_escape_logfmt( &out, str, strlen( str ) );
+    else
+        lg_kv_escape_json( &out, str, strlen( str ) );
+    ret = ( out.len == strlen( expect ) && !memcmp( out.data, expect, out.len ) );
+    lg_fmt_buf_free( &out );
+
+    return ret;
+}
+
+
+void test_kv( void )
+{
+    lg_host_t host;
+    lg_grp_t  grp;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    grp = lg_grp_log( host, "app", "test/out/kv.txt" );
+    lg_grp_join_file( host, "app", "test/out/kv.json" );
+    lg_grp_join_file( host, "app", "test/out/kv.fmt" );
+    lg_log_encoding( host, "test/out/kv.json", LG_ENC_JSON );
+    lg_log_encoding( host, "test/out/kv.fmt", LG_ENC_LOGFMT );
+    lg_grp_prefix_str( host, "app", "[app] " );
+    lg_grp_postfix_str( host, "app", " ." );
+
+    LG_KV( host,
+           grp,
+           "start",
+           LG_I64( "n", -42 ),
+           LG_U64( "u", 7 ),
+           LG_F64( "f", 1.5 ),
+           LG_STR( "s", "a \"b\"\n" ),
+           LG_BOOL( "ok", 1 ),
+           LG_STR( "z", st_nil ) );
+    lg_h( host, grp, "plain" );
+
+    lg_grp_n( host, "app" );
+    LG_KV( host, grp, "off", LG_I64( "n", 1 ) );
+
+    lg_host_del( host );
+
+    check_file_content( "test/out/kv.txt",
+                        "[app] start n=-42 u=7 f=1.5 s=\"a \\\"b\\\"\\n\" ok=true z=null .\n"
+                        "[app] plain .\n" );
+    check_file_content( "test/out/kv.json",
+                        "{\"prefix\":\"[app]\",\"grp\":\"app\",\"msg\":\"start\",\"n\":-42,\"u\":7,"
+                        "\"f\":1.5,\"s\":\"a \\\"b\\\"\\n\",\"ok\":true,\"z\":null,\"postfix\":\".\"}\n"
+                        "[app] plain .\n" );
+    check_file_content( "test/out/kv.fmt",
+                        "prefix=[app] grp=app msg=start n=-42 u=7 f=1.5 s=\"a \\\"b\\\"\\n\" ok=true z= "
+                        "postfix=.\n"
+                        "[app] plain .\n" );
+
+    /* Async Host. */
+    host = lg_host_new( st_nil );
+    lg_host_async( host, 64, LG_ASYNC_BLOCK );
+    grp = lg_grp_log( host, "app", "test/out/kv_async.json" );
+    lg_log_encoding( host, "test/out/kv_async.json", LG_ENC_JSON );
+    LG_KV( host, grp, "a", LG_F64( "inf", 1.0 / 0.0 ), LG_STR( "e", "" ) );
+    lg_host_del( host );
+
+    check_file_content( "test/out/kv_async.json",
+                        "{\"grp\":\"app\",\"msg\":\"a\",\"inf\":null,\"e\":\"\"}\n" );
+
+    /* Keys are sanitized, and encoding is set for any File type. */
+    host = lg_host_new( st_nil );
+    grp = lg_grp_log( host, "app", "test/out/kv_key.txt" );
+    lg_grp_join_file_type( host, "app", "test/out/kv_key.fmt", LG_LOG_TYPE_MMAP );
+    lg_log_encoding( host, "test/out/kv_key.fmt", LG_ENC_LOGFMT );
+    LG_KV( host, grp, "k", LG_I64( "a b=\"c\"\n", 1 ), LG_STR( "", "x" ) );
+    lg_host_del( host );
+
+    check_file_content( "test/out/kv_key.txt", "k a_b__c__=1 _=\"x\"\n" );
+    check_file_content( "test/out/kv_key.fmt", "grp=app msg=k a_b__c__=1 _=x\n" );
+
+    /* Escaping of long strings (vector scan and tail). */
+    TEST_ASSERT_TRUE( kv_escape( "0123456789abcdef0123\"56789abcdef012\001", 0,
+                                 "0123456789abcdef0123\\\"56789abcdef012\\u0001" ) );
+    TEST_ASSERT_TRUE( kv_escape( "0123456789abcdef0123456789abcdef\\", 0,
+                                 "0123456789abcdef0123456789abcdef\\\\" ) );
+    TEST_ASSERT_TRUE( kv_escape( "0123456789abcdef0123456789abcdef", 1,
+                                 "0123456789abcdef0123456789abcdef" ) );
+    TEST_ASSERT_TRUE( kv_escape( "0123456789abcdef01234567 9abcdef", 1,
+                                 "\"0123456789abcdef01234567 9abcdef\"" ) );
+    TEST_ASSERT_TRUE( kv_escape( "a=b\tc\x7f", 1, "\"a=b\\tc\x7f\"" ) );
+    TEST_ASSERT_TRUE( kv_escape( "", 1, "\"\"" ) );
+
+    clean_testout();
+}
+
+
+/** Shard with the first record. */
+static int shard_first;
+
+
+/**
+ * Check records of shard File, mark their sequence numbers and count
+ * messages of threads.
+ *
+ * @return Number of records.
+ */
+static int shard_check( const char* file, uint32_t shard, uint64_t* run, uint8_t* seen, int* counts )
+{
+    FILE*    fh;
+    char     head[ LG_SHARD_HEAD ];
+    char     rec[ LG_SHARD_REC_HEAD ];
+    char     msg[ 64 ];
+    uint32_t num;
+    uint32_t len;
+    uint64_t seq;
+    uint64_t prev;
+    int      cnt;
+    int      id;
+    int      idx;
+
+    fh = fopen( file, "rb" );
+    TEST_ASSERT_TRUE( fh != NULL );
+    TEST_ASSERT_TRUE( fread( head, 1, LG_SHARD_HEAD, fh ) == LG_SHARD_HEAD );
+    TEST_ASSERT_TRUE( !memcmp( head, LG_SHARD_MAGIC, 4 ) );
+    memcpy( &num, head + 8, 4 );
+    TEST_ASSERT_TRUE( num == shard );
+    memcpy( &num, head + 12, 4 );
+    TEST_ASSERT_TRUE( num == THREAD_CNT );
+    memcpy( &seq, head + 16, 8 );
+    TEST_ASSERT_TRUE( *run == 0 || *run == seq );
+    *run = seq;
+
+    cnt = 0;
+    prev = 0;
+    while ( fread( rec, 1, LG_SHARD_REC_HEAD, fh ) == LG_SHARD_REC_HEAD ) {
+        memcpy( &seq, rec, 8 );
+        memcpy( &len, rec + 16, 4 );
+        TEST_ASSERT_TRUE( len < sizeof( msg ) );
+        TEST_ASSERT_TRUE( fread( msg, 1, len, fh ) == len );
+        msg[ len ] = 0;
+        TEST_ASSERT_TRUE( cnt == 0 || seq > prev );
+        TEST_ASSERT_TRUE( seq < THREAD_CNT * THREAD_MSG && !seen[ seq ] );
+        seen[ seq ] = 1;
+        if ( seq == 0 )
+            shard_first = shard;
+        TEST_ASSERT_TRUE( sscanf( msg, "thread %d message %d", &id, &idx ) == 2 );
+        TEST_ASSERT_TRUE( id >= 0 && id < THREAD_CNT && idx == counts[ id ] );
+        counts[ id ]++;
+        prev = seq;
+        cnt++;
+    }
+    fclose( fh );
+
+    return cnt;
+}
+
+
+void test_shard( void )
+{
+    lg_host_t    host;
+    pthread_t    threads[ THREAD_CNT ];
+    thread_arg_t args[ THREAD_CNT ];
+    int          counts[ THREAD_CNT ] = { 0 };
+    lg_stats_t   stats;
+    uint64_t     run;
+    uint8_t*     seen;
+    sl_t         ss;
+    char*        line;
+    char         file[ 64 ];
+    int          total;
+    int          id;
+    int          idx;
+    int          i;
+
+    prepare_testout();
+
+    host = lg_host_new( st_nil );
+    lg_host_config( host, "threaded", st_true );
+    lg_host_config( host, "stats", st_true );
+    lg_log_shard( host, "test/out/shard.log", THREAD_CNT );
+    lg_grp_log( host, "app", st_nil );
+    lg_grp_join_file_type( host, "app", "test/out/shard.log", LG_LOG_TYPE_SHARD );
+
+    for ( i = 0; i < THREAD_CNT; i++ ) {
+        args[ i ].host = host;
+        args[ i ].grp = lg_grp_get( host, "app" );
+        args[ i ].id = i;
+        pthread_create( &threads[ i ], NULL, thread_logger, &args[ i ] );
+    }
+
+    for ( i = 0; i < THREAD_CNT; i++ )
+        pthread_join( threads[ i ], NULL );
+
+    /* Shard counters are summed to sharded Log. */
+    stats = lg_host_stats( host );
+    for ( i = 0; i < (int)stats->log_cnt; i++ ) {
+        if ( strstr( stats->logs[ i ].name, "shard.log" ) ) {
+            TEST_ASSERT_TRUE( stats->logs[ i ].msgs == THREAD_CNT * THREAD_MSG );
+            TEST_ASSERT_TRUE( lg_hist_count( stats->logs[ i ].hist ) == THREAD_CNT * THREAD_MSG );
+        }
+    }
+    lg_stats_del( stats );
+
+    lg_host_del( host );
+
+    run = 0;
+    seen = calloc( THREAD_CNT * THREAD_MSG, 1 );
+    total = 0;
+    for ( i = 0; i < THREAD_CNT; i++ ) {
+        sprintf( file, "test/out/shard.log.shard%d", i );
+        if ( check_file_exists( file ) )
+            total += shard_check( file, i, &run, seen, counts );
+    }
+    free( seen );
+
+    TEST_ASSERT_TRUE( total == THREAD_CNT * THREAD_MSG );
+    for ( i = 0; i < THREAD_CNT; i++ )
+        TEST_ASSERT_TRUE( counts[ i ] == THREAD_MSG );
+
+    /* Merged messages of each thread are in order. */
+    TEST_ASSERT_TRUE( system( "make -s -C tools lgmerge > /dev/null" ) == 0 );
+    TEST_ASSERT_TRUE(
+        system( "tools/lgmerge test/out/shard.log.shard* > test/out/merged.txt 2> test/out/merge.err" ) == 0 );
+    check_file_content( "test/out/merge.err", "" );
+
+    memset( counts, 0, sizeof( counts ) );
+    total = 0;
+    ss = sl_read_file( "test/out/merged.txt" );
+    for ( line = strtok( ss, "\n" ); line; line = strtok( NULL, "\n" ) ) {
+        TEST_ASSERT_TRUE( sscanf( line, "thread %d message %d", &id, &idx ) == 2 );
+        TEST_ASSERT_TRUE( id >= 0 && id < THREAD_CNT && idx == counts[ id ] );
+        counts[ id ]++;
+        total++;
+    }
+    sl_del( &ss );
+    TEST_ASSERT_TRUE( total == THREAD_CNT * THREAD_MSG );
+
+    /* Gap of a missing shard is reported. */
+    sprintf( file, "mv test/out/shard.log.shard%d test/out/first.shard", shard_first );
+    TEST_ASSERT_TRUE( system( file ) == 0 );
+    TEST_ASSERT_TRUE( system( "tools/lgmerge test/out/shard.log.shard* > /dev/null 2> test/out/merge.err" ) == 0 );
+    ss = sl_read_file( "test/out/merge.err" );
+    TEST_ASSERT_TRUE( !strncmp( ss, "lgmerge: missing records 0..", 28 ) );
+    sl_del( &ss );
+    sprintf( file, "mv test/out/first.shard test/out/shard.log.shard%d", shard_first );
+    TEST_ASSERT_TRUE( system( file ) == 0 );
+
+    /* New run deletes shards of earlier run, and shards of different
+       runs are not merged. */
+    rename( "test/out/shard.log.shard0", "test/out/old.shard0" );
+
+    host = lg_host_new( st_nil );
+    lg_log_shard( host, "test/out/shard.log", 1 );
+    lg_grp_log( host, "app", st_nil );
+    lg_grp_join_file_type( host, "app", "test/out/shard.log", LG_LOG_TYPE_SHARD );
+    lg( host, "app", "new" );
+    lg_host_del( host );
+
+    for ( i = 1; i < THREAD_CNT; i++ ) {
+        sprintf( file, "test/out/shard.log.shard%d", i );
+        TEST_ASSERT_TRUE( !check_file_exists( file ) );
+    }
+    TEST_ASSERT_TRUE( system( "tools/lgmerge test/out/shard.log.shard* > test/out/merged.txt" ) == 0 );
+    check_file_content( "test/out/merged.txt", "new\n" );
+    TEST_ASSERT_TRUE( system( "tools/lgmerge test/out/shard.log.shard0 test/out/old.shard0 "
+                              "> /dev/null 2> test/out/merge.err" )
+                      != 0 );
+    TEST_ASSERT_TRUE( system( "tools/lgmerge test/out/old.shard0 test/out/old.shard0 "
+                              "> /dev/null 2> test/out/merge.err" )
+                      != 0 );
+
+    clean_testout();
+}
@@ -0,0 +1,272 @@
+/**
+ * @file   lgdecode.c
+ *
+ * @brief  Decoder for Logger binary Logs.
+ *
+ * Converts binary Log to the text that the logging calls would have
+ * produced. Output can be limited to selected Groups with "-g"
+ * options. Messages of other Groups are skipped without rendering.
+ *
+ *     lgdecode [-g <group>]... <file>
+ *
+ */
+
+#include "lg_bin.h"
+#include "lg_fmt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/** String table. */
+typedef struct
+{
+    char**   strs; /**< Strings by id. */
+    uint32_t cnt;  /**< Number of slots. */
+} table_t;
+
+
+static void table_put( table_t* table, uint32_t id, const char* str, uint32_t len )
+{
+    if ( id >= table->cnt ) {
+        uint32_t cnt = table->cnt ? table->cnt : 64;
+        while ( cnt <= id )
+            cnt *= 2;
+        table->strs = realloc( table->strs, cnt * sizeof( char* ) );
+        memset( table->strs + table->cnt, 0, ( cnt - table->cnt ) * sizeof( char* ) );
+        table->cnt = cnt;
+    }
+
+    free( table->strs[ id ] );
+    table->strs[ id ] = malloc( len + 1 );
+    memcpy( table->strs[ id ], str, len );
+    table->strs[ id ][ len ] = 0;
+}
+
+
+static const char* table_get( table_t* table, uint32_t id )
+{
+    if ( id < table->cnt )
+        return table->strs[ id ];
+    else
+        return NULL;
+}
+
+
+static void table_free( table_t* table )
+{
+    uint32_t i;
+
+    for ( i = 0; i < table->cnt; i++ )
+        free( table->strs[ i ] );
+    free( table->strs );
+}
+
+
+static char* read_file( const char* name, size_t* len )
+{
+    FILE*  fh;
+    char*  data;
+    size_t size;
+    size_t ret;
+
+    fh = fopen( name, "rb" );
+    if ( fh == NULL )
+        return NULL;
+
+    size = 1 << 16;
+    data = malloc( size );
+    *len = 0;
+
+    while ( ( ret = fread( data + *len, 1, size - *len, fh ) ) > 0 ) {
+        *len += ret;
+        if ( *len == size ) {
+            size *= 2;
+            data = realloc( data, size );
+        }
+    }
+
+    fclose( fh );
+
+    return data;
+}
+
+
+static int selected( char** groups, int group_cnt, const char* name )
+{
+    int i;
+
+    if ( group_cnt == 0 )
+        return 1;
+
+    for ( i = 0; i < group_cnt; i++ )
+        if ( name && !strcmp( groups[ i ], name ) )
+            return 1;
+
+    return 0;
+}
+
+
+static int decode( const char* data, size_t len, char** groups, int group_cnt )
+{
+    table_t      strs = { NULL, 0 };
+    table_t      grps = { NULL, 0 };
+    lg_fmt_buf_s out;
+    size_t       pos;
+    uint8_t      type;
+    uint32_t     size;
+    uint32_t     id;
+
+    if ( len < 8 || memcmp( data, LG_BIN_MAGIC, 4 ) ) {
+        fprintf( stderr, "lgdecode: not a binary log\n" );
+        return 1;
+    }
+
+    lg_fmt_buf_init( &out );
+    pos = 8;
+
+    while ( pos + LG_BIN_REC_HEAD <= len ) {
+
+        const char* rec;
+        const char* end;
+
+        type = data[ pos ];
+        memcpy( &size, data + pos + 1, sizeof( size ) );
+
+        if ( size > len - pos - LG_BIN_REC_HEAD ) {
+            fprintf( stderr, "lgdecode: truncated record\n" );
+            break;
+        }
+
+        rec = data + pos + LG_BIN_REC_HEAD;
+        end = rec + size;
+        pos += LG_BIN_REC_HEAD + size;
+
+        if ( size < sizeof( id ) ) {
+            fprintf( stderr, "lgdecode: invalid record\n" );
+            continue;
+        }
+
+        memcpy( &id, rec, sizeof( id ) );
+
+        /* Each definition takes a record, which bounds the ids. */
+        if ( ( type == LG_BIN_REC_STR || type == LG_BIN_REC_GRP ) && id >= len ) {
+            fprintf( stderr, "lgdecode: invalid record\n" );
+            continue;
+        }
+
+        if ( type == LG_BIN_REC_STR ) {
+
+            table_put( &strs, id, rec + 4, size - 4 );
+
+        } else if ( type == LG_BIN_REC_GRP ) {
+
+            table_put( &grps, id, rec + 4, size - 4 );
+
+        } else if ( type == LG_BIN_REC_MSG ) {
+
+            const char* p;
+            const char* format;
+            uint32_t    fmt_id;
+            uint8_t     newline;
+            uint32_t    pre;
+            uint32_t    post;
+
+            if ( !selected( groups, group_cnt, table_get( &grps, id ) ) )
+                continue;
+
+            /* Group id, sequence, timestamp, format id, newline and
+             * prefix length. */
+            if ( size < 4 + 8 + 8 + 4 + 1 + 4 ) {
+                fprintf( stderr, "lgdecode: invalid message\n" );
+                continue;
+            }
+
+            p = rec + 4 + 8 + 8;
+            memcpy( &fmt_id, p, 4 );
+            p += 4;
+            newline = *p++;
+            memcpy( &pre, p, 4 );
+            p += 4;
+
+            if ( pre > (size_t)( end - p ) || 4 > (size_t)( end - p - pre ) ) {
+                fprintf( stderr, "lgdecode: invalid message\n" );
+                continue;
+            }
+
+            out.len = 0;
+            lg_fmt_buf_append( &out, p, pre );
+            p += pre;
+            memcpy( &post, p, 4 );
+            p += 4;
+
+            if ( post > (size_t)( end - p ) ) {
+                fprintf( stderr, "lgdecode: invalid message\n" );
+                continue;
+            }
+
+            format = table_get( &strs, fmt_id );
+            if ( format )
+                lg_fmt_render( &out, format, p + post, end - ( p + post ) );
+            lg_fmt_buf_append( &out, p, post );
+            if ( newline )
+                lg_fmt_buf_append( &out, "\n", 1 );
+
+            fwrite( out.data, 1, out.len, stdout );
+        }
+    }
+
+    lg_fmt_buf_free( &out );
+    table_free( &strs );
+    table_free( &grps );
+
+    return 0;
+}
+
+
+int main( int argc, char** argv )
+{
+    char** groups;
+    int    group_cnt;
+    char*  file;
+    char*  data;
+    size_t len;
+    int    ret;
+    int    i;
+
+    groups = malloc( argc * sizeof( char* ) );
+    group_cnt = 0;
+    file = NULL;
+
+    for ( i = 1; i < argc; i++ ) {
+        if ( !strcmp( argv[ i ], "-g" ) && i + 1 < argc ) {
+            groups[ group_cnt++ ] = argv[ ++i ];
+        } else if ( argv[ i ][ 0 ] == '-' ) {
+            file = NULL;
+            break;
+        } else {
+            file = argv[ i ];
+        }
+    }
+
+    if ( file == NULL ) {
+        fprintf( stderr, "Usage: lgdecode [-g <group>]... <file>\n" );
+        free( groups );
+        return 1;
+    }
+
+    data = read_file( file, &len );
+    if ( data == NULL ) {
+        fprintf( stderr, "lgdecode: can't read \"%s\"\n", file );
+        free( groups );
+        return 1;
+    }
+
+    ret = decode( data, len, groups, group_cnt );
+
+    free( data );
+    free( groups );
+
+    return ret;
+}
@@ -0,0 +1,256 @@
+/**
+ * @file   lgmerge.c
+ *
+ * @brief  Merger for Logger sharded Files.
+ *
+ * Merges shard Files of one sharded Log by sequence number and writes
+ * the messages in the order they were logged. With "-t" each record
+ * is preceded by its timestamp ("<sec>.<ns> "). Shards must be from
+ * the same run of the same Log. Gaps in the sequence, e.g. due to a
+ * missing shard, and duplicate sequences are reported to stderr.
+ *
+ *     lgmerge [-t] <shard>...
+ *
+ */
+
+#include "lg_shard.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/** Shard reading state. */
+typedef struct
+{
+    const char* name;   /**< File name. */
+    char*       data;   /**< File content. */
+    size_t      len;    /**< File length. */
+    uint32_t    idx;    /**< Shard index. */
+    uint32_t    cnt;    /**< Shard count. */
+    uint64_t    run;    /**< Run id. */
+    size_t      pos;    /**< Position of current record. */
+    uint64_t    seq;    /**< Sequence of current record. */
+    uint64_t    ns;     /**< Timestamp of current record. */
+    int         done;   /**< No more records. */
+} shard_t;
+
+
+static char* read_file( const char* name, size_t* len )
+{
+    FILE*  fh;
+    char*  data;
+    size_t size;
+    size_t ret;
+
+    fh = fopen( name, "rb" );
+    if ( fh == NULL )
+        return NULL;
+
+    size = 1 << 16;
+    data = malloc( size );
+    *len = 0;
+
+    while ( ( ret = fread( data + *len, 1, size - *len, fh ) ) > 0 ) {
+        *len += ret;
+        if ( *len == size ) {
+            size *= 2;
+            data = realloc( data, size );
+        }
+    }
+
+    fclose( fh );
+
+    return data;
+}
+
+
+/**
+ * Load sequence of record at current position, or mark shard done.
+ */
+static void shard_peek( shard_t* shard )
+{
+    uint32_t len;
+
+    if ( shard->pos == shard->len ) {
+        shard->done = 1;
+        return;
+    }
+
+    if ( shard->len - shard->pos < LG_SHARD_REC_HEAD ) {
+        fprintf( stderr, "lgmerge: truncated record in \"%s\"\n", shard->name );
+        shard->done = 1;
+        return;
+    }
+
+    memcpy( &shard->seq, shard->data + shard->pos, 8 );
+    memcpy( &shard->ns, shard->data + shard->pos + 8, 8 );
+    memcpy( &len, shard->data + shard->pos + 16, 4 );
+
+    if ( shard->len - shard->pos - LG_SHARD_REC_HEAD < len ) {
+        fprintf( stderr, "lgmerge: truncated record in \"%s\"\n", shard->name );
+        shard->done = 1;
+    }
+}
+
+
+static int shard_open( shard_t* shard, const char* name )
+{
+    uint32_t version;
+
+    shard->name = name;
+    shard->pos = LG_SHARD_HEAD;
+    shard->done = 0;
+
+    shard->data = read_file( name, &shard->len );
+    if ( shard->data == NULL ) {
+        fprintf( stderr, "lgmerge: can't read \"%s\"\n", name );
+        return 1;
+    }
+
+    if ( shard->len < LG_SHARD_HEAD || memcmp( shard->data, LG_SHARD_MAGIC, 4 ) ) {
+        fprintf( stderr, "lgmerge: \"%s\" is not a shard file\n", name );
+        return 1;
+    }
+
+    memcpy( &version, shard->data + 4, sizeof( version ) );
+    if ( version != LG_SHARD_VERSION ) {
+        fprintf( stderr, "lgmerge: unsupported version in \"%s\"\n", name );
+        return 1;
+    }
+
+    memcpy( &shard->idx, shard->data + 8, 4 );
+    memcpy( &shard->cnt, shard->data + 12, 4 );
+    memcpy( &shard->run, shard->data + 16, 8 );
+    if ( shard->idx >= shard->cnt ) {
+        fprintf( stderr, "lgmerge: invalid shard index in \"%s\"\n", name );
+        return 1;
+    }
+
+    shard_peek( shard );
+
+    return 0;
+}
+
+
+/**
+ * Check that last opened shard is from the same run as the first one,
+ * and that its index is not used by earlier shards.
+ */
+static int shard_match( shard_t* shards, int cnt )
+{
+    shard_t* shard = &shards[ cnt - 1 ];
+    int      i;
+
+    if ( shard->run != shards[ 0 ].run || shard->cnt != shards[ 0 ].cnt ) {
+        fprintf( stderr,
+                 "lgmerge: \"%s\" is from another run than \"%s\"\n",
+                 shard->name,
+                 shards[ 0 ].name );
+        return 1;
+    }
+
+    for ( i = 0; i < cnt - 1; i++ ) {
+        if ( shards[ i ].idx == shard->idx ) {
+            fprintf( stderr, "lgmerge: \"%s\" duplicates \"%s\"\n", shard->name, shards[ i ].name );
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+static void merge( shard_t* shards, int cnt, int stamp )
+{
+    shard_t* next;
+    uint64_t expect;
+    uint32_t len;
+    int      i;
+
+    expect = 0;
+
+    for ( ;; ) {
+
+        /* Shard counts are small, hence linear search. */
+        next = NULL;
+        for ( i = 0; i < cnt; i++ )
+            if ( !shards[ i ].done && ( next == NULL || shards[ i ].seq < next->seq ) )
+                next = &shards[ i ];
+
+        if ( next == NULL )
+            break;
+
+        /* Sequence below expected is a duplicate (or out of order)
+         * record, and it must not move the expectation back. */
+        if ( next->seq > expect )
+            fprintf( stderr,
+                     "lgmerge: missing records %llu..%llu\n",
+                     (unsigned long long)expect,
+                     (unsigned long long)( next->seq - 1 ) );
+        else if ( next->seq < expect )
+            fprintf( stderr,
+                     "lgmerge: duplicate record %llu in \"%s\"\n",
+                     (unsigned long long)next->seq,
+                     next->name );
+        if ( next->seq >= expect )
+            expect = next->seq + 1;
+
+        memcpy( &len, next->data + next->pos + 16, 4 );
+
+        if ( stamp )
+            printf( "%llu.%09llu ",
+                    (unsigned long long)( next->ns / 1000000000 ),
+                    (unsigned long long)( next->ns % 1000000000 ) );
+        fwrite( next->data + next->pos + LG_SHARD_REC_HEAD, 1, len, stdout );
+
+        next->pos += LG_SHARD_REC_HEAD + len;
+        shard_peek( next );
+    }
+}
+
+
+int main( int argc, char** argv )
+{
+    shard_t* shards;
+    int      cnt;
+    int      stamp;
+    int      usage;
+    int      ret;
+    int      i;
+
+    shards = malloc( argc * sizeof( shard_t ) );
+    cnt = 0;
+    stamp = 0;
+    usage = 0;
+    ret = 0;
+
+    for ( i = 1; i < argc; i++ ) {
+        if ( !strcmp( argv[ i ], "-t" ) ) {
+            stamp = 1;
+        } else if ( argv[ i ][ 0 ] == '-' ) {
+            usage = 1;
+            break;
+        } else {
+            shards[ cnt ].data = NULL;
+            if ( shard_open( &shards[ cnt++ ], argv[ i ] ) || shard_match( shards, cnt ) ) {
+                ret = 1;
+                break;
+            }
+        }
+    }
+
+    if ( ret == 0 && ( usage || cnt == 0 ) ) {
+        fprintf( stderr, "Usage: lgmerge [-t] <shard>...\n" );
+        ret = 1;
+    }
+
+    if ( ret == 0 )
+        merge( shards, cnt, stamp );
+
+    for ( i = 0; i < cnt; i++ )
+        free( shards[ i ].data );
+    free( shards );
+
+    return ret;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file   lgring.c
+ *
+ * @brief  Extractor for Logger flight recorder Files.
+ *
+ * Writes the content of ring File in chronological order. If the
+ * ring has wrapped around, the partial first line is skipped.
+ *
+ *     lgring <file>
+ *
+ */
+
+#include "lg_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static char* read_file( const char* name, size_t* len )
+{
+    FILE*  fh;
+    char*  data;
+    size_t size;
+    size_t ret;
+
+    fh = fopen( name, "rb" );
+    if ( fh == NULL )
+        return NULL;
+
+    size = 1 << 16;
+    data = malloc( size );
+    *len = 0;
+
+    while ( ( ret = fread( data + *len, 1, size - *len, fh ) ) > 0 ) {
+        *len += ret;
+        if ( *len == size ) {
+            size *= 2;
+            data = realloc( data, size );
+        }
+    }
+
+    fclose( fh );
+
+    return data;
+}
+
+
+static int extract( const char* data, size_t len )
+{
+    uint32_t    version;
+    uint64_t    size;
+    uint64_t    pos;
+    const char* ring;
+    const char* nl;
+    size_t      at;
+
+    if ( len < LG_RING_HEAD || memcmp( data, LG_RING_MAGIC, 4 ) ) {
+        fprintf( stderr, "lgring: not a ring file\n" );
+        return 1;
+    }
+
+    memcpy( &version, data + 4, sizeof( version ) );
+    memcpy( &size, data + LG_RING_OFF_SIZE, sizeof( size ) );
+    memcpy( &pos, data + LG_RING_OFF_POS, sizeof( pos ) );
+
+    if ( version != LG_RING_VERSION || size == 0 || len < LG_RING_HEAD + size ) {
+        fprintf( stderr, "lgring: unsupported or truncated ring file\n" );
+        return 1;
+    }
+
+    ring = data + LG_RING_HEAD;
+
+    if ( pos <= size ) {
+        fwrite( ring, 1, pos, stdout );
+        return 0;
+    }
+
+    /* Oldest data starts at write position. */
+    at = pos % size;
+    nl = memchr( ring + at, '\n', size - at );
+    if ( nl ) {
+        fwrite( nl + 1, 1, ring + size - ( nl + 1 ), stdout );
+        fwrite( ring, 1, at, stdout );
+    } else {
+        nl = memchr( ring, '\n', at );
+        if ( nl )
+            fwrite( nl + 1, 1, ring + at - ( nl + 1 ), stdout );
+    }
+
+    return 0;
+}
+
+
+int main( int argc, char** argv )
+{
+    char*  data;
+    size_t len;
+    int    ret;
+
+    if ( argc != 2 || argv[ 1 ][ 0 ] == '-' ) {
+        fprintf( stderr, "Usage: lgring <file>\n" );
+        return 1;
+    }
+
+    data = read_file( argv[ 1 ], &len );
+    if ( data == NULL ) {
+        fprintf( stderr, "lgring: can't read \"%s\"\n", argv[ 1 ] );
+        return 1;
+    }
+
+    ret = extract( data, len );
+
+    free( data );
+
+    return ret;
+}